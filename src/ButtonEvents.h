@@ -0,0 +1,223 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#ifndef __BUTTON_EVENTS_H__
+#define __BUTTON_EVENTS_H__
+
+// button presses / releases over a reliable, ordered sub channel of the UDP
+// transport. axes stay in frames, latest wins, so a lost frame costs nothing
+// but a lost press would be missed by the application.
+//
+//   sender   --> {"evt":{"s":S,"ts":T,"id":I,"b0":B,"ev":[[button,down,dt],...]}}
+//   receiver --> {"evack":{"s":S,"ts":T,"id":I}}
+//
+// the sender numbers each edge of the button bit mask and keeps it until acked.
+// all pending events go in one packet: at a new edge, and again after the
+// retransmission timeout (2 x smoothed rtt, from "ts" echoed by the ack).
+// "id" is the id of the first event, "b0" the buttons before it.
+//
+// the receiver delivers each event once and in order, and acks the last one
+// delivered (cumulative). "s" is the start time of the sender: a restarted
+// sender counts ids from 1 again. events the sender gave up on (MAX_PENDING,
+// receiver gone for long) are skipped, and the buttons are taken from "b0".
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+#include "json.hpp"
+
+struct ButtonEvent
+{
+	uint32_t id;
+	int64_t ts;	// sender time of the edge [usec].
+	uint8_t button;	// bit of GamepadState::buttons.
+	bool down;
+	uint16_t buttons;	// all buttons after this event.
+};
+
+class ButtonEventSender
+{
+public:
+	static constexpr size_t MAX_PENDING = 48;	// a packet of them fits in 1500 bytes.
+	static constexpr int64_t RTO_INIT = 100'000;	// [usec], until the first ack.
+	static constexpr int64_t RTO_MIN = 10'000;	// [usec].
+	static constexpr int64_t RTO_MAX = 1'000'000;	// [usec].
+
+	// edges between the last buttons and buttons, at ts [usec]. returns the number
+	// of events given up on to make room (the oldest ones).
+	uint32_t update(uint16_t buttons, int64_t ts)
+	{
+		if (m_start == 0) m_start = ts;
+
+		uint32_t lost = 0;
+		const uint16_t diff = buttons ^ m_buttons;
+		for (int i = 0; i < 16; i++) {
+			if (!((diff >> i) & 1)) continue;
+			if (m_pending.size() >= MAX_PENDING) {
+				m_pending.pop_front();
+				lost++;
+			}
+			ButtonEvent e = {};
+			e.id = m_next++;
+			e.ts = ts;
+			e.button = i;
+			e.down = (buttons >> i) & 1;
+			e.buttons = m_buttons ^ (diff & ((2u << i) - 1));
+			m_pending.push_back(e);
+			m_fresh = true;
+		}
+		m_buttons = buttons;
+
+		return lost;
+	}
+
+	// the pending events are due now. retransmit is set if they were sent before.
+	bool due(int64_t now, bool &retransmit) const
+	{
+		retransmit = false;
+		if (m_pending.empty()) return false;
+		if (m_fresh) return true;
+
+		retransmit = (now - m_sent >= m_rto);
+		return retransmit;
+	}
+
+	// packet of all pending events, sent at now.
+	nlohmann::json packet(int64_t now)
+	{
+		if (!m_fresh) m_rto = std::min(m_rto * 2, RTO_MAX);	// back off.
+		m_fresh = false;
+		m_sent = now;
+
+		auto &first = m_pending.front();
+		nlohmann::json ev = nlohmann::json::array();
+		for (auto &e : m_pending) ev.push_back({ e.button, e.down ? 1 : 0, e.ts - now });
+		uint16_t b0 = first.buttons ^ (1 << first.button);
+
+		return { { "evt", { { "s", m_start }, { "ts", now }, { "id", first.id }, { "b0", b0 }, { "ev", std::move(ev) } } } };
+	}
+
+	// {"s","ts","id"} of "evack".
+	void on_ack(const nlohmann::json &ack, int64_t now)
+	{
+		int64_t start, ts;
+		uint32_t id;
+		try {
+			start = ack.at("s").get<int64_t>();
+			ts = ack.at("ts").get<int64_t>();
+			id = ack.at("id").get<uint32_t>();
+		} catch (nlohmann::json::exception &e) {
+			return;
+		}
+		if (start != m_start) return;	// to the previous run.
+
+		while (!m_pending.empty() && int32_t(m_pending.front().id - id) <= 0) m_pending.pop_front();
+
+		const int64_t rtt = now - ts;
+		if (rtt < 0 || rtt > RTO_MAX) return;
+		m_srtt = m_srtt ? (7 * m_srtt + rtt) / 8 : rtt;
+		m_rto = std::clamp(2 * m_srtt, RTO_MIN, RTO_MAX);
+	}
+
+	bool IsPending() const { return !m_pending.empty(); }
+	int64_t GetRto() const { return m_rto; }
+	int64_t GetStart() const { return m_start; }
+
+private:
+	int64_t m_start = 0;	// [usec], identifies this run.
+	uint32_t m_next = 1;
+	uint16_t m_buttons = 0;
+	std::deque<ButtonEvent> m_pending;	// not acked yet, oldest first.
+	bool m_fresh = false;	// new events since the last packet.
+	int64_t m_sent = 0;	// last packet [usec].
+	int64_t m_srtt = 0;	// [usec].
+	int64_t m_rto = RTO_INIT;	// [usec].
+};
+
+class ButtonEventReceiver
+{
+public:
+	// "evt" of a packet. events not delivered yet are appended to out, ack is the
+	// "evack" to send back. returns false if evt is broken.
+	bool on_packet(const nlohmann::json &evt, std::vector<ButtonEvent> &out, nlohmann::json &ack, uint32_t &lost)
+	{
+		lost = 0;
+		try {
+			const int64_t start = evt.at("s").get<int64_t>();
+			const int64_t ts = evt.at("ts").get<int64_t>();
+			const uint32_t first = evt.at("id").get<uint32_t>();
+			const auto &ev = evt.at("ev");
+			if (!ev.is_array()) return false;
+
+			if (start != m_start) {
+				// new sender, or a restarted one.
+				m_start = start;
+				m_last = first - 1;
+				m_buttons = evt.at("b0").get<uint16_t>();
+			} else if (int32_t(first - m_last) > 1) {
+				// given up by the sender.
+				lost = first - m_last - 1;
+				m_last = first - 1;
+				m_buttons = evt.at("b0").get<uint16_t>();
+			}
+
+			for (size_t i = 0; i < ev.size(); i++) {
+				const uint32_t id = first + i;
+				if (int32_t(id - m_last) <= 0) continue;	// delivered.
+
+				auto &e = ev[i];
+				if (!e.is_array() || e.size() != 3) return false;
+				ButtonEvent be = {};
+				be.id = id;
+				be.ts = ts + e[2].get<int64_t>();
+				be.button = e[0].get<uint8_t>() & 15;
+				be.down = e[1].get<int>() != 0;
+				if (be.down) m_buttons |= (1 << be.button);
+				else m_buttons &= ~(1 << be.button);
+				be.buttons = m_buttons;
+				out.push_back(be);
+				m_last = id;
+			}
+
+			ack = { { "evack", { { "s", m_start }, { "ts", ts }, { "id", m_last } } } };
+		} catch (nlohmann::json::exception &e) {
+			return false;
+		}
+
+		return true;
+	}
+
+	bool IsActive() const { return m_start != 0; }
+	int64_t GetStart() const { return m_start; }
+	uint16_t GetButtons() const { return m_buttons; }
+
+private:
+	int64_t m_start = 0;	// of the sender.
+	uint32_t m_last = 0;	// id of the last event delivered.
+	uint16_t m_buttons = 0;
+};
+
+#endif
@@ -0,0 +1,131 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#ifndef __CLOCK_SYNC_H__
+#define __CLOCK_SYNC_H__
+
+#include <cstdint>
+#include <array>
+#include <atomic>
+
+// estimate clock offset between sender and receiver, NTP style.
+//
+//   receiver  t1 --ping--> t2  sender
+//   receiver  t4 <-frame-- t3  sender  (pong is carried in the next frame)
+//
+//   offset = ((t2 - t1) + (t3 - t4)) / 2   sender clock - receiver clock.
+//   rtt    = (t4 - t1) - (t3 - t2)
+//
+// samples with large rtt are likely delayed on one way only, so the offset of
+// the sample with minimum rtt in the last NUM_SAMPLES is used (NTP clock filter).
+class ClockSync
+{
+public:
+	static constexpr int NUM_SAMPLES = 8;
+	static constexpr int64_t PING_INTERVAL = 1'000'000;	// [usec].
+	static constexpr int64_t PING_INTERVAL_FAST = 250'000;	// [usec], until the filter is filled.
+
+	struct Sample {
+		int64_t offset = 0;
+		int64_t rtt = -1;	// < 0 : empty.
+	};
+
+	// add one exchange. all time stamps are [usec].
+	bool add(int64_t t1, int64_t t2, int64_t t3, int64_t t4)
+	{
+		if (t1 <= 0 || t2 <= 0 || t3 <= 0 || t4 <= 0) return false;
+
+		Sample s;
+		s.rtt = (t4 - t1) - (t3 - t2);
+		s.offset = ((t2 - t1) + (t3 - t4)) / 2;
+		if (s.rtt < 0 || t4 < t1) return false;
+
+		m_samples[m_next] = s;
+		m_next = (m_next + 1) % NUM_SAMPLES;
+		if (m_count < NUM_SAMPLES) m_count++;
+
+		// pick minimum rtt.
+		const Sample *best = nullptr;
+		for (auto &e : m_samples) {
+			if (e.rtt < 0) continue;
+			if (!best || e.rtt < best->rtt) best = &e;
+		}
+		m_offset.store(best->offset, std::memory_order_relaxed);
+		m_rtt.store(best->rtt, std::memory_order_relaxed);
+		m_valid.store(true, std::memory_order_release);
+
+		return true;
+	}
+
+	// time to send next ping.
+	bool need_ping(int64_t now)
+	{
+		auto interval = (m_count < NUM_SAMPLES) ? PING_INTERVAL_FAST : PING_INTERVAL;
+		if (now - m_last_ping < interval) return false;
+
+		m_last_ping = now;
+		return true;
+	}
+
+	void reset()
+	{
+		m_samples = {};
+		m_next = 0;
+		m_count = 0;
+		m_last_ping = 0;
+		m_valid = false;
+		m_offset = 0;
+		m_rtt = 0;
+	}
+
+	bool IsValid() const { return m_valid.load(std::memory_order_acquire); }
+	int64_t GetOffset() const { return m_offset.load(std::memory_order_relaxed); }
+	int64_t GetRtt() const { return m_rtt.load(std::memory_order_relaxed); }
+
+	// sender time stamp -> receiver local time. as is, if not estimated yet.
+	int64_t to_local(int64_t t_sender) const
+	{
+		if (t_sender == 0 || !IsValid()) return t_sender;
+		return t_sender - GetOffset();
+	}
+
+	// receiver local time -> sender time stamp, the inverse of to_local().
+	int64_t to_sender(int64_t t_local) const
+	{
+		if (t_local == 0 || !IsValid()) return t_local;
+		return t_local + GetOffset();
+	}
+
+private:
+	std::array<Sample, NUM_SAMPLES> m_samples = {};
+	int m_next = 0;
+	int m_count = 0;
+	int64_t m_last_ping = 0;
+
+	// read from metrics exporter thread.
+	std::atomic<bool> m_valid{false};
+	std::atomic<int64_t> m_offset{0};
+	std::atomic<int64_t> m_rtt{0};
+};
+
+#endif
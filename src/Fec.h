@@ -0,0 +1,223 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#ifndef __FEC_H__
+#define __FEC_H__
+
+// forward error correction for the UDP transport, XOR parity over groups of frames.
+//
+//   frames  : seq  first .. first + K - 1
+//   parity i: XOR of frames j (first + j) with j % M == i, i = 0 .. M - 1
+//
+// a parity packet rebuilds one lost frame of the frames it covers, without a
+// round trip. M interleaved parities rebuild a burst of up to M lost frames.
+// overhead is M / K packets, each as large as the largest frame it covers.
+//
+// frames are the usual packets (JSON), so the receiver needs no setting. parity
+// packets start with FecHeader::MAGIC, which is never the start of JSON.
+//
+// with adaptive K, the sender picks K from the loss rate the receiver reports
+// in its pings: more parity for a lossy link, less for a clean one.
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <vector>
+#include <algorithm>
+
+struct FecHeader
+{
+	static constexpr char MAGIC[4] = { 'V', 'G', 'F', '1' };
+
+	char magic[4];
+	uint32_t first;		// seq of the first frame of the group.
+	uint8_t k;		// frames in the group.
+	uint8_t m;		// parity packets of the group.
+	uint8_t index;		// this parity, covers frames j % m == index.
+	uint8_t reserved;
+	uint16_t length;	// XOR of lengths of the covered frames.
+	uint16_t reserved2;
+};
+static_assert(sizeof(FecHeader) == 16, "FecHeader must be 16 bytes");
+
+class FecEncoder
+{
+public:
+	static constexpr int MAX_K = 32;
+	static constexpr int MAX_M = 4;
+
+	// k frames per group (0: adaptive), m parity packets per group. m = 0 disables.
+	bool configure(int k, int m)
+	{
+		if (k < 0 || k > MAX_K || m < 0 || m > MAX_M || (k != 0 && k < m)) return false;
+
+		m_adaptive = (k == 0);
+		m_m = m;
+		m_next_k = m_adaptive ? MAX_K / 2 : k;
+		m_group.clear();
+
+		return true;
+	}
+
+	bool enabled() const { return m_m > 0; }
+	int GetK() const { return m_next_k; }
+	int GetM() const { return m_m; }
+
+	// loss rate reported by the receiver [0, 1]. takes effect from the next group.
+	void set_loss(double loss)
+	{
+		if (!m_adaptive || loss < 0.0) return;
+
+		// a group is lost only if a parity set loses 2 or more frames, keep it rare.
+		int k;
+		if (loss < 0.005) k = 32;
+		else if (loss < 0.01) k = 16;
+		else if (loss < 0.03) k = 8;
+		else if (loss < 0.08) k = 4;
+		else k = 2;
+		m_next_k = std::max(k, m_m);
+	}
+
+	// a frame was sent. parity packets are made when the group is complete.
+	void add(uint32_t seq, const std::vector<char> &pkt, std::vector<std::vector<char>> &parity)
+	{
+		parity.clear();
+		if (!enabled()) return;
+
+		// a frame not sent (dropped before the socket) breaks the group, start again.
+		if (!m_group.empty() && seq != m_first + m_group.size()) m_group.clear();
+		if (m_group.empty()) {
+			m_first = seq;
+			m_k = m_next_k;
+		}
+		m_group.push_back(pkt);
+		if (int(m_group.size()) < m_k) return;
+
+		for (int i = 0; i < m_m; i++) {
+			size_t size = 0;
+			for (int j = i; j < m_k; j += m_m) size = std::max(size, m_group[j].size());
+
+			std::vector<char> p(sizeof(FecHeader) + size, 0);
+			FecHeader h = {};
+			memcpy(h.magic, FecHeader::MAGIC, sizeof h.magic);
+			h.first = m_first;
+			h.k = m_k;
+			h.m = m_m;
+			h.index = i;
+			auto payload = p.data() + sizeof(FecHeader);
+			for (int j = i; j < m_k; j += m_m) {
+				auto &f = m_group[j];
+				for (size_t n = 0; n < f.size(); n++) payload[n] ^= f[n];
+				h.length ^= uint16_t(f.size());
+			}
+			memcpy(p.data(), &h, sizeof h);
+			parity.push_back(std::move(p));
+		}
+		m_group.clear();
+	}
+
+private:
+	bool m_adaptive = false;
+	int m_m = 0;
+	int m_next_k = 0;
+	int m_k = 0;	// of the current group.
+	uint32_t m_first = 0;
+	std::vector<std::vector<char>> m_group;
+};
+
+class FecDecoder
+{
+public:
+	static constexpr uint32_t HISTORY = 128;	// frames kept to rebuild a lost one.
+
+	static bool is_parity(const char *data, size_t size)
+	{
+		return size >= sizeof(FecHeader) && memcmp(data, FecHeader::MAGIC, sizeof FecHeader::MAGIC) == 0;
+	}
+
+	// frames are kept only after the first parity packet, no cost without FEC.
+	bool IsActive() const { return m_active; }
+
+	// a received frame.
+	void add(uint32_t seq, const std::vector<char> &pkt)
+	{
+		if (!m_active) return;
+
+		auto &slot = m_frames[seq % HISTORY];
+		if (slot.valid && slot.seq == seq) return;
+		slot.seq = seq;
+		slot.valid = true;
+		slot.pkt = pkt;
+	}
+
+	// a parity packet. true if a lost frame is rebuilt into pkt.
+	bool recover(const char *data, size_t size, std::vector<char> &pkt)
+	{
+		if (!is_parity(data, size)) return false;
+		m_active = true;
+
+		FecHeader h;
+		memcpy(&h, data, sizeof h);
+		if (h.k == 0 || h.k > HISTORY / 2 || h.m == 0 || h.index >= h.m) return false;
+
+		int lost = -1;
+		uint16_t length = h.length;
+		for (uint32_t j = h.index; j < h.k; j += h.m) {
+			auto seq = h.first + j;
+			auto &slot = m_frames[seq % HISTORY];
+			if (slot.valid && slot.seq == seq) {
+				length ^= uint16_t(slot.pkt.size());
+				continue;
+			}
+			if (lost >= 0) return false;	// 2 or more lost, can't.
+			lost = j;
+		}
+		if (lost < 0) return false;	// nothing lost.
+
+		const size_t payload_size = size - sizeof(FecHeader);
+		if (length == 0 || length > payload_size) return false;
+		pkt.assign(data + sizeof(FecHeader), data + size);
+		for (uint32_t j = h.index; j < h.k; j += h.m) {
+			if (int(j) == lost) continue;
+			auto &f = m_frames[(h.first + j) % HISTORY].pkt;
+			for (size_t n = 0; n < std::min(f.size(), pkt.size()); n++) pkt[n] ^= f[n];
+		}
+		pkt.resize(length);
+		add(h.first + lost, pkt);
+
+		return true;
+	}
+
+private:
+	struct Slot {
+		uint32_t seq = 0;
+		bool valid = false;
+		std::vector<char> pkt;
+	};
+
+	bool m_active = false;
+	std::array<Slot, HISTORY> m_frames;
+};
+
+#endif
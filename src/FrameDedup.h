@@ -0,0 +1,86 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#ifndef __FRAME_DEDUP_H__
+#define __FRAME_DEDUP_H__
+
+#include <cstdint>
+#include <array>
+
+// accept each frame once, and only if it's newer than the latest accepted one.
+// for redundant paths, the first copy to arrive wins and the others are dropped.
+//
+//   DUPLICATE : same seq and send time stamp as one of the last WINDOW frames.
+//   LATE      : older than the latest accepted frame (reordered), the state is
+//               already newer.
+//
+// a restarted sender counts seq from 1 again, so a frame behind in seq but newer
+// by the send time stamp is accepted.
+class FrameDedup
+{
+public:
+	static constexpr uint32_t WINDOW = 64;
+
+	enum class em_Result : int {
+		ACCEPT,
+		DUPLICATE,
+		LATE,
+	};
+
+	em_Result check(uint32_t seq, int64_t ts)
+	{
+		auto &slot = m_seen[seq % WINDOW];
+		if (m_count > 0) {
+			if (slot.seq == seq && slot.ts == ts) return em_Result::DUPLICATE;
+			if (int32_t(seq - m_seq) <= 0 && ts <= m_ts) return em_Result::LATE;
+		}
+
+		slot.seq = seq;
+		slot.ts = ts;
+		m_seq = seq;
+		m_ts = ts;
+		m_count++;
+
+		return em_Result::ACCEPT;
+	}
+
+	void reset()
+	{
+		m_seen = {};
+		m_count = 0;
+	}
+
+private:
+	struct Seen {
+		uint32_t seq = 0;
+		int64_t ts = -1;
+	};
+
+	std::array<Seen, WINDOW> m_seen = {};
+	uint32_t m_seq = 0;	// latest accepted.
+	int64_t m_ts = 0;
+	uint64_t m_count = 0;
+};
+
+#endif
@@ -0,0 +1,554 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#ifndef __GAMEPAD_ARCHIVE_H__
+#define __GAMEPAD_ARCHIVE_H__
+
+// columnar, compressed archive of gamepad frames, for long-term storage.
+//
+//   file  = header (64 bytes) + chunks + chunk index + trailer (16 bytes).
+//   chunk = chunk header (80 bytes) + one column per field.
+//
+// each chunk holds up to CHUNK_FRAMES frames. fields are stored column by
+// column, so similar values are next to each other:
+//   ts, seq, ts_send, ts_recv : delta of delta (nearly constant increment).
+//   axis[]                    : delta.
+//   buttons, flags            : run length (value, length - 1).
+// deltas are zigzag encoded to unsigned and written as LEB128 varint, a run of
+// zero deltas is written as (0, length - 1), so an idle stick costs nothing.
+//
+// the chunk index at the end has the time range of every chunk for seeking.
+// if it's missing (writer crashed), the reader walks the chunk headers instead.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "GamepadState.h"
+
+struct GamepadArchiveHeader
+{
+	static constexpr char MAGIC[8] = { 'V', 'G', 'M', 'P', 'A', 'R', 'C', '1' };
+
+	char magic[8];
+	uint32_t version;
+	uint32_t chunk_frames;
+	uint32_t mode;			// 0: send, 1: receive.
+	uint32_t reserved;
+	int64_t ts_start;		// [usec].
+	char source[32];		// host:port/protocol.
+};
+static_assert(sizeof(GamepadArchiveHeader) == 64, "GamepadArchiveHeader must be 64 bytes");
+
+struct GamepadArchiveChunk
+{
+	static constexpr char MAGIC[4] = { 'C', 'H', 'N', 'K' };
+
+	enum {
+		COL_TS,
+		COL_SEQ,
+		COL_TS_SEND,
+		COL_TS_RECV,
+		COL_AXIS,	// NUM_AXIS columns.
+		COL_BUTTONS = COL_AXIS + GamepadState::NUM_AXIS,
+		COL_FLAGS,
+		NUM_COLUMNS,
+	};
+
+	char magic[4];
+	uint32_t num_frames;
+	uint32_t seq_first;
+	uint32_t size;			// bytes of columns, following this header.
+	int64_t ts_first;
+	int64_t ts_last;
+	uint32_t column_size[NUM_COLUMNS];
+};
+static_assert(sizeof(GamepadArchiveChunk) == 80, "GamepadArchiveChunk must be 80 bytes");
+
+struct GamepadArchiveIndex
+{
+	uint64_t offset;		// of chunk header, from the beginning of the file.
+	int64_t ts_first;
+	int64_t ts_last;
+	uint32_t seq_first;
+	uint32_t num_frames;
+};
+static_assert(sizeof(GamepadArchiveIndex) == 32, "GamepadArchiveIndex must be 32 bytes");
+
+struct GamepadArchiveTrailer
+{
+	static constexpr char MAGIC[4] = { 'V', 'G', 'A', 'E' };
+
+	uint64_t index_offset;
+	uint32_t num_chunks;
+	char magic[4];
+};
+static_assert(sizeof(GamepadArchiveTrailer) == 16, "GamepadArchiveTrailer must be 16 bytes");
+
+// one frame, same fields as GamepadRecord.
+struct GamepadArchiveFrame
+{
+	uint32_t seq;
+	int64_t ts;			// recorded [usec].
+	int64_t ts_send;	// [usec], 0 if unknown.
+	int64_t ts_recv;	// [usec], 0 if not received.
+	GamepadState state;
+};
+
+namespace gamepad_archive {
+
+inline uint64_t zigzag(int64_t v) { return (uint64_t(v) << 1) ^ uint64_t(v >> 63); }
+inline int64_t unzigzag(uint64_t v) { return int64_t(v >> 1) ^ -int64_t(v & 1); }
+
+inline void put_varint(std::string &out, uint64_t v)
+{
+	while (v >= 0x80) {
+		out.push_back(char(v | 0x80));
+		v >>= 7;
+	}
+	out.push_back(char(v));
+}
+
+inline bool get_varint(const uint8_t *&p, const uint8_t *end, uint64_t &v)
+{
+	// 1 byte is the most common case.
+	if (p < end && *p < 0x80) {
+		v = *p++;
+		return true;
+	}
+
+	v = 0;
+	for (int shift = 0; p < end && shift < 64; shift += 7) {
+		uint8_t b = *p++;
+		v |= uint64_t(b & 0x7f) << shift;
+		if (b < 0x80) return true;
+	}
+	return false;
+}
+
+// order 1: delta, order 2: delta of delta. zero runs as (0, length - 1).
+inline void encode_deltas(std::string &out, const std::vector<int64_t> &v, int order)
+{
+	int64_t prev = 0, prev_d = 0;
+	uint64_t zeros = 0;
+	auto flush = [&]() {
+		if (zeros == 0) return;
+		put_varint(out, 0);
+		put_varint(out, zeros - 1);
+		zeros = 0;
+	};
+
+	for (auto x : v) {
+		int64_t d = x - prev;
+		int64_t e = (order == 2) ? d - prev_d : d;
+		prev = x;
+		prev_d = d;
+
+		if (e == 0) {
+			zeros++;
+			continue;
+		}
+		flush();
+		put_varint(out, zigzag(e));
+	}
+	flush();
+}
+
+inline bool decode_deltas(const uint8_t *p, size_t size, int64_t *v, size_t n, int order)
+{
+	auto end = p + size;
+	int64_t prev = 0, prev_d = 0;
+	size_t i = 0;
+
+	while (i < n) {
+		uint64_t u;
+		if (!get_varint(p, end, u)) return false;
+
+		uint64_t count = 1;
+		int64_t e = 0;
+		if (u == 0) {
+			if (!get_varint(p, end, count)) return false;
+			count++;
+			if (count > n - i) return false;
+		} else {
+			e = unzigzag(u);
+		}
+
+		for (uint64_t k = 0; k < count; k++) {
+			int64_t d = (order == 2) ? prev_d + e : e;
+			prev += d;
+			prev_d = d;
+			v[i++] = prev;
+		}
+	}
+
+	return p == end;
+}
+
+// (value, length - 1) pairs.
+inline void encode_runs(std::string &out, const std::vector<int64_t> &v)
+{
+	for (size_t i = 0; i < v.size();) {
+		size_t j = i + 1;
+		while (j < v.size() && v[j] == v[i]) j++;
+		put_varint(out, uint64_t(v[i]));
+		put_varint(out, j - i - 1);
+		i = j;
+	}
+}
+
+inline bool decode_runs(const uint8_t *p, size_t size, int64_t *v, size_t n)
+{
+	auto end = p + size;
+	size_t i = 0;
+
+	while (i < n) {
+		uint64_t value, len;
+		if (!get_varint(p, end, value) || !get_varint(p, end, len)) return false;
+		if (len >= n - i) return false;
+		for (uint64_t k = 0; k <= len; k++) v[i++] = int64_t(value);
+	}
+
+	return p == end;
+}
+
+}	// namespace gamepad_archive
+
+// write frames to an archive. frames are buffered and written chunk by chunk.
+class GamepadArchiveWriter
+{
+public:
+	static constexpr uint32_t VERSION = 1;
+	static constexpr uint32_t CHUNK_FRAMES = 4096;
+
+	GamepadArchiveWriter() {}
+	virtual ~GamepadArchiveWriter() { close(); }
+
+	bool open(const std::string &path, const std::string &source, bool receive, int64_t ts_start)
+	{
+		close();
+
+		m_fp = fopen(path.c_str(), "wb");
+		if (!m_fp) return false;
+		setvbuf(m_fp, nullptr, _IOFBF, 1 << 16);
+
+		GamepadArchiveHeader h = {};
+		memcpy(h.magic, GamepadArchiveHeader::MAGIC, sizeof h.magic);
+		h.version = VERSION;
+		h.chunk_frames = CHUNK_FRAMES;
+		h.mode = receive ? 1 : 0;
+		h.ts_start = ts_start;
+		strncpy(h.source, source.c_str(), sizeof h.source - 1);
+		if (fwrite(&h, sizeof h, 1, m_fp) != 1) {
+			fclose(m_fp);
+			m_fp = nullptr;
+			return false;
+		}
+
+		m_offset = sizeof h;
+		m_frames = 0;
+		m_index.clear();
+		for (auto &c : m_columns) {
+			c.clear();
+			c.reserve(CHUNK_FRAMES);
+		}
+
+		return true;
+	}
+
+	// flush the last chunk and write the index.
+	bool close()
+	{
+		if (!m_fp) return false;
+
+		bool ok = flush_chunk();
+
+		GamepadArchiveTrailer t = {};
+		t.index_offset = m_offset;
+		t.num_chunks = m_index.size();
+		memcpy(t.magic, GamepadArchiveTrailer::MAGIC, sizeof t.magic);
+		if (!m_index.empty() && fwrite(m_index.data(), sizeof(GamepadArchiveIndex), m_index.size(), m_fp) != m_index.size()) ok = false;
+		if (fwrite(&t, sizeof t, 1, m_fp) != 1) ok = false;
+
+		if (fclose(m_fp) != 0) ok = false;
+		m_fp = nullptr;
+
+		return ok;
+	}
+
+	bool IsOpen() const { return m_fp != nullptr; }
+	uint64_t GetFrames() const { return m_frames; }
+
+	bool write(const GamepadArchiveFrame &f)
+	{
+		if (!m_fp) return false;
+
+		using C = GamepadArchiveChunk;
+		m_columns[C::COL_TS].push_back(f.ts);
+		m_columns[C::COL_SEQ].push_back(f.seq);
+		m_columns[C::COL_TS_SEND].push_back(f.ts_send);
+		m_columns[C::COL_TS_RECV].push_back(f.ts_recv);
+		for (int i = 0; i < GamepadState::NUM_AXIS; i++) m_columns[C::COL_AXIS + i].push_back(f.state.axis[i]);
+		m_columns[C::COL_BUTTONS].push_back(f.state.buttons);
+		m_columns[C::COL_FLAGS].push_back(f.state.flags);
+		m_frames++;
+
+		if (m_columns[0].size() >= CHUNK_FRAMES) return flush_chunk();
+		return true;
+	}
+
+private:
+	bool flush_chunk()
+	{
+		using C = GamepadArchiveChunk;
+		auto n = m_columns[0].size();
+		if (n == 0) return true;
+
+		GamepadArchiveChunk c = {};
+		memcpy(c.magic, C::MAGIC, sizeof c.magic);
+		c.num_frames = n;
+		c.seq_first = m_columns[C::COL_SEQ].front();
+		c.ts_first = m_columns[C::COL_TS].front();
+		c.ts_last = m_columns[C::COL_TS].back();
+
+		m_buf.clear();
+		for (int i = 0; i < C::NUM_COLUMNS; i++) {
+			auto before = m_buf.size();
+			switch (i) {
+			case C::COL_TS:
+			case C::COL_SEQ:
+			case C::COL_TS_SEND:
+			case C::COL_TS_RECV:
+				gamepad_archive::encode_deltas(m_buf, m_columns[i], 2);
+				break;
+			case C::COL_BUTTONS:
+			case C::COL_FLAGS:
+				gamepad_archive::encode_runs(m_buf, m_columns[i]);
+				break;
+			default:
+				gamepad_archive::encode_deltas(m_buf, m_columns[i], 1);
+				break;
+			}
+			c.column_size[i] = m_buf.size() - before;
+			m_columns[i].clear();
+		}
+		c.size = m_buf.size();
+
+		if (fwrite(&c, sizeof c, 1, m_fp) != 1) return false;
+		if (fwrite(m_buf.data(), 1, m_buf.size(), m_fp) != m_buf.size()) return false;
+
+		m_index.push_back({ m_offset, c.ts_first, c.ts_last, c.seq_first, c.num_frames });
+		m_offset += sizeof c + m_buf.size();
+
+		return true;
+	}
+
+	FILE *m_fp = nullptr;
+	uint64_t m_offset = 0;
+	uint64_t m_frames = 0;
+	std::vector<int64_t> m_columns[GamepadArchiveChunk::NUM_COLUMNS];
+	std::vector<GamepadArchiveIndex> m_index;
+	std::string m_buf;
+};
+
+// read an archive with mmap.
+class GamepadArchiveReader
+{
+public:
+	GamepadArchiveReader() {}
+	virtual ~GamepadArchiveReader() { close(); }
+
+	bool open(const std::string &path)
+	{
+		close();
+
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(GamepadArchiveHeader)) {
+			::close(fd);
+			return false;
+		}
+		m_size = st.st_size;
+		m_addr = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (m_addr == MAP_FAILED) {
+			m_addr = nullptr;
+			return false;
+		}
+
+		auto h = header();
+		if (memcmp(h->magic, GamepadArchiveHeader::MAGIC, sizeof h->magic) != 0) {
+			close();
+			return false;
+		}
+
+		if (!load_index()) scan_chunks();
+
+		return true;
+	}
+
+	void close()
+	{
+		if (m_addr) munmap(m_addr, m_size);
+		m_addr = nullptr;
+		m_size = 0;
+		m_index.clear();
+	}
+
+	const GamepadArchiveHeader *header() const { return (const GamepadArchiveHeader *)m_addr; }
+	size_t size() const { return m_size; }
+
+	const std::vector<GamepadArchiveIndex> &chunks() const { return m_index; }
+
+	uint64_t frames() const
+	{
+		uint64_t n = 0;
+		for (auto &ix : m_index) n += ix.num_frames;
+		return n;
+	}
+
+	// first chunk which may have a frame with ts >= t, chunks().size() if none.
+	size_t find(int64_t t) const
+	{
+		size_t lo = 0, hi = m_index.size();
+		while (lo < hi) {
+			auto mid = (lo + hi) / 2;
+			if (m_index[mid].ts_last < t) lo = mid + 1;
+			else hi = mid;
+		}
+		return lo;
+	}
+
+	// decode a chunk, frames are appended.
+	bool read_chunk(size_t n, std::vector<GamepadArchiveFrame> &frames)
+	{
+		using C = GamepadArchiveChunk;
+		if (n >= m_index.size()) return false;
+
+		auto base = (const uint8_t *)m_addr;
+		auto &c = *(const C *)(base + m_index[n].offset);
+		auto num = c.num_frames;
+		if (num > header()->chunk_frames) return false;
+
+		for (auto &col : m_columns) col.resize(num);
+		auto p = base + m_index[n].offset + sizeof c;
+		for (int i = 0; i < C::NUM_COLUMNS; i++) {
+			bool ok;
+			switch (i) {
+			case C::COL_TS:
+			case C::COL_SEQ:
+			case C::COL_TS_SEND:
+			case C::COL_TS_RECV:
+				ok = gamepad_archive::decode_deltas(p, c.column_size[i], m_columns[i].data(), num, 2);
+				break;
+			case C::COL_BUTTONS:
+			case C::COL_FLAGS:
+				ok = gamepad_archive::decode_runs(p, c.column_size[i], m_columns[i].data(), num);
+				break;
+			default:
+				ok = gamepad_archive::decode_deltas(p, c.column_size[i], m_columns[i].data(), num, 1);
+				break;
+			}
+			if (!ok) return false;
+			p += c.column_size[i];
+		}
+
+		auto first = frames.size();
+		frames.resize(first + num);
+		for (uint32_t k = 0; k < num; k++) {
+			auto &f = frames[first + k];
+			f.ts = m_columns[C::COL_TS][k];
+			f.seq = uint32_t(m_columns[C::COL_SEQ][k]);
+			f.ts_send = m_columns[C::COL_TS_SEND][k];
+			f.ts_recv = m_columns[C::COL_TS_RECV][k];
+			for (int i = 0; i < GamepadState::NUM_AXIS; i++) f.state.axis[i] = int16_t(m_columns[C::COL_AXIS + i][k]);
+			f.state.buttons = uint16_t(m_columns[C::COL_BUTTONS][k]);
+			f.state.flags = uint8_t(m_columns[C::COL_FLAGS][k]);
+			f.state.reserved = 0;
+		}
+
+		return true;
+	}
+
+private:
+	// a chunk header fits in the file, and its columns add up.
+	bool valid_chunk(uint64_t offset) const
+	{
+		if (offset + sizeof(GamepadArchiveChunk) > m_size) return false;
+		auto &c = *(const GamepadArchiveChunk *)((const char *)m_addr + offset);
+		if (memcmp(c.magic, GamepadArchiveChunk::MAGIC, sizeof c.magic) != 0) return false;
+		if (offset + sizeof c + c.size > m_size) return false;
+
+		uint64_t total = 0;
+		for (auto s : c.column_size) total += s;
+		return total == c.size;
+	}
+
+	bool load_index()
+	{
+		if (m_size < sizeof(GamepadArchiveHeader) + sizeof(GamepadArchiveTrailer)) return false;
+
+		auto &t = *(const GamepadArchiveTrailer *)((const char *)m_addr + m_size - sizeof(GamepadArchiveTrailer));
+		if (memcmp(t.magic, GamepadArchiveTrailer::MAGIC, sizeof t.magic) != 0) return false;
+		if (t.index_offset + uint64_t(t.num_chunks) * sizeof(GamepadArchiveIndex) + sizeof t != m_size) return false;
+
+		auto ix = (const GamepadArchiveIndex *)((const char *)m_addr + t.index_offset);
+		for (uint32_t i = 0; i < t.num_chunks; i++) {
+			if (!valid_chunk(ix[i].offset)) {
+				m_index.clear();
+				return false;
+			}
+			m_index.push_back(ix[i]);
+		}
+
+		return true;
+	}
+
+	// no index (writer still running, or crashed), walk chunk headers.
+	void scan_chunks()
+	{
+		uint64_t offset = sizeof(GamepadArchiveHeader);
+		while (valid_chunk(offset)) {
+			auto &c = *(const GamepadArchiveChunk *)((const char *)m_addr + offset);
+			m_index.push_back({ offset, c.ts_first, c.ts_last, c.seq_first, c.num_frames });
+			offset += sizeof c + c.size;
+		}
+	}
+
+	void *m_addr = nullptr;
+	size_t m_size = 0;
+	std::vector<GamepadArchiveIndex> m_index;
+	std::vector<int64_t> m_columns[GamepadArchiveChunk::NUM_COLUMNS];
+};
+
+#endif
@@ -0,0 +1,311 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#ifndef __GAMEPAD_RECORD_H__
+#define __GAMEPAD_RECORD_H__
+
+// binary recording of gamepad frames.
+//
+//   file = header (64 bytes) + records (64 bytes each).
+//   every INDEX_INTERVAL-th record slot is an index record summarizing the
+//   preceding INDEX_INTERVAL - 1 frame records (time / sequence range),
+//   so a reader can binary search by time over the index slots only.
+//   the last block has no index record until it's completed.
+//
+// all records are fixed size and little endian (host order), the file can be
+// mmap()ed and read as an array of GamepadRecord without parsing.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <chrono>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "GamepadState.h"
+
+struct GamepadRecordHeader
+{
+	static constexpr char MAGIC[8] = { 'V', 'G', 'M', 'P', 'R', 'E', 'C', '1' };
+
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t index_interval;
+	uint32_t mode;			// 0: send, 1: receive.
+	int64_t ts_start;		// [usec].
+	char source[32];		// host:port/protocol.
+};
+static_assert(sizeof(GamepadRecordHeader) == 64, "GamepadRecordHeader must be 64 bytes");
+
+struct GamepadRecord
+{
+	enum : uint16_t {
+		TYPE_FRAME = 1,
+		TYPE_INDEX = 2,
+	};
+
+	uint16_t type;
+	uint16_t reserved0;
+	uint32_t seq;			// frame sequence number.
+	int64_t ts;				// recorded, local wall clock [usec].
+	union {
+		struct {
+			int64_t ts_send;	// sender time stamp, in local time if clock offset is known [usec]. 0 if unknown.
+			int64_t ts_recv;	// received (receiver only) [usec]. 0 if not received.
+			GamepadState state;
+			uint8_t reserved1[16];
+		} frame;
+		struct {
+			int64_t ts_first;	// ts of the first frame in this block.
+			uint32_t seq_first;
+			uint32_t num_frames;
+			uint64_t frame_no;	// number of frames before this block.
+			uint8_t reserved1[24];
+		} index;
+	};
+};
+static_assert(sizeof(GamepadRecord) == 64, "GamepadRecord must be 64 bytes");
+
+// append frames to a file.
+class GamepadRecordWriter
+{
+public:
+	static constexpr uint32_t VERSION = 1;
+	static constexpr uint32_t INDEX_INTERVAL = 1024;	// slots per block, including index record.
+	static constexpr int64_t FLUSH_INTERVAL = 1'000'000;	// [usec].
+
+	GamepadRecordWriter() {}
+	virtual ~GamepadRecordWriter() { close(); }
+
+	bool open(const std::string &path, const std::string &source, bool receive)
+	{
+		close();
+
+		m_fp = fopen(path.c_str(), "wb");
+		if (!m_fp) return false;
+		setvbuf(m_fp, nullptr, _IOFBF, 1 << 16);
+
+		GamepadRecordHeader h = {};
+		memcpy(h.magic, GamepadRecordHeader::MAGIC, sizeof h.magic);
+		h.version = VERSION;
+		h.record_size = sizeof(GamepadRecord);
+		h.index_interval = INDEX_INTERVAL;
+		h.mode = receive ? 1 : 0;
+		h.ts_start = now();
+		strncpy(h.source, source.c_str(), sizeof h.source - 1);
+		if (fwrite(&h, sizeof h, 1, m_fp) != 1) {
+			close();
+			return false;
+		}
+
+		m_slot = 0;
+		m_frames = 0;
+		m_block_frames = 0;
+		m_ts_flush = h.ts_start;
+
+		return true;
+	}
+
+	void close()
+	{
+		if (!m_fp) return;
+
+		fclose(m_fp);
+		m_fp = nullptr;
+	}
+
+	bool IsOpen() const { return m_fp != nullptr; }
+	uint64_t GetFrames() const { return m_frames; }
+
+	bool write(uint32_t seq, int64_t ts_send, int64_t ts_recv, const GamepadState &state)
+	{
+		if (!m_fp) return false;
+
+		GamepadRecord r = {};
+		r.type = GamepadRecord::TYPE_FRAME;
+		r.seq = seq;
+		r.ts = now();
+		r.frame.ts_send = ts_send;
+		r.frame.ts_recv = ts_recv;
+		r.frame.state = state;
+		if (!put(r)) return false;
+
+		if (m_block_frames == 0) {
+			m_block.ts_first = r.ts;
+			m_block.seq_first = seq;
+		}
+		m_block_frames++;
+		m_frames++;
+		m_last_seq = seq;
+		m_last_ts = r.ts;
+
+		// close the block.
+		if ((m_slot % INDEX_INTERVAL) == INDEX_INTERVAL - 1) {
+			GamepadRecord ix = {};
+			ix.type = GamepadRecord::TYPE_INDEX;
+			ix.seq = m_last_seq;
+			ix.ts = m_last_ts;
+			ix.index.ts_first = m_block.ts_first;
+			ix.index.seq_first = m_block.seq_first;
+			ix.index.num_frames = m_block_frames;
+			ix.index.frame_no = m_frames - m_block_frames;
+			if (!put(ix)) return false;
+			m_block_frames = 0;
+		}
+
+		// stdio buffer is written when full, and at least once a second.
+		if (r.ts - m_ts_flush >= FLUSH_INTERVAL) {
+			fflush(m_fp);
+			m_ts_flush = r.ts;
+		}
+
+		return true;
+	}
+
+private:
+	static int64_t now()
+	{
+		auto t = std::chrono::system_clock::now().time_since_epoch();
+		return std::chrono::duration_cast<std::chrono::microseconds>(t).count();
+	}
+
+	bool put(const GamepadRecord &r)
+	{
+		if (fwrite(&r, sizeof r, 1, m_fp) != 1) return false;
+		m_slot++;
+		return true;
+	}
+
+	FILE *m_fp = nullptr;
+	uint64_t m_slot = 0;	// records written, including index.
+	uint64_t m_frames = 0;
+	uint32_t m_block_frames = 0;
+	struct {
+		int64_t ts_first;
+		uint32_t seq_first;
+	} m_block = {};
+	uint32_t m_last_seq = 0;
+	int64_t m_last_ts = 0;
+	int64_t m_ts_flush = 0;
+};
+
+// read a recording with mmap.
+class GamepadRecordReader
+{
+public:
+	GamepadRecordReader() {}
+	virtual ~GamepadRecordReader() { close(); }
+
+	bool open(const std::string &path)
+	{
+		close();
+
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(GamepadRecordHeader)) {
+			::close(fd);
+			return false;
+		}
+		m_size = st.st_size;
+		m_addr = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (m_addr == MAP_FAILED) {
+			m_addr = nullptr;
+			return false;
+		}
+
+		auto h = header();
+		if (memcmp(h->magic, GamepadRecordHeader::MAGIC, sizeof h->magic) != 0
+			|| h->record_size != sizeof(GamepadRecord) || h->index_interval < 2) {
+			close();
+			return false;
+		}
+		// a partial record at the end (writer still running, or crashed) is ignored.
+		m_slots = (m_size - sizeof(GamepadRecordHeader)) / sizeof(GamepadRecord);
+
+		return true;
+	}
+
+	void close()
+	{
+		if (m_addr) munmap(m_addr, m_size);
+		m_addr = nullptr;
+		m_size = 0;
+		m_slots = 0;
+	}
+
+	const GamepadRecordHeader *header() const { return (const GamepadRecordHeader *)m_addr; }
+
+	// all records, frame and index.
+	size_t slots() const { return m_slots; }
+	const GamepadRecord *records() const
+	{
+		return (const GamepadRecord *)((const char *)m_addr + sizeof(GamepadRecordHeader));
+	}
+	const GamepadRecord &operator[](size_t slot) const { return records()[slot]; }
+
+	// first frame slot with ts >= t, slots() if none.
+	size_t find(int64_t t) const
+	{
+		auto interval = header()->index_interval;
+		auto num_blocks = m_slots / interval;
+
+		// binary search over index records.
+		size_t lo = 0, hi = num_blocks;
+		while (lo < hi) {
+			auto mid = (lo + hi) / 2;
+			auto &ix = records()[(mid + 1) * interval - 1];
+			if (ix.type == GamepadRecord::TYPE_INDEX && ix.ts < t) lo = mid + 1;
+			else hi = mid;
+		}
+
+		// linear in the block.
+		for (size_t i = lo * interval; i < m_slots; i++) {
+			auto &r = records()[i];
+			if (r.type == GamepadRecord::TYPE_FRAME && r.ts >= t) return i;
+		}
+		return m_slots;
+	}
+
+	// next frame slot from slot (inclusive), slots() if none.
+	size_t next_frame(size_t slot) const
+	{
+		while (slot < m_slots && records()[slot].type != GamepadRecord::TYPE_FRAME) slot++;
+		return slot;
+	}
+
+private:
+	void *m_addr = nullptr;
+	size_t m_size = 0;
+	size_t m_slots = 0;
+};
+
+#endif
@@ -0,0 +1,81 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#ifndef __GAMEPAD_STATE_H__
+#define __GAMEPAD_STATE_H__
+
+#include <cstdint>
+
+// gamepad state, fixed size POD.
+// binary form of the json packet, for recording and shared memory.
+struct GamepadState
+{
+	enum : uint16_t {
+		BUTTON_A = 1 << 0,
+		BUTTON_B = 1 << 1,
+		BUTTON_X = 1 << 2,
+		BUTTON_Y = 1 << 3,
+		BUTTON_BACK = 1 << 4,
+		BUTTON_GUIDE = 1 << 5,
+		BUTTON_START = 1 << 6,
+		BUTTON_STICK_L = 1 << 7,
+		BUTTON_STICK_R = 1 << 8,
+		BUTTON_SHOULDER_L = 1 << 9,
+		BUTTON_SHOULDER_R = 1 << 10,
+		BUTTON_DPAD_U = 1 << 11,
+		BUTTON_DPAD_D = 1 << 12,
+		BUTTON_DPAD_L = 1 << 13,
+		BUTTON_DPAD_R = 1 << 14,
+	};
+	enum : uint8_t {
+		FLAG_AXIS_MOTION = 1 << 0,
+		FLAG_BUTTON_DOWN = 1 << 1,
+		FLAG_BUTTON_UP = 1 << 2,
+	};
+	enum {
+		AXIS_LEFT_X,
+		AXIS_LEFT_Y,
+		AXIS_RIGHT_X,
+		AXIS_RIGHT_Y,
+		AXIS_TRIGGER_L,
+		AXIS_TRIGGER_R,
+		NUM_AXIS,
+	};
+	static constexpr int NUM_BUTTON = 15;
+
+	int16_t axis[NUM_AXIS];
+	uint16_t buttons;	// BUTTON_xxx.
+	uint8_t flags;		// FLAG_xxx, events since previous frame.
+	uint8_t reserved;
+
+	bool operator==(const GamepadState &s) const
+	{
+		for (int i = 0; i < NUM_AXIS; i++) if (axis[i] != s.axis[i]) return false;
+		return buttons == s.buttons && flags == s.flags;
+	}
+	bool operator!=(const GamepadState &s) const { return !(*this == s); }
+};
+static_assert(sizeof(GamepadState) == 16, "GamepadState must be 16 bytes");
+
+#endif
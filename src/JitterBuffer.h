@@ -0,0 +1,148 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#ifndef __JITTER_BUFFER_H__
+#define __JITTER_BUFFER_H__
+
+// receiver side, plays frames out at the pace they were sent, not as they arrive.
+//
+//   transit = receive time (local) - send time (sender clock)
+//   base    = minimum transit of the last WINDOW frames, the fastest path.
+//   target  = (PERCENTILE of transit - base) + MARGIN, at most max_delay.
+//   playout = send time + base + target
+//
+// so the frames arriving within the target are spaced as the sender spaced them,
+// at the cost of target [usec] of latency. the target follows the measured jitter:
+// up at once when frames arrive later than it, down slowly (1 / DECAY per frame),
+// so a quieter link doesn't bunch the frames already in the buffer.
+//
+// the sender clock is used as is: a new clock offset estimate (ClockSync.h) must
+// not move the frames in the buffer. transit includes the offset, it cancels out.
+//
+// a frame arriving after its playout time is played at once (late), unless a newer
+// one is already played, then it's dropped.
+
+#include <cstdint>
+#include <array>
+#include <deque>
+#include <atomic>
+#include <algorithm>
+
+#include "GamepadState.h"
+
+class JitterBuffer
+{
+public:
+	static constexpr int WINDOW = 128;	// [frames].
+	static constexpr double PERCENTILE = 0.98;
+	static constexpr int64_t MARGIN = 1'000;	// [usec].
+	static constexpr int DECAY = 32;	// [frames].
+
+	struct Frame {
+		uint32_t seq;
+		int64_t ts_send;	// [usec], sender clock.
+		int64_t ts_recv;	// [usec].
+		GamepadState state;
+	};
+
+	// max_delay : cap of the target [usec]. 0 : disabled.
+	explicit JitterBuffer(int64_t max_delay = 0) : m_max_delay(max_delay) {}
+
+	bool IsEnabled() const { return m_max_delay > 0; }
+
+	// measure : false for a frame rebuilt from a later one (its receive time is not its own).
+	void push(const Frame &f, bool measure = true)
+	{
+		if (f.ts_send <= m_played) {
+			m_late.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		if (measure) update_target(f.ts_recv - f.ts_send);
+		if (playout(f) < f.ts_recv) m_late.fetch_add(1, std::memory_order_relaxed);
+
+		// in the order sent, usually at the end.
+		auto itr = m_frames.end();
+		while (itr != m_frames.begin() && std::prev(itr)->ts_send > f.ts_send) --itr;
+		if (itr != m_frames.begin() && std::prev(itr)->ts_send == f.ts_send) return;	// same frame.
+		m_frames.insert(itr, f);
+	}
+
+	// the next frame due at now, in the order sent.
+	bool pop(int64_t now, Frame &f)
+	{
+		if (m_frames.empty() || playout(m_frames.front()) > now) return false;
+
+		f = m_frames.front();
+		m_frames.pop_front();
+		m_played = f.ts_send;
+
+		return true;
+	}
+
+	// playout time of the next frame [usec]. 0 if empty.
+	int64_t next() const { return m_frames.empty() ? 0 : playout(m_frames.front()); }
+
+	// read from metrics exporter thread.
+	int64_t GetTarget() const { return m_target_out.load(std::memory_order_relaxed); }
+	uint64_t GetLate() const { return m_late.load(std::memory_order_relaxed); }
+
+private:
+	int64_t playout(const Frame &f) const { return f.ts_send + m_base + m_target; }
+
+	void update_target(int64_t transit)
+	{
+		m_transit[m_next] = transit;
+		m_next = (m_next + 1) % WINDOW;
+		if (m_count < WINDOW) m_count++;
+
+		std::array<int64_t, WINDOW> t;
+		std::copy_n(m_transit.begin(), m_count, t.begin());
+		auto p = t.begin() + int((m_count - 1) * PERCENTILE);
+		std::nth_element(t.begin(), p, t.begin() + m_count);
+		m_base = *std::min_element(t.begin(), t.begin() + m_count);
+
+		const int64_t want = std::min(*p - m_base + MARGIN, m_max_delay);
+		if (want > m_target) {
+			m_target = want;
+		} else {
+			m_target -= (m_target - want) / DECAY;
+		}
+		m_target_out.store(m_target, std::memory_order_relaxed);
+	}
+
+	int64_t m_max_delay;	// [usec].
+	std::deque<Frame> m_frames;	// waiting, in the order sent.
+	int64_t m_played = 0;	// send time of the last frame played.
+
+	std::array<int64_t, WINDOW> m_transit = {};
+	int m_next = 0;
+	int m_count = 0;
+	int64_t m_base = 0;	// [usec].
+	int64_t m_target = 0;	// [usec].
+
+	std::atomic<int64_t> m_target_out{0};
+	std::atomic<uint64_t> m_late{0};
+};
+
+#endif
@@ -0,0 +1,134 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#ifndef __JSON_FRAMES_H__
+#define __JSON_FRAMES_H__
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+#include "GamepadState.h"
+
+// split captured stdout of vgmpad_send / vgmpad_recv into JSON frames.
+// the capture is a mix of log lines and (pretty printed) JSON objects,
+// so only top level '{' ... '}' blocks are picked up.
+namespace json_frames {
+
+// call func(const char *begin, size_t len) for every top level JSON object in text.
+template<typename F>
+size_t for_each_object(const char *text, size_t size, F &&func)
+{
+	size_t num = 0;
+	int depth = 0;
+	bool in_string = false;
+	bool escape = false;
+	size_t begin = 0;
+
+	for (size_t i = 0; i < size; i++) {
+		const char c = text[i];
+
+		if (in_string) {
+			if (escape) escape = false;
+			else if (c == '\\') escape = true;
+			else if (c == '"') in_string = false;
+			continue;
+		}
+
+		if (c == '"') {
+			if (depth > 0) in_string = true;
+		} else if (c == '{') {
+			if (depth == 0) begin = i;
+			depth++;
+		} else if (c == '}' && depth > 0) {
+			depth--;
+			if (depth == 0) {
+				func(text + begin, i - begin + 1);
+				num++;
+			}
+		}
+	}
+
+	return num;
+}
+
+// parse every frame in text. frames which can't be parsed are skipped.
+inline std::vector<nlohmann::json> parse(const std::string &text)
+{
+	std::vector<nlohmann::json> frames;
+
+	for_each_object(text.data(), text.size(), [&](const char *p, size_t len) {
+		auto js = nlohmann::json::parse(p, p + len, nullptr, false);
+		if (!js.is_discarded()) frames.push_back(std::move(js));
+	});
+
+	return frames;
+}
+
+// frame -> binary state. false if it's not a gamepad frame.
+inline bool to_state(const nlohmann::json &js, GamepadState &s)
+{
+	static const char *axes[GamepadState::NUM_AXIS] = {
+		"axis_Left_X", "axis_Left_Y", "axis_Right_X", "axis_Right_Y", "axis_Trigger_L", "axis_Trigger_R",
+	};
+	static const char *buttons[GamepadState::NUM_BUTTON] = {
+		"button_A", "button_B", "button_X", "button_Y",
+		"button_Back", "button_Guide", "button_Start",
+		"button_Stick_L", "button_Stick_R", "button_Shoulder_L", "button_Shoulder_R",
+		"button_Dpad_U", "button_Dpad_D", "button_Dpad_L", "button_Dpad_R",
+	};
+
+	s = {};
+	try {
+		for (int i = 0; i < GamepadState::NUM_AXIS; i++) s.axis[i] = js.at(axes[i]).get<int16_t>();
+		for (int i = 0; i < GamepadState::NUM_BUTTON; i++) {
+			if (js.at(buttons[i]).get<int>()) s.buttons |= (1 << i);
+		}
+		if (js.at("axis_motion").get<bool>()) s.flags |= GamepadState::FLAG_AXIS_MOTION;
+		if (js.at("button_down").get<bool>()) s.flags |= GamepadState::FLAG_BUTTON_DOWN;
+		if (js.at("button_up").get<bool>()) s.flags |= GamepadState::FLAG_BUTTON_UP;
+	} catch (nlohmann::json::exception &e) {
+		return false;
+	}
+
+	return true;
+}
+
+inline bool read_file(const std::string &path, std::string &text)
+{
+	std::ifstream ifs(path, std::ios::binary);
+	if (!ifs) return false;
+
+	std::stringstream ss;
+	ss << ifs.rdbuf();
+	text = ss.str();
+
+	return true;
+}
+
+}	// namespace json_frames
+
+#endif
@@ -0,0 +1,253 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#ifndef __VGMPAD_LOGGER_H__
+#define __VGMPAD_LOGGER_H__
+
+// asynchronous logger for LogError/LogInfo/... .
+//
+// * the caller formats into a slot of a lock-free ring and returns, a background
+//   thread writes to stderr. a slow terminal or pipe never blocks the caller.
+// * stdout is left to the data (JSON, records), a log line never splits them.
+//   if the ring is full the message is dropped and counted.
+// * each call site is rate limited (RATE_LIMIT messages per second). suppressed
+//   messages are not even formatted, an error storm costs one atomic increment.
+// * levels above VGMPAD_LOG_LEVEL are removed at compile time.
+//     0: error, 1: success, 2: info, 3: verbose, 4: debug (default).
+
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#ifndef VGMPAD_LOG_LEVEL
+#define VGMPAD_LOG_LEVEL 4
+#endif
+
+class Logger
+{
+public:
+	static constexpr size_t NUM_SLOTS = 1024;	// power of 2.
+	static constexpr size_t SLOT_SIZE = 512;	// longer messages are truncated.
+	static constexpr uint32_t RATE_LIMIT = 20;	// messages per second, per call site.
+
+	// state of one call site (LogXxx in source).
+	struct Site {
+		std::atomic<int64_t> window{0};	// [sec].
+		std::atomic<uint32_t> count{0};
+		std::atomic<uint32_t> suppressed{0};
+	};
+
+	static Logger &instance()
+	{
+		// never destroyed, may be used from static destructors.
+		static Logger *logger = new Logger();
+		return *logger;
+	}
+
+	void write(Site &site, const char *fmt, ...) __attribute__((format(printf, 3, 4)))
+	{
+		// rate limit, before formatting.
+		auto now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		auto window = site.window.load(std::memory_order_relaxed);
+		uint32_t suppressed = 0;
+		if (now != window && site.window.compare_exchange_strong(window, now, std::memory_order_relaxed)) {
+			site.count.store(0, std::memory_order_relaxed);
+			suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+		}
+		if (site.count.fetch_add(1, std::memory_order_relaxed) >= RATE_LIMIT) {
+			site.suppressed.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		if (suppressed > 0) {
+			push("(last message repeated, %u similar messages suppressed)\n", suppressed);
+		}
+
+		va_list ap;
+		va_start(ap, fmt);
+		vpush(fmt, ap);
+		va_end(ap);
+	}
+
+	// wait until all queued messages are written.
+	void flush()
+	{
+		if (!m_running) return;
+
+		auto target = m_tail.load(std::memory_order_acquire);
+		m_cv.notify_one();
+		while (m_written.load(std::memory_order_acquire) < target && m_running) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	uint64_t GetDropped() const { return m_dropped_total.load(std::memory_order_relaxed); }
+
+private:
+	struct Slot {
+		std::atomic<size_t> seq;
+		int len;
+		char text[SLOT_SIZE];
+	};
+
+	Logger()
+	{
+		for (size_t i = 0; i < NUM_SLOTS; i++) m_slots[i].seq.store(i, std::memory_order_relaxed);
+
+		m_running = true;
+		m_thread = std::thread([this]() { run(); });
+		atexit([]() { Logger::instance().stop(); });
+	}
+
+	void push(const char *fmt, ...) __attribute__((format(printf, 2, 3)))
+	{
+		va_list ap;
+		va_start(ap, fmt);
+		vpush(fmt, ap);
+		va_end(ap);
+	}
+
+	void vpush(const char *fmt, va_list ap)
+	{
+		// after stop (exit), write directly.
+		if (!m_running) {
+			vfprintf(stderr, fmt, ap);
+			fflush(stderr);
+			return;
+		}
+
+		// bounded MPMC queue (D. Vyukov), single consumer.
+		auto pos = m_tail.load(std::memory_order_relaxed);
+		Slot *slot;
+		for (;;) {
+			slot = &m_slots[pos & (NUM_SLOTS - 1)];
+			auto seq = slot->seq.load(std::memory_order_acquire);
+			auto diff = intptr_t(seq) - intptr_t(pos);
+			if (diff == 0) {
+				if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+			} else if (diff < 0) {
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+				m_dropped_total.fetch_add(1, std::memory_order_relaxed);
+				return;
+			} else {
+				pos = m_tail.load(std::memory_order_relaxed);
+			}
+		}
+
+		auto n = vsnprintf(slot->text, SLOT_SIZE, fmt, ap);
+		slot->len = (n < 0) ? 0 : std::min<int>(n, SLOT_SIZE - 1);
+		slot->seq.store(pos + 1, std::memory_order_release);
+
+		if (m_idle.load(std::memory_order_relaxed)) m_cv.notify_one();
+	}
+
+	void run()
+	{
+		size_t head = 0;
+		while (m_running || head != m_tail.load(std::memory_order_acquire)) {
+			bool any = false;
+			for (;;) {
+				auto &slot = m_slots[head & (NUM_SLOTS - 1)];
+				if (slot.seq.load(std::memory_order_acquire) != head + 1) break;
+
+				fwrite(slot.text, 1, slot.len, stderr);
+				slot.seq.store(head + NUM_SLOTS, std::memory_order_release);
+				head++;
+				any = true;
+			}
+			if (auto d = m_dropped.exchange(0, std::memory_order_relaxed)) {
+				fprintf(stderr, "(log ring full, %lu messages dropped)\n", (unsigned long)d);
+				any = true;
+			}
+			if (any) fflush(stderr);
+			m_written.store(head, std::memory_order_release);
+
+			if (!any && m_running) {
+				// producer notifies only while idle, wait_for covers a missed notify.
+				std::unique_lock<std::mutex> lk(m_mtx);
+				m_idle.store(true, std::memory_order_relaxed);
+				m_cv.wait_for(lk, std::chrono::milliseconds(10));
+				m_idle.store(false, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	void stop()
+	{
+		if (!m_running) return;
+
+		flush();
+		m_running = false;
+		m_cv.notify_one();
+		if (m_thread.joinable()) m_thread.join();
+	}
+
+	Slot m_slots[NUM_SLOTS];
+	std::atomic<size_t> m_tail{0};
+	std::atomic<size_t> m_written{0};
+	std::atomic<uint64_t> m_dropped{0};
+	std::atomic<uint64_t> m_dropped_total{0};
+
+	std::atomic<bool> m_running{false};
+	std::atomic<bool> m_idle{false};
+	std::mutex m_mtx;
+	std::condition_variable m_cv;
+	std::thread m_thread;
+};
+
+#define VGMPAD_LOG(...) do { static Logger::Site log_site_; Logger::instance().write(log_site_, __VA_ARGS__); } while (0)
+
+#define LogError(...) VGMPAD_LOG(__VA_ARGS__)
+
+#if VGMPAD_LOG_LEVEL >= 1
+#define LogSuccess(...) VGMPAD_LOG(__VA_ARGS__)
+#else
+#define LogSuccess(...) do {} while (0)
+#endif
+
+#if VGMPAD_LOG_LEVEL >= 2
+#define LogInfo(...) VGMPAD_LOG(__VA_ARGS__)
+#else
+#define LogInfo(...) do {} while (0)
+#endif
+
+#if VGMPAD_LOG_LEVEL >= 3
+#define LogVerbose(...) VGMPAD_LOG(__VA_ARGS__)
+#else
+#define LogVerbose(...) do {} while (0)
+#endif
+
+#if VGMPAD_LOG_LEVEL >= 4
+#define LogDebug(...) VGMPAD_LOG(__VA_ARGS__)
+#else
+#define LogDebug(...) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,292 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#ifndef __OUTPUT_SINK_H__
+#define __OUTPUT_SINK_H__
+
+// where vgmpad_recv writes the received gamepad state.
+//
+//   pretty         : pretty printed JSON to stdout every loop. (as before)
+//   ndjson[:PATH]  : one compact JSON per line every loop, buffered.
+//   changes[:PATH] : same as ndjson, only when sticks or buttons changed.
+//   binary[:PATH]  : GamepadRecord (64 bytes, see GamepadRecord.h) per new frame,
+//                    for a FIFO / pipe.
+//   none           : nothing.
+//
+// PATH is a file or FIFO, stdout if omitted or "-". log lines go to stderr (Logger.h),
+// so stdout has nothing but the sink.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+#include "VirtualGamepad.h"
+#include "GamepadRecord.h"
+
+class OutputSink
+{
+public:
+	static std::unique_ptr<OutputSink> Create(const std::string &spec);
+
+	virtual ~OutputSink() {}
+
+	// the frame being written, the state is vg's. with the jitter buffer, it's
+	// the one played out, not the newest one received.
+	struct Frame {
+		uint32_t seq;
+		int64_t ts_send;	// [usec], in local time if clock offset is known.
+		int64_t ts_recv;	// [usec].
+	};
+	static Frame Latest(const VirtualGamepad &vg) { return { vg.GetSeq(), vg.GetSendTime(), vg.GetRecvTime() }; }
+
+	// called every loop, or every frame played out. false on write error.
+	virtual bool write(const VirtualGamepad &vg, const Frame &frame) = 0;
+	// called every loop, writes out what is buffered when it's time, also
+	// while nothing is written (changes of an idle pad, jitter buffer waiting).
+	virtual void flush() {}
+
+	const std::string &GetName() const { return m_name; }
+
+protected:
+	static int64_t now()
+	{
+		auto t = std::chrono::system_clock::now().time_since_epoch();
+		return std::chrono::duration_cast<std::chrono::microseconds>(t).count();
+	}
+
+	std::string m_name;
+};
+
+// as before, std::cout << std::setw(2) << js << std::endl.
+class OutputSinkPretty : public OutputSink
+{
+public:
+	OutputSinkPretty() { m_name = "pretty"; }
+
+	bool write(const VirtualGamepad &vg, const Frame &) override
+	{
+		to_json(m_js, vg);
+		std::cout << std::setw(2) << m_js << std::endl;
+		return bool(std::cout);
+	}
+
+private:
+	njson m_js;
+};
+
+// buffered stdio stream, flushed when the buffer is full or every flush_interval.
+class OutputSinkFile : public OutputSink
+{
+public:
+	static constexpr size_t BUFFER_SIZE = 1 << 16;
+
+	virtual ~OutputSinkFile() { close(); }
+
+	bool open(const std::string &path, int64_t flush_interval)
+	{
+		close();
+
+		if (path.empty() || path == "-") {
+			m_fp = stdout;
+		} else {
+			// a FIFO blocks here until the reader opens it.
+			m_fp = fopen(path.c_str(), "w");
+			if (!m_fp) return false;
+			setvbuf(m_fp, nullptr, _IOFBF, BUFFER_SIZE);
+		}
+		m_flush_interval = flush_interval;
+		m_ts_flush = now();
+		m_error = false;
+
+		return true;
+	}
+
+	void close()
+	{
+		if (!m_fp) return;
+
+		fflush(m_fp);
+		if (m_fp != stdout) fclose(m_fp);
+		m_fp = nullptr;
+	}
+
+	void flush() override
+	{
+		if (!m_fp || m_error) return;
+
+		auto t = now();
+		if (t - m_ts_flush >= m_flush_interval) {
+			m_ts_flush = t;
+			if (fflush(m_fp) != 0) error();
+		}
+	}
+
+protected:
+	bool put(const void *data, size_t size)
+	{
+		if (!m_fp || m_error) return false;
+
+		bool ok = (fwrite(data, 1, size, m_fp) == size);
+
+		auto t = now();
+		if (ok && t - m_ts_flush >= m_flush_interval) {
+			ok = (fflush(m_fp) == 0);
+			m_ts_flush = t;
+		}
+
+		if (!ok) error();
+
+		return ok;
+	}
+
+	void error()
+	{
+		// reader of the pipe has gone. (SIGPIPE should be ignored)
+		LogError("ERROR!! output %s: %s\n", m_name.c_str(), strerror(errno));
+		m_error = true;
+	}
+
+	FILE *m_fp = nullptr;
+	int64_t m_flush_interval = 0;	// [usec].
+	int64_t m_ts_flush = 0;
+	bool m_error = false;
+};
+
+// one compact JSON per line.
+class OutputSinkNDJSON : public OutputSinkFile
+{
+public:
+	static constexpr int64_t FLUSH_INTERVAL = 100'000;	// [usec].
+
+	OutputSinkNDJSON() { m_name = "ndjson"; }
+
+	bool write(const VirtualGamepad &vg, const Frame &) override
+	{
+		to_json(m_js, vg);
+		m_line = m_js.dump();
+		m_line.push_back('\n');
+		return put(m_line.data(), m_line.size());
+	}
+
+protected:
+	njson m_js;
+	std::string m_line;
+};
+
+// ndjson, only when sticks or buttons changed. event flags are not compared,
+// they stay set until the next frame arrives.
+class OutputSinkChanges : public OutputSinkNDJSON
+{
+public:
+	OutputSinkChanges() { m_name = "changes"; }
+
+	bool write(const VirtualGamepad &vg, const Frame &frame) override
+	{
+		auto s = vg.get_state();
+		s.flags = 0;
+		if (m_written && s == m_last) return true;
+
+		m_last = s;
+		m_written = true;
+		return OutputSinkNDJSON::write(vg, frame);
+	}
+
+private:
+	GamepadState m_last = {};
+	bool m_written = false;
+};
+
+// GamepadRecord per new frame, flushed every frame.
+class OutputSinkBinary : public OutputSinkFile
+{
+public:
+	OutputSinkBinary() { m_name = "binary"; }
+
+	bool write(const VirtualGamepad &vg, const Frame &frame) override
+	{
+		if (frame.ts_recv == 0 || (m_written && frame.seq == m_seq)) return true;
+		m_seq = frame.seq;
+		m_written = true;
+
+		GamepadRecord r = {};
+		r.type = GamepadRecord::TYPE_FRAME;
+		r.seq = m_seq;
+		r.ts = now();
+		r.frame.ts_send = frame.ts_send;
+		r.frame.ts_recv = frame.ts_recv;
+		r.frame.state = vg.get_state();
+		return put(&r, sizeof r);
+	}
+
+private:
+	uint32_t m_seq = 0;
+	bool m_written = false;
+};
+
+class OutputSinkNone : public OutputSink
+{
+public:
+	OutputSinkNone() { m_name = "none"; }
+
+	bool write(const VirtualGamepad &, const Frame &) override { return true; }
+};
+
+inline std::unique_ptr<OutputSink> OutputSink::Create(const std::string &spec)
+{
+	auto pos = spec.find(':');
+	auto type = spec.substr(0, pos);
+	auto path = (pos == std::string::npos) ? std::string() : spec.substr(pos + 1);
+
+	if (type == "pretty" && path.empty()) {
+		return std::make_unique<OutputSinkPretty>();
+	} else if (type == "none" && path.empty()) {
+		return std::make_unique<OutputSinkNone>();
+	}
+
+	std::unique_ptr<OutputSinkFile> sink;
+	int64_t flush_interval = OutputSinkNDJSON::FLUSH_INTERVAL;
+	if (type == "ndjson") {
+		sink = std::make_unique<OutputSinkNDJSON>();
+	} else if (type == "changes") {
+		sink = std::make_unique<OutputSinkChanges>();
+	} else if (type == "binary") {
+		sink = std::make_unique<OutputSinkBinary>();
+		flush_interval = 0;
+	} else {
+		return nullptr;
+	}
+
+	if (!sink->open(path, flush_interval)) {
+		LogError("ERROR!! open %s: %s\n", path.c_str(), strerror(errno));
+		return nullptr;
+	}
+
+	return sink;
+}
+
+#endif
@@ -0,0 +1,386 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#ifndef __RENDEZVOUS_H__
+#define __RENDEZVOUS_H__
+
+// direct UDP path between sender and receiver behind NAT, by hole punching.
+//
+//   1. both sides send "register" {session, role} to the rendezvous server
+//      (vgmpad_rendezvous), from the socket used for frames.
+//   2. the server sees their public address (after NAT). once both roles of a
+//      session are registered, it sends each side "peer" {addr, port} of the other.
+//   3. both sides send "punch" to each other. an outgoing punch opens the own NAT
+//      for the peer, so the punches get through after a few tries. a punch is
+//      answered with "ack", and the direct path is up on either of them.
+//
+// frames go over the relay (the address given as usual) until the direct path
+// is up, and again if nothing arrives over it for PEER_TIMEOUT. so a failed punch
+// (symmetric NAT, firewall) costs nothing but a retry every RETRY_INTERVAL.
+//
+// all messages are JSON, {"rdv": {"op": ..., "session": ..., ...}}, like the
+// other control packets.
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+#include "json.hpp"
+#include "Logger.h"
+
+namespace rendezvous {
+
+constexpr size_t MAX_PACKET = 1500;
+
+struct Config
+{
+	std::string name;	// rendezvous server.
+	std::string service;
+	std::string session;	// sender and receiver with the same session are paired.
+	int timeout = 5000;	// [msec], for one attempt.
+
+	bool enabled() const { return !service.empty() && !session.empty(); }
+
+	// "host:port".
+	bool set_server(const std::string &str)
+	{
+		auto pos = str.rfind(':');
+		if (pos == std::string::npos) return false;
+		name = str.substr(0, pos);
+		service = str.substr(pos + 1);
+
+		return !service.empty();
+	}
+};
+
+inline nlohmann::json message(const std::string &op, const std::string &session)
+{
+	return { { "rdv", { { "op", op }, { "session", session } } } };
+}
+
+inline bool send_message(int sock, const nlohmann::json &js, const struct sockaddr_storage &addr, socklen_t addrlen)
+{
+	auto str = js.dump();
+	return sendto(sock, str.c_str(), int(str.size() + 1), 0, (const struct sockaddr *)&addr, addrlen) > 0;
+}
+
+// a field of a message. messages come from anyone, a missing field or one of
+// another type is "" / 0, it never throws.
+inline std::string get_string(const nlohmann::json &msg, const char *key)
+{
+	auto itr = msg.find(key);
+	return (itr != msg.end() && itr->is_string()) ? itr->get<std::string>() : std::string();
+}
+
+inline int get_port(const nlohmann::json &msg, const char *key)
+{
+	auto itr = msg.find(key);
+	if (itr == msg.end() || !itr->is_number_integer()) return 0;
+	auto port = itr->get<int64_t>();
+	return (port > 0 && port <= 65535) ? int(port) : 0;
+}
+
+// "rdv" object of a packet. false if it's not a rendezvous message.
+inline bool decode_message(const char *data, size_t size, nlohmann::json &msg)
+{
+	auto parsed = nlohmann::json::parse(std::string(data, strnlen(data, size)), nullptr, false);
+	if (parsed.is_discarded() || !parsed.is_object()) return false;
+	auto itr = parsed.find("rdv");
+	if (itr == parsed.end() || !itr->is_object()) return false;
+	msg = std::move(*itr);
+
+	return true;
+}
+
+// numeric host and port of an address.
+inline std::pair<std::string, int> host_port(const struct sockaddr_storage &addr)
+{
+	char host[INET6_ADDRSTRLEN] = {};
+	if (addr.ss_family == AF_INET) {
+		auto in = (const struct sockaddr_in *)&addr;
+		inet_ntop(AF_INET, &in->sin_addr, host, sizeof host);
+		return { host, ntohs(in->sin_port) };
+	} else if (addr.ss_family == AF_INET6) {
+		auto in6 = (const struct sockaddr_in6 *)&addr;
+		inet_ntop(AF_INET6, &in6->sin6_addr, host, sizeof host);
+		return { host, ntohs(in6->sin6_port) };
+	}
+	return { "", 0 };
+}
+
+inline std::string to_string(const struct sockaddr_storage &addr)
+{
+	auto [ host, port ] = host_port(addr);
+	if (addr.ss_family == AF_INET6) return "[" + host + "]:" + std::to_string(port);
+	return host + ":" + std::to_string(port);
+}
+
+inline bool same_address(const struct sockaddr_storage &a, socklen_t alen, const struct sockaddr_storage &b, socklen_t blen)
+{
+	if (alen == 0 || blen == 0 || a.ss_family != b.ss_family) return false;
+	return host_port(a) == host_port(b);
+}
+
+// same host, any port.
+inline bool same_host(const struct sockaddr_storage &a, socklen_t alen, const struct sockaddr_storage &b, socklen_t blen)
+{
+	if (alen == 0 || blen == 0 || a.ss_family != b.ss_family) return false;
+	return host_port(a).first == host_port(b).first;
+}
+
+// host name (or numeric address) and port -> address of the family.
+inline bool resolve(const std::string &name, const std::string &service, int family, struct sockaddr_storage &addr, socklen_t &addrlen)
+{
+	struct addrinfo hints = {};
+	hints.ai_family = family;
+	hints.ai_socktype = SOCK_DGRAM;
+	struct addrinfo *ai = nullptr;
+	const char *n = name.empty() ? nullptr : name.c_str();
+	if (getaddrinfo(n, service.c_str(), &hints, &ai) != 0 || !ai) return false;
+
+	memcpy(&addr, ai->ai_addr, ai->ai_addrlen);
+	addrlen = ai->ai_addrlen;
+	freeaddrinfo(ai);
+
+	return true;
+}
+
+// one side of a session. not thread safe, driven from the poll loop of the transport.
+class Puncher
+{
+public:
+	enum class em_State : int {
+		OFF,		// not used.
+		REGISTER,	// waiting for the peer address from the server.
+		PUNCH,		// sending punches to the peer.
+		DIRECT,		// direct path is up.
+		RELAY,		// gave up, retry later.
+	};
+
+	static constexpr int64_t REGISTER_INTERVAL = 250'000;	// [usec].
+	static constexpr int64_t PUNCH_INTERVAL = 50'000;	// [usec].
+	static constexpr int64_t RETRY_INTERVAL = 10'000'000;	// [usec].
+	static constexpr int64_t PEER_TIMEOUT = 5'000'000;	// [usec], receiver pings every second.
+
+	// role : "send" or "recv". family : of the socket for frames.
+	bool start(const Config &cfg, const std::string &role, int family, int64_t now)
+	{
+		m_state = em_State::OFF;
+		if (!cfg.enabled()) return false;
+		if (!resolve(cfg.name, cfg.service, family, m_server, m_server_len)) {
+			LogError("ERROR!! rendezvous server %s:%s is not found.\n", cfg.name.c_str(), cfg.service.c_str());
+			return false;
+		}
+
+		m_cfg = cfg;
+		m_role = role;
+		begin(now);
+
+		return true;
+	}
+
+	void stop() { m_state = em_State::OFF; }
+
+	bool IsActive() const { return m_state != em_State::OFF; }
+	bool IsDirect() const { return m_state == em_State::DIRECT; }
+	bool IsFailed() const { return m_state == em_State::RELAY; }
+	em_State GetState() const { return m_state; }
+
+	const struct sockaddr_storage &peer() const { return m_peer; }
+	socklen_t peer_len() const { return m_peer_len; }
+
+	// send register / punch when it's time, give up after timeout. call every poll.
+	void step(int sock, int64_t now)
+	{
+		switch (m_state) {
+		case em_State::REGISTER:
+		case em_State::PUNCH:
+			if (now - m_attempt >= int64_t(m_cfg.timeout) * 1000) {
+				LogInfo("rendezvous: no direct path (%s), use relay.\n", m_state == em_State::PUNCH ? "punch failed" : "no peer");
+				m_state = em_State::RELAY;
+				m_next = now + RETRY_INTERVAL;
+				break;
+			}
+			if (now < m_next) break;
+			if (m_state == em_State::REGISTER) {
+				auto js = message("register", m_cfg.session);
+				js["rdv"]["role"] = m_role;
+				send_message(sock, js, m_server, m_server_len);
+				m_next = now + REGISTER_INTERVAL;
+			} else {
+				send_message(sock, message("punch", m_cfg.session), m_peer, m_peer_len);
+				m_next = now + PUNCH_INTERVAL;
+			}
+			break;
+		case em_State::DIRECT:
+			if (now - m_heard >= PEER_TIMEOUT) {
+				LogInfo("rendezvous: direct path to %s is lost, use relay.\n", to_string(m_peer).c_str());
+				begin(now);
+			}
+			break;
+		case em_State::RELAY:
+			if (now >= m_next) begin(now);
+			break;
+		default:
+			break;
+		}
+	}
+
+	// a rendezvous message from the server or the peer.
+	void on_message(int sock, const nlohmann::json &msg, const struct sockaddr_storage &from, socklen_t fromlen, int64_t now)
+	{
+		if (m_state == em_State::OFF) return;
+		if (get_string(msg, "session") != m_cfg.session) return;
+
+		auto op = get_string(msg, "op");
+		if (op == "peer") {
+			if (m_state == em_State::DIRECT) return;
+			if (!same_address(from, fromlen, m_server, m_server_len)) return;
+
+			struct sockaddr_storage peer;
+			socklen_t peer_len;
+			auto addr = get_string(msg, "addr");
+			auto port = get_port(msg, "port");
+			if (addr.empty() || port == 0) return;
+			if (!resolve(addr, std::to_string(port), m_server.ss_family, peer, peer_len)) return;
+			if (m_state != em_State::PUNCH || !same_address(peer, peer_len, m_peer, m_peer_len)) {
+				LogVerbose("rendezvous: punch to %s, this side is seen as %s.\n", to_string(peer).c_str(), get_string(msg, "you").c_str());
+			}
+			if (m_state == em_State::RELAY) m_attempt = now;	// notified of a new peer.
+			memcpy(&m_told, &peer, peer_len);
+			m_told_len = peer_len;
+			memcpy(&m_peer, &peer, peer_len);
+			m_peer_len = peer_len;
+			m_state = em_State::PUNCH;
+			m_next = now;
+
+		} else if (op == "punch" || op == "ack") {
+			// only from the current peer, or the peer the server told. it may be seen
+			// at another port than told (NAT), but not at another host. the direct
+			// path isn't moved to another port.
+			const bool current = same_address(from, fromlen, m_peer, m_peer_len);
+			if (!current && !same_address(from, fromlen, m_told, m_told_len)
+				&& (m_state == em_State::DIRECT || !same_host(from, fromlen, m_told, m_told_len))) return;
+
+			if (op == "punch") send_message(sock, message("ack", m_cfg.session), from, fromlen);
+			m_heard = now;
+			if (m_state == em_State::DIRECT && current) return;
+
+			memcpy(&m_peer, &from, fromlen);
+			m_peer_len = fromlen;
+			direct();
+		}
+	}
+
+	// a frame or a control packet arrived. keeps the direct path, or is the
+	// first sign of it if the ack was lost.
+	void on_packet(const struct sockaddr_storage &from, socklen_t fromlen, int64_t now)
+	{
+		if (m_state != em_State::DIRECT && m_state != em_State::PUNCH) return;
+		if (!same_address(from, fromlen, m_peer, m_peer_len)) return;
+
+		m_heard = now;
+		if (m_state == em_State::PUNCH) direct();
+	}
+
+	// blocking, until the direct path is up or the attempt fails.
+	// for the transports which can't switch the path later (SRT).
+	bool run(int sock)
+	{
+		auto now_us = []() -> int64_t {
+			auto now = std::chrono::system_clock::now().time_since_epoch();
+			return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+		};
+
+		std::vector<char> pkt(MAX_PACKET);
+		while (m_state == em_State::REGISTER || m_state == em_State::PUNCH) {
+			step(sock, now_us());
+
+#if defined(_WIN32)
+			WSAPOLLFD pfd = { SOCKET(sock), POLLIN, 0 };
+			if (WSAPoll(&pfd, 1, 10) <= 0) continue;
+#else
+			struct pollfd pfd = { sock, POLLIN, 0 };
+			if (::poll(&pfd, 1, 10) <= 0) continue;
+#endif
+
+			struct sockaddr_storage from;
+			socklen_t fromlen = sizeof from;
+			const int stat = recvfrom(sock, pkt.data(), int(pkt.size()), 0, (struct sockaddr *)&from, &fromlen);
+			if (stat <= 0) continue;
+
+			nlohmann::json msg;
+			if (decode_message(pkt.data(), stat, msg)) on_message(sock, msg, from, fromlen, now_us());
+		}
+
+		return IsDirect();
+	}
+
+private:
+	void begin(int64_t now)
+	{
+		m_state = em_State::REGISTER;
+		m_attempt = now;
+		m_next = now;
+	}
+
+	void direct()
+	{
+		m_state = em_State::DIRECT;
+		LogInfo("rendezvous: direct path to %s.\n", to_string(m_peer).c_str());
+	}
+
+	Config m_cfg;
+	std::string m_role;
+	em_State m_state = em_State::OFF;
+
+	struct sockaddr_storage m_server = {};
+	socklen_t m_server_len = 0;
+	struct sockaddr_storage m_peer = {};
+	socklen_t m_peer_len = 0;
+	struct sockaddr_storage m_told = {};	// peer address by the server.
+	socklen_t m_told_len = 0;
+
+	int64_t m_attempt = 0;	// start of this attempt [usec].
+	int64_t m_next = 0;	// next register / punch [usec].
+	int64_t m_heard = 0;	// last packet from the peer [usec].
+};
+
+}	// namespace rendezvous
+
+#endif
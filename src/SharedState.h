@@ -0,0 +1,368 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#ifndef __SHARED_STATE_H__
+#define __SHARED_STATE_H__
+
+// publish received gamepad state to local processes over POSIX shared memory.
+//
+//   one writer (vgmpad_recv --shm NAME), any number of readers.
+//   latest : the latest frame, guarded by a seqlock.
+//   ring   : the last RING_SIZE frames that carry an input event (axis motion,
+//            button down / up), so a polling reader doesn't miss a button press.
+//
+// seqlock: the writer makes the sequence odd, writes, then makes it even.
+// a reader copies the data between two loads of the sequence and retries if
+// they differ or are odd. nobody blocks, and reading is a few loads, no syscall.
+// data is copied as relaxed atomic 64-bit words, so there is no data race.
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <atomic>
+#include <chrono>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "GamepadState.h"
+
+// one frame.
+struct SharedGamepadFrame
+{
+	uint32_t seq;		// frame sequence number.
+	uint32_t reserved;
+	int64_t ts_send;	// sender time stamp [usec], in local time if clock offset is known.
+	int64_t ts_recv;	// received [usec].
+	int64_t ts_publish;	// written to shared memory [usec].
+	GamepadState state;
+};
+static_assert(sizeof(SharedGamepadFrame) % 8 == 0, "SharedGamepadFrame must be a multiple of 8 bytes");
+
+namespace shared_state {
+
+constexpr size_t FRAME_WORDS = sizeof(SharedGamepadFrame) / 8;
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "needs lock free 64-bit atomics across processes");
+
+// a frame behind a seqlock.
+struct alignas(64) Slot
+{
+	std::atomic<uint64_t> seq;	// 2n + 1 while writing n-th data, 2n + 2 after. 0: empty.
+	std::atomic<uint64_t> words[FRAME_WORDS];
+
+	void store(uint64_t n, const SharedGamepadFrame &f)
+	{
+		uint64_t w[FRAME_WORDS];
+		memcpy(w, &f, sizeof w);
+
+		seq.store(n * 2 + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i = 0; i < FRAME_WORDS; i++) words[i].store(w[i], std::memory_order_relaxed);
+		seq.store(n * 2 + 2, std::memory_order_release);
+	}
+
+	// false if it's being written, or was changed while reading.
+	bool load(uint64_t &s, SharedGamepadFrame &f) const
+	{
+		uint64_t w[FRAME_WORDS];
+
+		s = seq.load(std::memory_order_acquire);
+		if (s & 1) return false;
+		for (size_t i = 0; i < FRAME_WORDS; i++) w[i] = words[i].load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (seq.load(std::memory_order_relaxed) != s) return false;
+
+		memcpy(&f, w, sizeof f);
+		return true;
+	}
+};
+
+}	// namespace shared_state
+
+struct SharedGamepadSegment
+{
+	static constexpr char MAGIC[8] = { 'V', 'G', 'M', 'P', 'S', 'H', 'M', '1' };
+	static constexpr uint32_t VERSION = 1;
+	static constexpr uint32_t RING_SIZE = 256;	// power of 2.
+
+	char magic[8];
+	uint32_t version;
+	uint32_t size;			// sizeof(SharedGamepadSegment).
+	uint32_t ring_size;
+	uint32_t pid;			// writer.
+	char source[32];		// host:port/protocol.
+
+	shared_state::Slot latest;
+
+	alignas(64) std::atomic<uint64_t> ring_head;	// number of events written.
+	shared_state::Slot ring[RING_SIZE];		// event n is in ring[n % RING_SIZE].
+};
+
+// create and write the segment. (vgmpad_recv)
+class SharedStateWriter
+{
+public:
+	SharedStateWriter() {}
+	virtual ~SharedStateWriter() { close(); }
+
+	// false with errno EBUSY if another writer is alive on the segment (see GetOwner()),
+	// EEXIST if the name is taken by something that is not a segment.
+	// a segment left by a writer that died is taken over.
+	bool open(const std::string &name, const std::string &source)
+	{
+		close();
+
+		m_owner = 0;
+		int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+		if (fd < 0 && errno == EEXIST) {
+			if (!stale(name)) return false;
+			shm_unlink(name.c_str());
+			fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+		}
+		if (fd < 0) return false;
+		if (ftruncate(fd, sizeof(SharedGamepadSegment)) != 0) {
+			::close(fd);
+			shm_unlink(name.c_str());
+			return false;
+		}
+		auto addr = mmap(nullptr, sizeof(SharedGamepadSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (addr == MAP_FAILED) {
+			shm_unlink(name.c_str());
+			return false;
+		}
+		m_seg = (SharedGamepadSegment *)addr;
+		m_name = name;
+
+		// readers check magic last.
+		memset(m_seg->magic, 0, sizeof m_seg->magic);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		m_seg->version = SharedGamepadSegment::VERSION;
+		m_seg->size = sizeof(SharedGamepadSegment);
+		m_seg->ring_size = SharedGamepadSegment::RING_SIZE;
+		m_seg->pid = getpid();
+		memset(m_seg->source, 0, sizeof m_seg->source);
+		strncpy(m_seg->source, source.c_str(), sizeof m_seg->source - 1);
+		m_seg->latest.seq.store(0, std::memory_order_relaxed);
+		m_seg->ring_head.store(0, std::memory_order_relaxed);
+		for (auto &slot : m_seg->ring) slot.seq.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		memcpy(m_seg->magic, SharedGamepadSegment::MAGIC, sizeof m_seg->magic);
+
+		m_frames = 0;
+
+		return true;
+	}
+
+	// the segment is removed, readers which have it mapped keep the last state.
+	void close()
+	{
+		if (!m_seg) return;
+
+		munmap(m_seg, sizeof(SharedGamepadSegment));
+		shm_unlink(m_name.c_str());
+		m_seg = nullptr;
+	}
+
+	bool IsOpen() const { return m_seg != nullptr; }
+
+	// pid of the live writer, after open() failed with EBUSY.
+	pid_t GetOwner() const { return m_owner; }
+
+	// latest only moves forward. a frame older than it (rebuilt after newer ones
+	// arrived, FEC) goes to the ring only. a restarted sender counts seq from 1
+	// again, its frames are newer by ts_send.
+	void publish(uint32_t seq, int64_t ts_send, int64_t ts_recv, const GamepadState &state)
+	{
+		if (!m_seg) return;
+
+		SharedGamepadFrame f = {};
+		f.seq = seq;
+		f.ts_send = ts_send;
+		f.ts_recv = ts_recv;
+		f.ts_publish = now();
+		f.state = state;
+
+		const bool older = (m_frames > 0 && int32_t(seq - m_seq) < 0 && ts_send <= m_ts_send);
+		if (!older) {
+			m_seg->latest.store(m_frames, f);
+			m_frames++;
+			m_seq = seq;
+			m_ts_send = ts_send;
+		}
+
+		if (state.flags) {
+			auto n = m_seg->ring_head.load(std::memory_order_relaxed);
+			m_seg->ring[n % SharedGamepadSegment::RING_SIZE].store(n, f);
+			m_seg->ring_head.store(n + 1, std::memory_order_release);
+		}
+	}
+
+private:
+	static int64_t now()
+	{
+		auto t = std::chrono::system_clock::now().time_since_epoch();
+		return std::chrono::duration_cast<std::chrono::microseconds>(t).count();
+	}
+
+	// true if the existing segment was left by a writer that is gone.
+	bool stale(const std::string &name)
+	{
+		int fd = shm_open(name.c_str(), O_RDONLY, 0);
+		if (fd < 0) return errno == ENOENT;	// removed meanwhile.
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(SharedGamepadSegment)) {
+			::close(fd);
+			errno = EEXIST;
+			return false;
+		}
+		auto addr = mmap(nullptr, sizeof(SharedGamepadSegment), PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (addr == MAP_FAILED) return false;
+		auto seg = (const SharedGamepadSegment *)addr;
+
+		bool ours = (memcmp(seg->magic, SharedGamepadSegment::MAGIC, sizeof seg->magic) == 0);
+		pid_t pid = seg->pid;
+		munmap(addr, sizeof(SharedGamepadSegment));
+		if (!ours) {
+			errno = EEXIST;
+			return false;
+		}
+		// EPERM: alive, owned by another user.
+		if (pid > 0 && (kill(pid, 0) == 0 || errno == EPERM)) {
+			m_owner = pid;
+			errno = EBUSY;
+			return false;
+		}
+
+		return true;
+	}
+
+	SharedGamepadSegment *m_seg = nullptr;
+	std::string m_name;
+	uint64_t m_frames = 0;
+	uint32_t m_seq = 0;	// of latest.
+	int64_t m_ts_send = 0;
+	pid_t m_owner = 0;
+};
+
+// map the segment read only. (consumers)
+class SharedStateReader
+{
+public:
+	SharedStateReader() {}
+	virtual ~SharedStateReader() { close(); }
+
+	bool open(const std::string &name)
+	{
+		close();
+
+		int fd = shm_open(name.c_str(), O_RDONLY, 0);
+		if (fd < 0) return false;
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(SharedGamepadSegment)) {
+			::close(fd);
+			return false;
+		}
+		auto addr = mmap(nullptr, sizeof(SharedGamepadSegment), PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (addr == MAP_FAILED) return false;
+		m_seg = (const SharedGamepadSegment *)addr;
+
+		if (memcmp(m_seg->magic, SharedGamepadSegment::MAGIC, sizeof m_seg->magic) != 0
+			|| m_seg->version != SharedGamepadSegment::VERSION || m_seg->size != sizeof(SharedGamepadSegment)) {
+			close();
+			return false;
+		}
+		m_cursor = m_seg->ring_head.load(std::memory_order_acquire);
+
+		return true;
+	}
+
+	void close()
+	{
+		if (m_seg) munmap((void *)m_seg, sizeof(SharedGamepadSegment));
+		m_seg = nullptr;
+	}
+
+	bool IsOpen() const { return m_seg != nullptr; }
+	const SharedGamepadSegment *segment() const { return m_seg; }
+
+	// a write is a few stores, a reader retries a bounded number of times,
+	// so a writer that died in the middle doesn't hang it.
+	static constexpr int READ_RETRIES = 10'000;
+
+	// the latest frame. false if nothing is published yet, or it's kept odd.
+	bool read(SharedGamepadFrame &f) const
+	{
+		if (!m_seg) return false;
+
+		uint64_t s;
+		for (int i = 0; i < READ_RETRIES; i++) {
+			if (m_seg->latest.load(s, f)) return s != 0;
+		}
+		return false;
+	}
+
+	// number of frames published.
+	uint64_t frames() const { return m_seg ? m_seg->latest.seq.load(std::memory_order_acquire) / 2 : 0; }
+
+	// events since the last call, up to max. lost is incremented by events
+	// overwritten before they were read.
+	size_t read_events(SharedGamepadFrame *events, size_t max, uint64_t *lost = nullptr)
+	{
+		if (!m_seg) return 0;
+
+		auto head = m_seg->ring_head.load(std::memory_order_acquire);
+		if (head - m_cursor > SharedGamepadSegment::RING_SIZE) {
+			if (lost) *lost += head - m_cursor - SharedGamepadSegment::RING_SIZE;
+			m_cursor = head - SharedGamepadSegment::RING_SIZE;
+		}
+
+		size_t num = 0;
+		while (m_cursor < head && num < max) {
+			auto &slot = m_seg->ring[m_cursor % SharedGamepadSegment::RING_SIZE];
+			uint64_t s;
+			// the slot is complete before ring_head is updated, so it's
+			// either the event, or overwritten by a newer one.
+			if (slot.load(s, events[num]) && s == m_cursor * 2 + 2) num++;
+			else if (lost) (*lost)++;
+			m_cursor++;
+		}
+
+		return num;
+	}
+
+private:
+	const SharedGamepadSegment *m_seg = nullptr;
+	uint64_t m_cursor = 0;	// next event to read.
+};
+
+#endif
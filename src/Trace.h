@@ -0,0 +1,214 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#ifndef __VGMPAD_TRACE_H__
+#define __VGMPAD_TRACE_H__
+
+// scoped spans of send/receive loops, dumped in Chrome trace format
+// (chrome://tracing, https://ui.perfetto.dev).
+//
+//   TRACE_SCOPE("encode");		// span until end of scope. name must be a string literal.
+//   TRACE_INSTANT("reconnect");	// point event.
+//
+// build with -DVGMPAD_TRACE=YES (cmake) to enable. otherwise the macros are empty
+// and Trace::start() etc. do nothing, no cost in the hot path.
+// each thread writes its own ring buffer, no lock and no allocation per span.
+
+#include <cstdint>
+#include <string>
+
+#if defined(VGMPAD_TRACE)
+
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+class Trace
+{
+public:
+	static constexpr size_t RING_SIZE = 1 << 16;	// events per thread, oldest are overwritten.
+
+	struct Event {
+		const char *name;
+		int64_t ts;		// [nsec], steady clock.
+		int64_t dur;	// [nsec], < 0 : instant.
+	};
+
+	struct Ring {
+		int tid = 0;
+		std::string thread_name;
+		std::atomic<uint64_t> head{0};	// written by owner thread only.
+		Event events[RING_SIZE];
+	};
+
+	class Scope
+	{
+	public:
+		explicit Scope(const char *name) : m_name(name), m_ts(Trace::enabled() ? now() : 0) {}
+		~Scope() { if (m_ts) Trace::record(m_name, m_ts, now() - m_ts); }
+
+	private:
+		const char *m_name;
+		int64_t m_ts;
+	};
+
+	// start recording. path is written by dump().
+	static void start(const std::string &path)
+	{
+		std::lock_guard<std::mutex> lk(mutex());
+		output_path() = path;
+		flag().store(true, std::memory_order_relaxed);
+	}
+
+	static bool enabled() { return flag().load(std::memory_order_relaxed); }
+
+	// call after start().
+	static void set_thread_name(const std::string &name)
+	{
+		if (!enabled()) return;
+
+		auto &r = ring();
+		std::lock_guard<std::mutex> lk(mutex());
+		r.thread_name = name;
+	}
+
+	static int64_t now()
+	{
+		auto t = std::chrono::steady_clock::now().time_since_epoch();
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(t).count();
+	}
+
+	static void record(const char *name, int64_t ts, int64_t dur)
+	{
+		auto &r = ring();
+		auto h = r.head.load(std::memory_order_relaxed);
+		r.events[h % RING_SIZE] = { name, ts, dur };
+		r.head.store(h + 1, std::memory_order_release);
+	}
+
+	static void instant(const char *name)
+	{
+		if (enabled()) record(name, now(), -1);
+	}
+
+	// write all rings to the path given to start(). may be called while threads are recording.
+	static bool dump()
+	{
+		std::lock_guard<std::mutex> lk(mutex());
+		if (output_path().empty()) return false;
+
+		auto fp = fopen(output_path().c_str(), "w");
+		if (!fp) return false;
+
+		auto pid = int(getpid());
+		fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		bool first = true;
+		auto sep = [&]() { fprintf(fp, first ? " " : ",\n "); first = false; };
+
+		std::vector<Event> buf;
+		for (auto &r : rings()) {
+			if (!r->thread_name.empty()) {
+				sep();
+				fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+					pid, r->tid, r->thread_name.c_str());
+			}
+
+			// copy, then drop events overwritten while copying.
+			auto h0 = r->head.load(std::memory_order_acquire);
+			auto begin = (h0 > RING_SIZE) ? h0 - RING_SIZE : 0;
+			buf.clear();
+			for (auto i = begin; i < h0; i++) buf.push_back(r->events[i % RING_SIZE]);
+			auto h1 = r->head.load(std::memory_order_acquire);
+			auto valid_from = (h1 > RING_SIZE) ? h1 - RING_SIZE : 0;
+
+			for (auto i = begin; i < h0; i++) {
+				if (i < valid_from) continue;
+				auto &e = buf[i - begin];
+				sep();
+				if (e.dur < 0) {
+					fprintf(fp, "{\"name\":\"%s\",\"cat\":\"vgmpad\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d}",
+						e.name, e.ts / 1000.0, pid, r->tid);
+				} else {
+					fprintf(fp, "{\"name\":\"%s\",\"cat\":\"vgmpad\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+						e.name, e.ts / 1000.0, e.dur / 1000.0, pid, r->tid);
+				}
+			}
+		}
+		fprintf(fp, "\n]}\n");
+		fclose(fp);
+
+		return true;
+	}
+
+private:
+	static std::atomic<bool> &flag() { static std::atomic<bool> f{false}; return f; }
+	static std::mutex &mutex() { static std::mutex m; return m; }
+	static std::string &output_path() { static std::string p; return p; }
+
+	// rings live until exit, dump() may run after a thread ended.
+	static std::vector<std::unique_ptr<Ring>> &rings() { static std::vector<std::unique_ptr<Ring>> v; return v; }
+
+	static Ring &ring()
+	{
+		thread_local Ring *r = nullptr;
+		if (!r) {
+			auto p = std::make_unique<Ring>();
+			p->tid = int(syscall(SYS_gettid));
+			r = p.get();
+			std::lock_guard<std::mutex> lk(mutex());
+			rings().push_back(std::move(p));
+		}
+		return *r;
+	}
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_INSTANT(name) Trace::instant(name)
+
+#else
+
+// tracing compiled out.
+class Trace
+{
+public:
+	static void start(const std::string &) {}
+	static bool enabled() { return false; }
+	static void set_thread_name(const std::string &) {}
+	static bool dump() { return false; }
+};
+
+#define TRACE_SCOPE(name) do {} while (0)
+#define TRACE_INSTANT(name) do {} while (0)
+
+#endif
+
+#endif
@@ -21,12 +21,17 @@
  *  SOFTWARE.
  */
 
+#ifndef __VIRTUAL_GAMEPAD_H__
+#define __VIRTUAL_GAMEPAD_H__
+
 #include <iostream>
 #include <sstream>
+#include <cstring>
 #include <algorithm>
 #include <string>
 #include <vector>
 #include <list>
+#include <map>
 #include <deque>
 #include <tuple>
 
@@ -49,8 +54,25 @@
 #include <unistd.h>
 #include <fcntl.h>
 #endif
+#if !defined(_WIN32)
+#include <sys/un.h>
+#include <poll.h>
+#include <netinet/tcp.h>
+#endif
+#if defined(__linux__)
+#include <linux/net_tstamp.h>
+#endif
 
 #include "devGamepad.h"
+#include "VirtualGamepadMetrics.h"
+#include "ClockSync.h"
+#include "Trace.h"
+#include "GamepadState.h"
+#include "Rendezvous.h"
+#include "FrameDedup.h"
+#include "Fec.h"
+#include "ButtonEvents.h"
+#include "JsonFrames.h"
 
 #include "json.hpp"
 using njson = nlohmann::json;
@@ -61,6 +83,25 @@ using njson = nlohmann::json;
 class VirtualGamepad
 {
 public:
+	// time stamp of each stage of a frame, wall clock [usec]. 0 if not stamped.
+	struct FrameStages {
+		int64_t event = 0;	// input event (SDL event time).
+		int64_t update = 0;	// update() from gamepad.
+		int64_t encode = 0;	// send(), encode start.
+		int64_t send = 0;	// send(), encoded.
+		int64_t arrive = 0;	// arrived at host (kernel time stamp, UDP only).
+		int64_t recv = 0;	// read from socket.
+		int64_t decode = 0;	// decoded.
+		int64_t output = 0;	// output by application, MarkOutput().
+	};
+
+	// state of a lost frame, carried in "hist" of a later frame.
+	struct RecoveredFrame {
+		uint32_t seq;
+		int64_t ts_send;	// in local time if clock offset is known.
+		GamepadState state;
+	};
+
 	enum class em_Mode : int {
 		SEND,
 		RECEIVE,
@@ -75,10 +116,43 @@ protected:
 	std::string m_service;
 	addrinfo *m_ai = nullptr;
 	bool m_connected = false;
+	bool m_reconnect_wait = true;	// sleep after a failed send / reconnect.
 
 	njson m_js;
 	// std::mutex m_mtx;
 
+	// frame info. carried in "frame" of packet.
+	uint32_t m_seq = 0;
+	FrameStages m_stages;
+	int64_t m_ts_event_sent = 0;	// last input event carried in a frame [usec].
+	std::vector<RecoveredFrame> m_recovered;
+	// receiver, seqs counted as drops, the last LOST_WINDOW. taken off if rebuilt later (FEC).
+	static constexpr size_t LOST_WINDOW = 64;
+	std::deque<uint32_t> m_lost;
+	std::vector<ButtonEvent> m_events;	// receiver, by the event channel in this poll.
+	bool m_event_buttons_valid = false;	// receiver, buttons by the event channel, not by frames.
+	uint16_t m_event_buttons = 0;
+	int64_t m_ts_arrive = 0;	// last packet arrived at host, kernel time stamp [usec]. 0 if not supported.
+	int64_t m_ts_sock = 0;	// last packet read from socket [usec].
+	uint32_t m_coalesced = 0;	// receiver, frames just before this one replaced by it on purpose (TCP), not lost.
+
+	// clock offset estimation. receiver sends ping, sender answers in next frame.
+	ClockSync m_clock;
+	int64_t m_ping_t1 = 0;	// receiver time of ping [usec].
+	int64_t m_ping_t2 = 0;	// sender time, ping arrived [usec].
+
+	// loss rate, measured by the receiver between pings and carried in the ping.
+	uint32_t m_loss_seq = 0;	// receiver, seq at last ping.
+	uint64_t m_loss_drops = 0;	// receiver, drops - drops_rebuilt at last ping.
+	double m_peer_loss = -1.0;	// sender, reported loss [0, 1]. < 0: unknown.
+
+	// previous states carried in "hist" of each frame, so a lost frame is covered
+	// by the next one. [dts, axis x 6, buttons, flags] each, newest first.
+	int m_history_size = 0;
+	std::deque<std::pair<int64_t, GamepadState>> m_history;	// sender, sent frames, newest first.
+
+	VirtualGamepadMetrics m_metrics;
+
 	// axis, button status.
 	bool axis_motion = false;
 	bool button_down = false;
@@ -118,6 +192,15 @@ protected:
 		}
 	}
 
+	// input events (axis motion, button down / up) of a frame replaced by a newer one,
+	// kept in the newer one.
+	static void carry_flags(const njson &from, njson &to)
+	{
+		for (auto key : { "axis_motion", "button_down", "button_up" }) {
+			if (from.value(key, false)) to[key] = true;
+		}
+	}
+
 public:
 	NLOHMANN_DEFINE_TYPE_INTRUSIVE(
 		VirtualGamepad,
@@ -180,13 +263,24 @@ public:
 
 		std::transform(protocol.cbegin(), protocol.cend(), protocol.begin(), ::tolower);
 		if (protocol == "") protocol = "srt";
-		if (protocol != "udp" && protocol != "srt") {
+		if (protocol != "udp" && protocol != "srt" && protocol != "unix" && protocol != "tcp") {
 			return { std::string{""}, std::string{""}, std::string{""} };
 		}
+#if defined(_WIN32)
+		// no unix domain socket nor TCP transport.
+		if (protocol == "unix" || protocol == "tcp") return { std::string{""}, std::string{""}, std::string{""} };
+#endif
 
 		return { name, service, protocol };
 	}
 
+	// time stamp [usec].
+	static int64_t get_time_us()
+	{
+		auto now = std::chrono::system_clock::now().time_since_epoch();
+		return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+	}
+
 	// Is Gamepad Attached.
 	virtual bool IsAttached() const = 0;
 
@@ -219,6 +313,69 @@ public:
 	uint8_t GetButton_Dpad_L() const { return button_Dpad_L; }
 	uint8_t GetButton_Dpad_R() const { return button_Dpad_R; }
 
+	uint32_t GetSeq() const { return m_seq; }
+
+	// receiver side, lost frames rebuilt from "hist" of the latest frame, oldest first.
+	const std::vector<RecoveredFrame> &GetRecovered() const { return m_recovered; }
+
+	// receiver side, button events arrived in this poll, in order. see ButtonEvents.h.
+	const std::vector<ButtonEvent> &GetEvents() const { return m_events; }
+
+	// sender side, send new button events now, without a frame. false if the
+	// transport has no event channel.
+	virtual bool send_events() { return false; }
+
+	// sender side, between frames. wait time_out [usec], reading control packets
+	// (ping) as they arrive, for the transports which have no arrival time stamp.
+	virtual void wait_control(int64_t time_out)
+	{
+		if (time_out > 0) std::this_thread::sleep_for(std::chrono::microseconds(time_out));
+	}
+
+	// sender side, sleep WAIT_FOR_RECONNECT after a failed send / reconnect, so a
+	// lost receiver is not hammered. off for many pads on one thread (vgmpad_loadgen),
+	// the caller paces the retries and the other pads must not wait.
+	void SetReconnectWait(bool wait) { m_reconnect_wait = wait; }
+
+	// sender side, carry the previous n states in each frame.
+	static constexpr int MAX_HISTORY = 12;	// worst case frame fits in 1500 bytes.
+	bool SetHistory(int n)
+	{
+		if (n < 0 || n > MAX_HISTORY) return false;
+		m_history_size = n;
+		m_history.clear();
+		return true;
+	}
+	int64_t GetSendTime() const { return m_stages.send; }
+	int64_t GetRecvTime() const { return m_stages.recv; }
+	const FrameStages &GetStages() const { return m_stages; }
+
+	// receiver side, the frame is output (rendered, injected, printed, ...).
+	void MarkOutput()
+	{
+		if (m_stages.decode == 0 || m_stages.output != 0) return;
+
+		m_stages.output = get_time_us();
+		auto &h = m_metrics.stages();
+		h.output.record(m_stages.output - m_stages.decode);
+		auto first = m_stages.event ? m_stages.event : (m_stages.update ? m_stages.update : m_stages.send);
+		if (first) h.total.record(m_stages.output - first);
+	}
+
+	const VirtualGamepadMetrics &GetMetrics() const { return m_metrics; }
+	virtual VirtualGamepadMetrics::Snapshot GetMetricsSnapshot() const
+	{
+		auto s = m_metrics.snapshot();
+		if (m_clock.IsValid()) {
+			s.gauges["clock_offset_us"] = m_clock.GetOffset();
+			s.gauges["clock_rtt_us"] = m_clock.GetRtt();
+		}
+		return s;
+	}
+
+	// sender clock - receiver clock. valid on receiver, after the first ping/pong.
+	const ClockSync &GetClock() const { return m_clock; }
+
 	VirtualGamepad() { clear_stat(); }
 
 	virtual ~VirtualGamepad() {}
@@ -255,39 +412,100 @@ public:
 		uint8_t button_Dpad_R = 0;
 	}
 
-	bool update(std::unique_ptr<GamepadDevice> &gamepad)
+	// binary state.
+	GamepadState get_state() const
+	{
+		GamepadState s = {};
+		s.axis[GamepadState::AXIS_LEFT_X] = axis_Left_X;
+		s.axis[GamepadState::AXIS_LEFT_Y] = axis_Left_Y;
+		s.axis[GamepadState::AXIS_RIGHT_X] = axis_Right_X;
+		s.axis[GamepadState::AXIS_RIGHT_Y] = axis_Right_Y;
+		s.axis[GamepadState::AXIS_TRIGGER_L] = axis_Trigger_L;
+		s.axis[GamepadState::AXIS_TRIGGER_R] = axis_Trigger_R;
+
+		const uint8_t buttons[] = {
+			button_A, button_B, button_X, button_Y,
+			button_Back, button_Guide, button_Start,
+			button_Stick_L, button_Stick_R, button_Shoulder_L, button_Shoulder_R,
+			button_Dpad_U, button_Dpad_D, button_Dpad_L, button_Dpad_R,
+		};
+		for (int i = 0; i < GamepadState::NUM_BUTTON; i++) {
+			if (buttons[i]) s.buttons |= (1 << i);
+		}
+
+		if (axis_motion) s.flags |= GamepadState::FLAG_AXIS_MOTION;
+		if (button_down) s.flags |= GamepadState::FLAG_BUTTON_DOWN;
+		if (button_up) s.flags |= GamepadState::FLAG_BUTTON_UP;
+
+		return s;
+	}
+
+	void set_state(const GamepadState &s)
+	{
+		axis_Left_X = s.axis[GamepadState::AXIS_LEFT_X];
+		axis_Left_Y = s.axis[GamepadState::AXIS_LEFT_Y];
+		axis_Right_X = s.axis[GamepadState::AXIS_RIGHT_X];
+		axis_Right_Y = s.axis[GamepadState::AXIS_RIGHT_Y];
+		axis_Trigger_L = s.axis[GamepadState::AXIS_TRIGGER_L];
+		axis_Trigger_R = s.axis[GamepadState::AXIS_TRIGGER_R];
+
+		uint8_t *buttons[] = {
+			&button_A, &button_B, &button_X, &button_Y,
+			&button_Back, &button_Guide, &button_Start,
+			&button_Stick_L, &button_Stick_R, &button_Shoulder_L, &button_Shoulder_R,
+			&button_Dpad_U, &button_Dpad_D, &button_Dpad_L, &button_Dpad_R,
+		};
+		for (int i = 0; i < GamepadState::NUM_BUTTON; i++) {
+			*buttons[i] = (s.buttons >> i) & 1;
+		}
+
+		axis_motion = (s.flags & GamepadState::FLAG_AXIS_MOTION) != 0;
+		button_down = (s.flags & GamepadState::FLAG_BUTTON_DOWN) != 0;
+		button_up = (s.flags & GamepadState::FLAG_BUTTON_UP) != 0;
+	}
+
+	template<typename T>
+	bool update(std::unique_ptr<T> &gamepad)
+	{
+		return update(*gamepad);
+	}
+
+	bool update(GamepadSource &gamepad)
 	{
-		if (!gamepad->IsAttached()) {
+		if (!gamepad.IsAttached()) {
 			// LogInfo("Gamepad is not enable.\n");
 			return false;
 		}
 
-		axis_motion = gamepad->IsAxisMotion();
-		button_down = gamepad->IsButtonDown();
-		button_up = gamepad->IsButtonUp();
-
-		axis_Left_X = gamepad->GetAxis_Left_X();
-		axis_Left_Y = gamepad->GetAxis_Left_Y();
-		axis_Right_X = gamepad->GetAxis_Right_X();
-		axis_Right_Y = gamepad->GetAxis_Right_Y();
-		axis_Trigger_L = gamepad->GetAxis_Trigger_L();
-		axis_Trigger_R = gamepad->GetAxis_Trigger_R();
-
-		button_A = gamepad->GetButton_A();
-		button_B = gamepad->GetButton_B();
-		button_X = gamepad->GetButton_X();
-		button_Y = gamepad->GetButton_Y();
-		button_Back = gamepad->GetButton_Back();
-		button_Guide = gamepad->GetButton_Guide();
-		button_Start = gamepad->GetButton_Start();
-		button_Stick_L = gamepad->GetButton_Stick_L();
-		button_Stick_R = gamepad->GetButton_Stick_R();
-		button_Shoulder_L = gamepad->GetButton_Shoulder_L();
-		button_Shoulder_R = gamepad->GetButton_Shoulder_R();
-		button_Dpad_U = gamepad->GetButton_Dpad_U();
-		button_Dpad_D = gamepad->GetButton_Dpad_D();
-		button_Dpad_L = gamepad->GetButton_Dpad_L();
-		button_Dpad_R = gamepad->GetButton_Dpad_R();
+		m_stages.event = gamepad.GetEventTime();
+		m_stages.update = get_time_us();
+
+		axis_motion = gamepad.IsAxisMotion();
+		button_down = gamepad.IsButtonDown();
+		button_up = gamepad.IsButtonUp();
+
+		axis_Left_X = gamepad.GetAxis_Left_X();
+		axis_Left_Y = gamepad.GetAxis_Left_Y();
+		axis_Right_X = gamepad.GetAxis_Right_X();
+		axis_Right_Y = gamepad.GetAxis_Right_Y();
+		axis_Trigger_L = gamepad.GetAxis_Trigger_L();
+		axis_Trigger_R = gamepad.GetAxis_Trigger_R();
+
+		button_A = gamepad.GetButton_A();
+		button_B = gamepad.GetButton_B();
+		button_X = gamepad.GetButton_X();
+		button_Y = gamepad.GetButton_Y();
+		button_Back = gamepad.GetButton_Back();
+		button_Guide = gamepad.GetButton_Guide();
+		button_Start = gamepad.GetButton_Start();
+		button_Stick_L = gamepad.GetButton_Stick_L();
+		button_Stick_R = gamepad.GetButton_Stick_R();
+		button_Shoulder_L = gamepad.GetButton_Shoulder_L();
+		button_Shoulder_R = gamepad.GetButton_Shoulder_R();
+		button_Dpad_U = gamepad.GetButton_Dpad_U();
+		button_Dpad_D = gamepad.GetButton_Dpad_D();
+		button_Dpad_L = gamepad.GetButton_Dpad_L();
+		button_Dpad_R = gamepad.GetButton_Dpad_R();
 
 		return true;
 	}
@@ -296,27 +514,254 @@ public:
 	virtual bool close() = 0;
 	virtual bool poll(int64_t time_out = 33) = 0;
 
+	// packet codec, shared by all transports.
+	static bool encode_packet(const njson &js, std::vector<char> &pkt, size_t max_size)
+	{
+		TRACE_SCOPE("encode");
+		std::stringstream ss;
+		ss /* << std::setw(4) */ << js << std::endl;
+		std::string ss_str = ss.str();
+		// auto cbor = njson::to_cbor(js);
+		if (ss_str.size() + 1 >= max_size) return false;
+
+		pkt.assign(ss_str.begin(), ss_str.end());
+		pkt.push_back('\0');
+
+		return true;
+	}
+
+	static bool decode_packet(const std::vector<char> &pkt, njson &js)
+	{
+		TRACE_SCOPE("decode");
+		// js = njson::from_cbor(pkt);
+		std::string str(pkt.data(), strnlen(pkt.data(), pkt.size()));
+		auto parsed = njson::parse(str, nullptr, false);
+		if (parsed.is_discarded() || !parsed.is_object()) return false;
+		js = std::move(parsed);
+
+		return true;
+	}
+
 	bool send(int64_t time_out = 33)
 	{
-		to_json(m_js, *this);
+		{
+			TRACE_SCOPE("to_json");
+			m_stages.encode = get_time_us();
+			to_json(m_js, *this);
+
+			m_seq++;
+			m_stages.send = get_time_us();
+			njson frame = { { "seq", m_seq }, { "ts", m_stages.send }, { "enc", m_stages.encode } };
+			if (m_stages.update) frame["up"] = m_stages.update;
+			// answer to ping. "ts" of this frame is t3.
+			if (m_ping_t1) {
+				frame["pong"] = { { "t1", m_ping_t1 }, { "t2", m_ping_t2 } };
+				m_ping_t1 = 0;
+			}
+			// input event time, only once per event.
+			if (m_stages.event > m_ts_event_sent) {
+				frame["ev"] = m_stages.event;
+				m_ts_event_sent = m_stages.event;
+			}
+			if (m_history_size > 0) {
+				njson hist = njson::array();
+				for (auto &[ts, st] : m_history) {
+					hist.push_back({ ts - m_stages.send,
+						st.axis[0], st.axis[1], st.axis[2], st.axis[3], st.axis[4], st.axis[5],
+						st.buttons, st.flags });
+				}
+				frame["hist"] = std::move(hist);
+				m_history.emplace_front(m_stages.send, get_state());
+				if (int(m_history.size()) > m_history_size) m_history.pop_back();
+			}
+			m_js["frame"] = std::move(frame);
+		}
 
 		return poll(time_out);
 	}
 
 	bool receive(int64_t time_out = 33)
 	{
+		m_recovered.clear();
+		m_events.clear();
+		m_coalesced = 0;
 		bool ret = poll(time_out);
 		if (ret) {
 			// LogDebug("poll() : true\n");
 		} else {
 			// LogDebug("poll() : false\n");
 		}
-		if (!m_js.empty()) from_json(m_js, *this);
+		if (!m_js.empty()) {
+			TRACE_SCOPE("from_json");
+			from_json(m_js, *this);
+
+			// new frame.
+			auto itr = m_js.find("frame");
+			if (itr != m_js.end() && itr->is_object()) {
+				auto seq = itr->value("seq", m_seq);
+				if (seq != m_seq) {
+					if (m_seq != 0 && int32_t(seq - m_seq) > 1) {
+						uint32_t lost = seq - m_seq - 1;
+						lost -= std::min(lost, m_coalesced);
+						if (lost > 0) {
+							auto recovered = std::min(recover_history(*itr, seq), lost);
+							VirtualGamepadMetrics::inc(m_metrics.hist_recovered, recovered);
+							VirtualGamepadMetrics::inc(m_metrics.drops, lost - recovered);
+
+							// the oldest ones, "hist" covers the newest.
+							const uint32_t n = lost - recovered;
+							for (uint32_t i = (n > LOST_WINDOW) ? n - LOST_WINDOW : 0; i < n; i++) m_lost.push_back(m_seq + 1 + i);
+							while (m_lost.size() > LOST_WINDOW) m_lost.pop_front();
+						}
+					}
+					m_seq = seq;
+					record_stages(*itr);
+				}
+			}
+		}
+
+		// buttons by the event channel, axes by frames.
+		if (m_event_buttons_valid) {
+			auto s = get_state();
+			s.buttons = m_event_buttons;
+			s.flags &= ~(GamepadState::FLAG_BUTTON_DOWN | GamepadState::FLAG_BUTTON_UP);
+			for (auto &e : m_events) s.flags |= e.down ? GamepadState::FLAG_BUTTON_DOWN : GamepadState::FLAG_BUTTON_UP;
+			set_state(s);
+		}
 
 		return ret;
 	}
 
 	friend std::ostream &operator<<(std::ostream &ostr, const VirtualGamepad &vg);
+
+protected:
+	// receiver -> sender, control packet (ping). false if the transport can't.
+	virtual bool send_control(const std::vector<char> &) { return false; }
+
+	// sender side, packet from receiver.
+	void on_control(const std::vector<char> &pkt, int64_t t_arrive)
+	{
+		njson js;
+		if (decode_packet(pkt, js)) on_control(js, t_arrive);
+	}
+
+	void on_control(const njson &js, int64_t t_arrive)
+	{
+		auto itr = js.find("ping");
+		if (itr != js.end() && itr->is_object()) {
+			// from the network, a field of a wrong type is ignored.
+			auto t1 = itr->find("t1");
+			if (t1 == itr->end() || !t1->is_number_integer()) return;
+			m_ping_t1 = t1->get<int64_t>();
+			m_ping_t2 = t_arrive;
+			auto loss = itr->find("loss");
+			if (loss != itr->end() && loss->is_number()) m_peer_loss = loss->get<double>();
+		}
+	}
+
+	// lost frames m_seq < s < seq from "hist" of frame seq. returns the number.
+	uint32_t recover_history(const njson &frame, uint32_t seq)
+	{
+		auto itr = frame.find("hist");
+		if (itr == frame.end() || !itr->is_array()) return 0;
+
+		const size_t first = m_recovered.size();
+		const int64_t ts = frame.value("ts", int64_t(0));
+		try {
+			for (size_t i = 0; i < itr->size(); i++) {
+				const uint32_t s = seq - 1 - i;
+				if (int32_t(s - m_seq) <= 0) break;	// received.
+
+				auto &e = (*itr)[i];
+				if (!e.is_array() || e.size() != 9) break;
+				RecoveredFrame r = {};
+				r.seq = s;
+				r.ts_send = m_clock.to_local(ts + e[0].get<int64_t>());
+				for (int n = 0; n < GamepadState::NUM_AXIS; n++) r.state.axis[n] = e[1 + n].get<int16_t>();
+				r.state.buttons = e[7].get<uint16_t>();
+				r.state.flags = e[8].get<uint8_t>();
+				m_recovered.push_back(r);
+			}
+		} catch (nlohmann::json::exception &e) {
+		}
+		std::reverse(m_recovered.begin() + first, m_recovered.end());
+
+		return m_recovered.size() - first;
+	}
+
+	// a lost frame rebuilt after newer ones arrived (FEC). it's counted in drops_rebuilt
+	// (drops stays a counter), and goes to GetRecovered(), the state stays newer. false if it isn't one counted as lost.
+	bool recover_lost(const njson &js)
+	{
+		auto itr = js.find("frame");
+		if (itr == js.end() || !itr->is_object()) return false;
+		const uint32_t seq = itr->value("seq", uint32_t(0));
+		if (int32_t(seq - m_seq) >= 0) return false;
+		auto lost = std::find(m_lost.begin(), m_lost.end(), seq);
+		if (lost == m_lost.end()) return false;
+
+		RecoveredFrame r = {};
+		if (!json_frames::to_state(js, r.state)) return false;
+		r.seq = seq;
+		r.ts_send = m_clock.to_local(itr->value("ts", int64_t(0)));
+		m_recovered.push_back(r);
+		m_lost.erase(lost);
+		VirtualGamepadMetrics::inc(m_metrics.drops_rebuilt);
+
+		return true;
+	}
+
+	void record_stages(const njson &frame)
+	{
+		auto t_arrive = m_ts_arrive ? m_ts_arrive : m_ts_sock;
+
+		// pong, update clock offset.
+		auto itr = frame.find("pong");
+		if (itr != frame.end() && itr->is_object()) {
+			m_clock.add(itr->value("t1", int64_t(0)), itr->value("t2", int64_t(0)), frame.value("ts", int64_t(0)), t_arrive);
+		}
+
+		// sender time stamps in local time.
+		FrameStages st;
+		st.event = m_clock.to_local(frame.value("ev", int64_t(0)));
+		st.update = m_clock.to_local(frame.value("up", int64_t(0)));
+		st.encode = m_clock.to_local(frame.value("enc", int64_t(0)));
+		st.send = m_clock.to_local(frame.value("ts", int64_t(0)));
+		st.arrive = m_ts_arrive;
+		st.recv = m_ts_sock;
+		st.decode = get_time_us();
+		m_stages = st;
+
+		// ping, answered in a later frame.
+		if (m_clock.need_ping(st.decode)) {
+			std::vector<char> pkt;
+			njson ping = { { "ping", { { "t1", get_time_us() } } } };
+			auto drops = m_metrics.drops.load(std::memory_order_relaxed) - m_metrics.drops_rebuilt.load(std::memory_order_relaxed);
+			if (m_loss_seq != 0 && int32_t(m_seq - m_loss_seq) > 0) {
+				// goes down if a frame lost before the last ping is rebuilt later.
+				ping["ping"]["loss"] = double(drops > m_loss_drops ? drops - m_loss_drops : 0) / int32_t(m_seq - m_loss_seq);
+			}
+			m_loss_seq = m_seq;
+			m_loss_drops = drops;
+			if (encode_packet(ping, pkt, 1500)) send_control(pkt);
+		}
+
+		if (st.send == 0) return;
+
+		m_metrics.latency.record(st.recv - st.send);
+
+		auto &h = m_metrics.stages();
+		if (st.event && st.update) h.input.record(st.update - st.event);
+		if (st.update && st.encode) h.queue.record(st.encode - st.update);
+		if (st.encode) h.encode.record(st.send - st.encode);
+		if (st.arrive) {
+			h.wire.record(st.arrive - st.send);
+			h.socket.record(st.recv - st.arrive);
+		} else {
+			h.wire.record(st.recv - st.send);
+		}
+		h.decode.record(st.decode - st.recv);
+	}
 };
 
 #ifdef USE_SRT
@@ -326,6 +771,19 @@ private:
 	SRTSOCKET m_sock = SRT_INVALID_SOCK;
 	SRTSOCKET m_sock_listen = SRT_INVALID_SOCK;
 
+	int m_latency = -1;	// [msec]. -1: libsrt default.
+
+	// direct path by hole punching, name:service is the relay. see Rendezvous.h.
+	rendezvous::Config m_rendezvous;
+
+	// SRT statistics (srt_bstats), collected in poll().
+	int64_t m_stats_interval = 1'000'000;	// [usec].
+	int64_t m_stats_last = 0;
+	mutable std::mutex m_stats_mtx;
+	std::map<std::string, double> m_srt_gauges;
+	std::map<std::string, uint64_t> m_srt_totals;	// current connection.
+	std::map<std::string, uint64_t> m_srt_totals_closed;	// sum of closed connections.
+
 	// epoll.
 	int m_pollid = -1;
 	int m_srtrfdslen = 2;
@@ -337,9 +795,11 @@ private:
 protected:
 
 public:
-	static std::unique_ptr<VirtualGamepadSRT> Create(const std::string &name, const std::string &service, em_Mode mode)
+	static std::unique_ptr<VirtualGamepadSRT> Create(const std::string &name, const std::string &service, em_Mode mode, int latency = -1, const rendezvous::Config &rdv = {})
 	{
 		auto vgmpad = std::make_unique<VirtualGamepadSRT>();
+		vgmpad->SetLatency(latency);
+		vgmpad->SetRendezvous(rdv);
 		auto ret = vgmpad->open(name, service, mode);
 
 		LogInfo("======== Virtual Gamepad ========\n");
@@ -370,6 +830,128 @@ public:
 		return receive(timeout);
 	}
 
+	// SRT latency [msec]. set before open().
+	void SetLatency(int latency) { m_latency = latency; }
+
+	// hole punching through the rendezvous server. set before open().
+	void SetRendezvous(const rendezvous::Config &rdv) { m_rendezvous = rdv; }
+
+	// SRT statistics collection interval [msec].
+	void SetStatsInterval(int interval) { m_stats_interval = int64_t(interval) * 1000; }
+
+	// counters and gauges of this session, with SRT statistics ("srt_*").
+	VirtualGamepadMetrics::Snapshot GetMetricsSnapshot() const override
+	{
+		auto s = VirtualGamepad::GetMetricsSnapshot();
+
+		std::lock_guard<std::mutex> lk(m_stats_mtx);
+		for (auto &[name, v] : m_srt_totals_closed) s.counters["srt_" + name] = v;
+		for (auto &[name, v] : m_srt_totals) s.counters["srt_" + name] += v;
+		for (auto &[name, v] : m_srt_gauges) s.gauges["srt_" + name] = v;
+
+		return s;
+	}
+
+protected:
+	// punch with a UDP socket on the port for SRT. the NAT keeps the mapping after
+	// it's closed, then both sides connect in SRT rendezvous mode.
+	bool punch(em_Mode mode, struct sockaddr_storage &local, socklen_t &local_len, struct sockaddr_storage &peer, socklen_t &peer_len)
+	{
+		int sock = socket(m_ai->ai_family, SOCK_DGRAM, 0);
+		if (sock < 0) return false;
+
+		int ret;
+		if (mode == em_Mode::RECEIVE) {
+			ret = ::bind(sock, m_ai->ai_addr, m_ai->ai_addrlen);
+		} else {
+			struct sockaddr_storage any = {};
+			any.ss_family = m_ai->ai_family;
+			ret = ::bind(sock, (struct sockaddr *)&any, (m_ai->ai_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+		}
+		local_len = sizeof local;
+		if (ret != 0 || getsockname(sock, (struct sockaddr *)&local, &local_len) != 0) {
+			LogError("ERROR!! bind for rendezvous\n");
+			::close(sock);
+			return false;
+		}
+
+		rendezvous::Puncher puncher;
+		bool direct = puncher.start(m_rendezvous, (mode == em_Mode::SEND) ? "send" : "recv", m_ai->ai_family, get_time_us()) && puncher.run(sock);
+		if (direct) {
+			memcpy(&peer, &puncher.peer(), puncher.peer_len());
+			peer_len = puncher.peer_len();
+		}
+		::close(sock);
+
+		return direct;
+	}
+
+	void collect_stats()
+	{
+		if (m_sock == SRT_INVALID_SOCK || !m_connected) return;
+
+		TRACE_SCOPE("srt_bstats");
+		SRT_TRACEBSTATS perf;
+		if (srt_bstats(m_sock, &perf, 0) == SRT_ERROR) return;
+
+		std::lock_guard<std::mutex> lk(m_stats_mtx);
+		m_srt_totals["pkt_sent"] = perf.pktSentTotal;
+		m_srt_totals["pkt_recv"] = perf.pktRecvTotal;
+		m_srt_totals["pkt_snd_loss"] = perf.pktSndLossTotal;
+		m_srt_totals["pkt_rcv_loss"] = perf.pktRcvLossTotal;
+		m_srt_totals["pkt_retrans"] = perf.pktRetransTotal;
+		m_srt_totals["pkt_snd_drop"] = perf.pktSndDropTotal;	// dropped too late to send.
+		m_srt_totals["pkt_rcv_drop"] = perf.pktRcvDropTotal;	// dropped too late to play.
+		m_srt_totals["pkt_rcv_undecrypt"] = perf.pktRcvUndecryptTotal;
+		m_srt_totals["pkt_sent_nak"] = perf.pktSentNAKTotal;
+		m_srt_totals["pkt_recv_nak"] = perf.pktRecvNAKTotal;
+		m_srt_totals["byte_sent"] = perf.byteSentTotal;
+		m_srt_totals["byte_recv"] = perf.byteRecvTotal;
+
+		m_srt_gauges["rtt_ms"] = perf.msRTT;
+		m_srt_gauges["bandwidth_mbps"] = perf.mbpsBandwidth;
+		m_srt_gauges["send_rate_mbps"] = perf.mbpsSendRate;
+		m_srt_gauges["recv_rate_mbps"] = perf.mbpsRecvRate;
+		m_srt_gauges["flight_size_pkts"] = perf.pktFlightSize;
+		m_srt_gauges["congestion_window_pkts"] = perf.pktCongestionWindow;
+		m_srt_gauges["snd_buf_pkts"] = perf.pktSndBuf;
+		m_srt_gauges["snd_buf_bytes"] = perf.byteSndBuf;
+		m_srt_gauges["snd_buf_ms"] = perf.msSndBuf;
+		m_srt_gauges["rcv_buf_pkts"] = perf.pktRcvBuf;
+		m_srt_gauges["rcv_buf_ms"] = perf.msRcvBuf;
+		m_srt_gauges["snd_tsbpd_delay_ms"] = perf.msSndTsbPdDelay;
+		m_srt_gauges["rcv_tsbpd_delay_ms"] = perf.msRcvTsbPdDelay;
+	}
+
+	// end of connection. log and keep totals.
+	void finish_stats()
+	{
+		collect_stats();
+
+		std::lock_guard<std::mutex> lk(m_stats_mtx);
+		if (m_srt_totals.empty()) return;
+
+		LogInfo("SRT stats: rtt %.1f ms, tsbpd delay snd/rcv %.0f/%.0f ms, sent %lu, recv %lu, retrans %lu, loss snd/rcv %lu/%lu, drop snd/rcv %lu/%lu\n",
+			m_srt_gauges["rtt_ms"], m_srt_gauges["snd_tsbpd_delay_ms"], m_srt_gauges["rcv_tsbpd_delay_ms"],
+			m_srt_totals["pkt_sent"], m_srt_totals["pkt_recv"], m_srt_totals["pkt_retrans"],
+			m_srt_totals["pkt_snd_loss"], m_srt_totals["pkt_rcv_loss"],
+			m_srt_totals["pkt_snd_drop"], m_srt_totals["pkt_rcv_drop"]);
+
+		for (auto &[name, v] : m_srt_totals) m_srt_totals_closed[name] += v;
+		m_srt_totals.clear();
+		m_srt_gauges.clear();
+	}
+
+	bool send_control(const std::vector<char> &pkt) override
+	{
+		if (m_sock == SRT_INVALID_SOCK || !m_connected) return false;
+
+		SRT_MSGCTRL ctrl = srt_msgctrl_default;
+		return srt_sendmsg2(m_sock, pkt.data(), (int)pkt.size(), &ctrl) != SRT_ERROR;
+	}
+
+public:
+
 	VirtualGamepadSRT()
 	{
 		m_pollid = srt_epoll_create();
@@ -424,6 +1006,11 @@ public:
 			}
 		}
 
+		// direct path, else name:service (relay) as usual.
+		struct sockaddr_storage local_addr = {}, peer_addr = {};
+		socklen_t local_addrlen = 0, peer_addrlen = 0;
+		const bool is_rendezvous = m_rendezvous.enabled() && punch(mode, local_addr, local_addrlen, peer_addr, peer_addrlen);
+
 		m_sock = srt_create_socket();
 		if ( m_sock == SRT_ERROR ) {
 			LogError("ERROR!! srt_create_socket\n");
@@ -440,9 +1027,26 @@ public:
 				srt_close(m_sock);
 				return false;
 			}
+			if (m_latency >= 0) {
+				result = srt_setsockopt(m_sock, 0, SRTO_LATENCY, &m_latency, sizeof m_latency);
+				if ( result == -1 ) {
+					LogError("Can't set SRT option : %s(%d)\n", "SRTO_LATENCY", m_latency);
+					srt_close(m_sock);
+					return false;
+				}
+			}
+
+			// rendezvous, both sides connect to each other.
+			if (is_rendezvous) {
+				if (SRT_ERROR == srt_rendezvous(m_sock, (struct sockaddr *)&local_addr, local_addrlen, (struct sockaddr *)&peer_addr, peer_addrlen))
+				{
+					LogError("ERROR!! srt_rendezvous: %s\n", srt_getlasterror_str());
+					srt_close(m_sock);
+					return false;
+				}
 
 			// caller.
-			if (is_caller) {
+			} else if (is_caller) {
 				// connect to the receiver, implicit bind
 				if (SRT_ERROR == srt_connect(m_sock, m_ai->ai_addr, m_ai->ai_addrlen))
 				{
@@ -511,6 +1115,10 @@ public:
 		}
 
 		if (m_sock != SRT_INVALID_SOCK) {
+			if (m_connected) {
+				finish_stats();
+				m_connected = false;
+			}
 			int r = srt_close(m_sock);
 			m_sock = SRT_INVALID_SOCK;
 			if (r != SRT_ERROR) ret = true;
@@ -523,20 +1131,32 @@ public:
 	{
 		if (m_sock == SRT_INVALID_SOCK)
 		{
+			TRACE_SCOPE("open");
+			VirtualGamepadMetrics::inc(m_metrics.reconnects);
 			if (!open(m_name, m_service, m_mode)) return false;
 		}
 
 		const auto str_direction = (m_mode == em_Mode::RECEIVE) ? "source" : "target";
 
+		auto now = get_time_us();
+		if (m_stats_interval > 0 && now - m_stats_last >= m_stats_interval) {
+			m_stats_last = now;
+			collect_stats();
+		}
+
 		m_srtrfdslen = 2;
 		m_srtwfdslen = 2;
 		for (auto &e : m_srtrwfds) e = SRT_INVALID_SOCK;
 		// m_sysrfdslen = 2;
 		// for (auto &e : m_sysrfds) e = SRT_INVALID_SOCK;
-		auto ret_epoll_wait = srt_epoll_wait(m_pollid,
-			&m_srtrwfds[0], &m_srtrfdslen, &m_srtrwfds[2], &m_srtwfdslen,
-			time_out,
-			0, 0, 0, 0);
+		int ret_epoll_wait;
+		{
+			TRACE_SCOPE("srt_epoll_wait");
+			ret_epoll_wait = srt_epoll_wait(m_pollid,
+				&m_srtrwfds[0], &m_srtrfdslen, &m_srtrwfds[2], &m_srtwfdslen,
+				time_out,
+				0, 0, 0, 0);
+		}
 			// &m_sysrfds[0], &m_sysrfdslen, 0, 0);
 		// LogDebug("srt_epoll_wait = %d (%s)\n", ret_epoll_wait, srt_getlasterror_str());
 		if (ret_epoll_wait >= 0
@@ -631,6 +1251,7 @@ public:
 						if (m_connected)
 						{
 							LogInfo("SRT %s disconnected\n", str_direction);
+							finish_stats();
 							m_connected = false;
 						}
 
@@ -668,6 +1289,7 @@ public:
 				std::list<std::vector<char>> dataqueue;
 				if (m_sock != SRT_INVALID_SOCK && (m_srtrfdslen /* || m_sysrfdslen */))
 				{
+					TRACE_SCOPE("socket.recv");
 					std::vector<char> pkt(SRT_LIVE_MAX_PLSIZE);
 					SRT_MSGCTRL ctrl;
 					const int stat = srt_recvmsg2(m_sock, pkt.data(), (int)pkt.size(), &ctrl);
@@ -675,14 +1297,19 @@ public:
 					if (stat <= 0)
 					{
 						// LogInfo("Empty packets\n");
+						VirtualGamepadMetrics::inc(m_metrics.empty_polls);
 						clear_axis_button_status();
 						return false;
 					}
 					if (stat < pkt.size()) pkt.resize(stat);
 					dataqueue.push_back(pkt);
+					m_ts_sock = get_time_us();
+					VirtualGamepadMetrics::inc(m_metrics.packets_in);
+					VirtualGamepadMetrics::inc(m_metrics.bytes_in, stat);
 
 				} else {
 					// LogInfo("Empty packets\n");
+					VirtualGamepadMetrics::inc(m_metrics.empty_polls);
 					clear_axis_button_status();
 					return false;
 				}
@@ -691,25 +1318,18 @@ public:
 				while (!dataqueue.empty())
 				{
 					std::vector<char> pkt = dataqueue.front();
-					// m_js = njson::from_cbor(pkt);
-					std::string str = pkt.data();
-					m_js = njson::parse(str);
 					dataqueue.pop_front();
+					if (!decode_packet(pkt, m_js)) {
+						VirtualGamepadMetrics::inc(m_metrics.parse_errors);
+						clear_axis_button_status();
+						return false;
+					}
 				}
 
 			} else if (m_mode == em_Mode::SEND) {
 				std::list<std::vector<char>> dataqueue;
-				std::vector<char> pkt(SRT_LIVE_MAX_PLSIZE);
-				std::stringstream ss;
-				ss /* << std::setw(4) */ << m_js << std::endl;
-				std::string ss_str = ss.str();
-				// auto cbor = njson::to_cbor(m_js);
-				// auto json_size = ss_str.size();
-				// auto cbor_size = cbor.size();
-				if (ss_str.size() + 1 < pkt.size()) {
-					pkt.assign(ss_str.begin(), ss_str.end());
-					pkt.resize(ss_str.size() + 1);
-					pkt.back() = '\0';
+				std::vector<char> pkt;
+				if (encode_packet(m_js, pkt, SRT_LIVE_MAX_PLSIZE)) {
 					dataqueue.push_back(pkt);
 				} else {
 					LogError("ERROR!! pkt size is not enough.\n");
@@ -718,6 +1338,7 @@ public:
 
 				while (!dataqueue.empty())
 				{
+					TRACE_SCOPE("socket.send");
 					std::vector<char> pkt = dataqueue.front();
 					SRT_MSGCTRL ctrl = srt_msgctrl_default;
 					int stat = srt_sendmsg2(m_sock, pkt.data(), (int)pkt.size(), &ctrl);
@@ -725,15 +1346,72 @@ public:
 					if (stat == SRT_ERROR)
 					{
 						LogError("ERROR!! send SRT packet.\n");
+						VirtualGamepadMetrics::inc(m_metrics.send_errors);
 						return false;
 					}
+					VirtualGamepadMetrics::inc(m_metrics.packets_out);
+					VirtualGamepadMetrics::inc(m_metrics.bytes_out, stat);
 					dataqueue.pop_front();
 				}
+
+				// control packets from receiver (ping), if the caller doesn't wait_control().
+				TRACE_SCOPE("socket.recv_control");
+				read_control(get_time_us());
 			}
 		}
 
 		return true;
 	}
+
+	// the ping is read when it's readable, so t2 of the pong is its arrival time,
+	// not the time of the next send().
+	void wait_control(int64_t time_out) override
+	{
+		const int64_t deadline = get_time_us() + time_out;
+		for (int64_t now = get_time_us(); now < deadline; now = get_time_us()) {
+			if (m_mode != em_Mode::SEND || !m_connected) {
+				std::this_thread::sleep_for(std::chrono::microseconds(deadline - now));
+				break;
+			}
+
+			// no writefds, the socket being writable doesn't wake up.
+			SRTSOCKET rfds[2];
+			int rlen = 2;
+			const int64_t ms = (deadline - now + 999) / 1000;
+			int ret;
+			{
+				TRACE_SCOPE("srt_epoll_wait(control)");
+				ret = srt_epoll_wait(m_pollid, rfds, &rlen, nullptr, nullptr, ms, 0, 0, 0, 0);
+			}
+			if (ret <= 0 || rlen <= 0) continue;	// timeout.
+
+			// readable but nothing to read: broken, poll() will see it.
+			if (!read_control(get_time_us())) {
+				now = get_time_us();
+				if (now < deadline) std::this_thread::sleep_for(std::chrono::microseconds(deadline - now));
+				break;
+			}
+		}
+	}
+
+private:
+	// sender, read all the control packets queued. t_arrive : time they got readable.
+	// returns the number read.
+	int read_control(int64_t t_arrive)
+	{
+		int n = 0;
+		while (m_connected) {
+			std::vector<char> pkt(SRT_LIVE_MAX_PLSIZE);
+			SRT_MSGCTRL ctrl;
+			const int stat = srt_recvmsg2(m_sock, pkt.data(), (int)pkt.size(), &ctrl);
+			if (stat <= 0) break;
+			pkt.resize(stat);
+			on_control(pkt, t_arrive);
+			n++;
+		}
+
+		return n;
+	}
 };
 #else
 class VirtualGamepadSRT : public VirtualGamepad
@@ -743,7 +1421,7 @@ private:
 protected:
 
 public:
-	static std::unique_ptr<VirtualGamepadSRT> Create(const std::string &name, const std::string &service, em_Mode mode)
+	static std::unique_ptr<VirtualGamepadSRT> Create(const std::string &name, const std::string &service, em_Mode mode, int latency = -1, const rendezvous::Config &rdv = {})
 	{
 		auto vgmpad = std::make_unique<VirtualGamepadSRT>();
 		vgmpad.reset();
@@ -756,6 +1434,9 @@ public:
 
 	bool Poll( uint32_t timeout=0 ) override { return false; }
 
+	void SetLatency(int latency) {}
+	void SetRendezvous(const rendezvous::Config &rdv) {}
+
 	VirtualGamepadSRT()
 	{
 		LogError("This execution binary is not support SRT.\n");
@@ -772,17 +1453,222 @@ public:
 
 class VirtualGamepadUDP : public VirtualGamepad
 {
-private:
+protected:
 	static constexpr auto WAIT_FOR_RECONNECT = 500;	// [msec].
 
 	int m_sock = -1;
 
-protected:
+	// receiver address, destination of frames (SEND mode).
+	struct sockaddr_storage m_dest_addr = {};
+	socklen_t m_dest_addrlen = 0;
+
+	// sender address, destination of control packets (RECEIVE mode).
+	struct sockaddr_storage m_peer_addr = {};
+	socklen_t m_peer_addrlen = 0;
+
+	// direct path by hole punching, name:service is the relay. see Rendezvous.h.
+	rendezvous::Config m_rendezvous;
+	rendezvous::Puncher m_punch;
+
+	// redundant paths, each frame is sent to name:service and all of them (SEND mode).
+	struct Path {
+		std::string name;
+		struct sockaddr_storage addr;
+		socklen_t addrlen;
+	};
+	std::vector<Path> m_paths;
+
+	// first copy of a frame wins (RECEIVE mode).
+	FrameDedup m_dedup;
+
+	// parity packets, see Fec.h.
+	FecEncoder m_fec_enc;	// SEND mode.
+	FecDecoder m_fec_dec;	// RECEIVE mode.
+
+	// button events, reliable and ordered. see ButtonEvents.h.
+	bool m_events_enabled = false;
+	ButtonEventSender m_evt_tx;	// SEND mode.
+	ButtonEventReceiver m_evt_rx;	// RECEIVE mode.
+
+	// one more packet of a frame (copy, parity). a failed one doesn't stop the others.
+	void send_extra(const std::vector<char> &pkt, const struct sockaddr_storage &addr, socklen_t addrlen)
+	{
+		int stat = sendto(m_sock, pkt.data(), pkt.size(), 0, (struct sockaddr *)&addr, addrlen);
+		if (stat < 1) {
+			VirtualGamepadMetrics::inc(m_metrics.send_errors);
+			return;
+		}
+		VirtualGamepadMetrics::inc(m_metrics.packets_out);
+		VirtualGamepadMetrics::inc(m_metrics.bytes_out, stat);
+	}
+
+	// false if js is a copy of a frame already received, or older than it.
+	bool accept_frame(const njson &js)
+	{
+		auto itr = js.find("frame");
+		if (itr == js.end() || !itr->is_object()) return true;
+
+		switch (m_dedup.check(itr->value("seq", uint32_t(0)), itr->value("ts", int64_t(0)))) {
+		case FrameDedup::em_Result::DUPLICATE:
+			VirtualGamepadMetrics::inc(m_metrics.duplicates);
+			return false;
+		case FrameDedup::em_Result::LATE:
+			VirtualGamepadMetrics::inc(m_metrics.late);
+			return false;
+		default:
+			return true;
+		}
+	}
+
+	// frames / pings over the direct path while it's up, else over the relay.
+	void use_path()
+	{
+		if (m_mode == em_Mode::SEND) {
+			if (m_punch.IsDirect()) {
+				memcpy(&m_dest_addr, &m_punch.peer(), m_punch.peer_len());
+				m_dest_addrlen = m_punch.peer_len();
+			} else if (m_ai) {
+				memcpy(&m_dest_addr, m_ai->ai_addr, m_ai->ai_addrlen);
+				m_dest_addrlen = m_ai->ai_addrlen;
+			}
+		} else if (m_punch.IsDirect()) {
+			memcpy(&m_peer_addr, &m_punch.peer(), m_punch.peer_len());
+			m_peer_addrlen = m_punch.peer_len();
+		}
+	}
+
+	void punch_step()
+	{
+		const bool direct = m_punch.IsDirect();
+		m_punch.step(m_sock, get_time_us());
+		if (direct != m_punch.IsDirect()) use_path();
+	}
+
+	// true if js is a rendezvous message, not a frame or a control packet.
+	bool on_rendezvous(const njson &js, const struct sockaddr_storage &from, socklen_t fromlen)
+	{
+		const bool direct = m_punch.IsDirect();
+		auto itr = js.find("rdv");
+		const bool is_rdv = (itr != js.end() && itr->is_object());
+		if (is_rdv) {
+			m_punch.on_message(m_sock, *itr, from, fromlen, get_time_us());
+		} else {
+			m_punch.on_packet(from, fromlen, get_time_us());
+		}
+		if (direct != m_punch.IsDirect()) use_path();
+
+		return is_rdv;
+	}
+
+	// new edges of the buttons, and the pending events if they are due (SEND mode).
+	void send_button_events()
+	{
+		if (!m_events_enabled) return;
+
+		const auto now = get_time_us();
+		auto lost = m_evt_tx.update(get_state().buttons, m_stages.event ? m_stages.event : now);
+		VirtualGamepadMetrics::inc(m_metrics.events_lost, lost);
+
+		bool retransmit = false;
+		if (!m_evt_tx.due(now, retransmit)) return;
+		if (retransmit) VirtualGamepadMetrics::inc(m_metrics.event_retransmits);
+
+		TRACE_SCOPE("socket.send_events");
+		std::vector<char> pkt;
+		if (!encode_packet(m_evt_tx.packet(now), pkt, 1500)) return;
+		send_extra(pkt, m_dest_addr, m_dest_addrlen);
+		for (auto &path : m_paths) send_extra(pkt, path.addr, path.addrlen);
+	}
+
+	// "evt" from the sender, ack to where it came from (RECEIVE mode).
+	void on_button_events(const njson &evt, const struct sockaddr_storage &from, socklen_t fromlen)
+	{
+		njson ack;
+		uint32_t lost = 0;
+		if (!m_evt_rx.on_packet(evt, m_events, ack, lost)) {
+			VirtualGamepadMetrics::inc(m_metrics.parse_errors);
+			return;
+		}
+		VirtualGamepadMetrics::inc(m_metrics.events_lost, lost);
+		m_event_buttons_valid = true;
+		m_event_buttons = m_evt_rx.GetButtons();
+
+		std::vector<char> pkt;
+		if (encode_packet(ack, pkt, 1500)) sendto(m_sock, pkt.data(), pkt.size(), 0, (struct sockaddr *)&from, fromlen);
+	}
+
+	// control packets from receiver: ping, ack of button events (SEND mode).
+	void recv_control()
+	{
+		TRACE_SCOPE("socket.recv_control");
+		while (true) {
+			std::vector<char> pkt(1500);
+			int64_t t_arrive = 0;
+			struct sockaddr_storage from_addr;
+			socklen_t from_addrlen = sizeof(from_addr);
+			const int stat = recv_packet(pkt, &from_addr, &from_addrlen, t_arrive);
+			if (stat <= 0) break;
+			pkt.resize(stat);
+
+			njson js;
+			if (!decode_packet(pkt, js)) continue;
+			if (m_punch.IsActive() && on_rendezvous(js, from_addr, from_addrlen)) continue;
+			auto itr = js.find("evack");
+			if (itr != js.end() && itr->is_object()) {
+				m_evt_tx.on_ack(*itr, get_time_us());
+				continue;
+			}
+			on_control(js, t_arrive ? t_arrive : get_time_us());
+		}
+	}
+
+	bool send_control(const std::vector<char> &pkt) override
+	{
+		if (m_sock < 0 || m_peer_addrlen == 0) return false;
+
+		return sendto(m_sock, pkt.data(), pkt.size(), 0, (struct sockaddr *)&m_peer_addr, m_peer_addrlen) > 0;
+	}
+
+	// recvfrom with arrival time stamp by kernel [usec]. t_arrive = 0 if not supported.
+	// (no recvmsg on Windows)
+	int recv_packet(std::vector<char> &pkt, struct sockaddr_storage *from_addr, socklen_t *from_addrlen, int64_t &t_arrive)
+	{
+		t_arrive = 0;
+#if defined(_WIN32)
+		return recvfrom(m_sock, pkt.data(), int(pkt.size()), 0, (struct sockaddr *)from_addr, from_addrlen);
+#else
+		char ctrl[CMSG_SPACE(sizeof(struct timeval))];
+		struct iovec iov = { pkt.data(), pkt.size() };
+		struct msghdr msg = {};
+		msg.msg_name = from_addr;
+		msg.msg_namelen = from_addrlen ? *from_addrlen : 0;
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = ctrl;
+		msg.msg_controllen = sizeof(ctrl);
+		const int stat = recvmsg(m_sock, &msg, 0);
+		if (stat <= 0) return stat;
+
+		if (from_addrlen) *from_addrlen = msg.msg_namelen;
+#if defined(SO_TIMESTAMP)
+		for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMP) {
+				struct timeval tv;
+				memcpy(&tv, CMSG_DATA(cmsg), sizeof tv);
+				t_arrive = int64_t(tv.tv_sec) * 1'000'000 + tv.tv_usec;
+			}
+		}
+#endif
+
+		return stat;
+#endif
+	}
 
 public:
-	static std::unique_ptr<VirtualGamepadUDP> Create(const std::string &name, const std::string &service, em_Mode mode)
+	static std::unique_ptr<VirtualGamepadUDP> Create(const std::string &name, const std::string &service, em_Mode mode, const rendezvous::Config &rdv = {})
 	{
 		auto vgmpad = std::make_unique<VirtualGamepadUDP>();
+		vgmpad->SetRendezvous(rdv);
 		auto ret = vgmpad->open(name, service, mode);
 
 		LogInfo("======== Virtual Gamepad ========\n");
@@ -813,12 +1699,67 @@ public:
 		return receive(timeout);
 	}
 
-	VirtualGamepadUDP() {}
+	// hole punching through the rendezvous server. set before open().
+	void SetRendezvous(const rendezvous::Config &rdv) { m_rendezvous = rdv; }
 
-	virtual ~VirtualGamepadUDP()
+	// parity packets, k frames per group (0: adaptive to loss), m parity per group (SEND mode).
+	bool SetFec(int k, int m)
 	{
-		if (!close()) {
-			LogError("ERROR!! VirtualGamepad close.\n");
+		if (!m_fec_enc.configure(k, m)) return false;
+		if (m_fec_enc.enabled()) LogInfo("virtual gamepad -- fec k=%s m=%d\n", k ? std::to_string(k).c_str() : "auto", m);
+
+		return true;
+	}
+
+	// button presses / releases over a reliable sub channel too (SEND mode).
+	// the receiver follows without a setting.
+	void SetEvents(bool enable) { m_events_enabled = enable; }
+
+	bool send_events() override
+	{
+		if (!m_events_enabled || m_mode != em_Mode::SEND || m_sock < 0) return false;
+
+		if (m_punch.IsActive()) punch_step();
+		send_button_events();
+		recv_control();
+
+		return true;
+	}
+
+	// send each frame over one more path too, e.g. another relay (SEND mode).
+	bool AddPath(const std::string &name, const std::string &service)
+	{
+		addrinfo fo = {
+			0,
+			m_ai ? m_ai->ai_family : AF_UNSPEC,
+			SOCK_DGRAM, IPPROTO_UDP,
+			0, 0,
+			NULL, NULL
+		};
+		addrinfo *ai = nullptr;
+		int erc = getaddrinfo(name.c_str(), service.c_str(), &fo, &ai);
+		if (erc != 0) {
+			LogError("ERROR!! getaddrinfo(errno=%d): name=%s, service=%s.\n", erc, name.c_str(), service.c_str());
+			return false;
+		}
+
+		Path path;
+		path.name = name + ":" + service;
+		memcpy(&path.addr, ai->ai_addr, ai->ai_addrlen);
+		path.addrlen = ai->ai_addrlen;
+		freeaddrinfo(ai);
+		m_paths.push_back(path);
+		LogInfo("virtual gamepad -- path %s\n", path.name.c_str());
+
+		return true;
+	}
+
+	VirtualGamepadUDP() {}
+
+	virtual ~VirtualGamepadUDP()
+	{
+		if (!close()) {
+			LogError("ERROR!! VirtualGamepad close.\n");
 			// exit(EXIT_FAILURE);
 		}
 	}
@@ -855,9 +1796,16 @@ public:
 		}
 
 		if (mode == em_Mode::SEND) {
+			memcpy(&m_dest_addr, m_ai->ai_addr, m_ai->ai_addrlen);
+			m_dest_addrlen = m_ai->ai_addrlen;
+
 			// pre config.
 			int yes = 1;
 			setsockopt(m_sock, SOL_SOCKET, SO_REUSEADDR, (const char*)&yes, sizeof yes);
+#if defined(SO_TIMESTAMP)
+			// arrival time stamp of ping from receiver.
+			setsockopt(m_sock, SOL_SOCKET, SO_TIMESTAMP, (const char*)&yes, sizeof yes);
+#endif
 #if defined(_WIN32)
 			unsigned long ulyes = 1;
 			if (ioctlsocket(m_sock, FIONBIO, &ulyes) == SOCKET_ERROR)
@@ -879,6 +1827,10 @@ public:
 			}
 
 			int yes = 1;
+#if defined(SO_TIMESTAMP)
+			// arrival time stamp by kernel, to split wire and receive loop.
+			setsockopt(m_sock, SOL_SOCKET, SO_TIMESTAMP, (const char*)&yes, sizeof yes);
+#endif
 #if defined(_WIN32)
 			unsigned long ulyes = 1;
 			if (ioctlsocket(m_sock, FIONBIO, &ulyes) == SOCKET_ERROR)
@@ -893,6 +1845,10 @@ public:
 			LogInfo("SUCCESS!! open virtual gamepad(RECEIVE).\n");
 		}
 
+		if (m_rendezvous.enabled()) {
+			m_punch.start(m_rendezvous, mode == em_Mode::SEND ? "send" : "recv", m_ai->ai_family, get_time_us());
+		}
+
 		return true;
 	}
 
@@ -922,83 +1878,753 @@ public:
 	{
 		if (m_sock == -1)
 		{
+			TRACE_SCOPE("open");
+			VirtualGamepadMetrics::inc(m_metrics.reconnects);
 			if (!open(m_name, m_service, m_mode)) return false;
 		}
 
 		const auto str_direction = m_mode == em_Mode::RECEIVE ? "source" : "target";
 
+		if (m_punch.IsActive()) punch_step();
+
 		{
 			if (m_mode == em_Mode::RECEIVE) {
-				std::list<std::vector<char>> dataqueue;
-				if (m_sock >= 0)
-				{
-					std::vector<char> pkt(1500);
-					socklen_t sin_size;
-					struct sockaddr_in from_addr;
-					const int stat = recvfrom(m_sock, pkt.data(), pkt.size(), 0, (struct sockaddr *)&from_addr, &sin_size);
+				// read until a new frame. rendezvous messages and copies over the other
+				// paths are skipped in the same poll, they don't take a turn of the loop.
+				while (true) {
+					struct sockaddr_storage from_addr;
+					socklen_t from_addrlen = sizeof(from_addr);
+					std::vector<char> pkt(1500 + sizeof(FecHeader));
+					int stat = 0;
+					if (m_sock >= 0)
+					{
+						TRACE_SCOPE("socket.recv");
+						stat = recv_packet(pkt, &from_addr, &from_addrlen, m_ts_arrive);
+					}
 					if (stat <= 0)
 					{
 						// LogInfo("Empty packets\n");
+						VirtualGamepadMetrics::inc(m_metrics.empty_polls);
 						clear_axis_button_status();
 						return false;
 					}
 					if (stat < pkt.size()) pkt.resize(stat);
-					dataqueue.push_back(pkt);
+					m_ts_sock = get_time_us();
+					VirtualGamepadMetrics::inc(m_metrics.packets_in);
+					VirtualGamepadMetrics::inc(m_metrics.bytes_in, stat);
+
+					// parity, a lost frame is rebuilt if the others of the group are here.
+					bool rebuilt = false;
+					if (FecDecoder::is_parity(pkt.data(), pkt.size())) {
+						TRACE_SCOPE("fec");
+						std::vector<char> frame;
+						if (!m_fec_dec.recover(pkt.data(), pkt.size(), frame)) continue;
+						pkt = std::move(frame);
+						rebuilt = true;
+					}
 
-				} else {
-					// LogInfo("Empty packets\n");
-					clear_axis_button_status();
-					return false;
-				}
+					njson js;
+					if (!decode_packet(pkt, js)) {
+						VirtualGamepadMetrics::inc(m_metrics.parse_errors);
+						clear_axis_button_status();
+						return false;
+					}
+					if (m_punch.IsActive() && on_rendezvous(js, from_addr, from_addrlen)) continue;
+					auto evt = js.find("evt");
+					if (evt != js.end() && evt->is_object()) {
+						on_button_events(*evt, from_addr, from_addrlen);
+						continue;
+					}
+					if (m_fec_dec.IsActive()) {
+						auto itr = js.find("frame");
+						if (itr != js.end() && itr->is_object()) m_fec_dec.add(itr->value("seq", uint32_t(0)), pkt);
+					}
+					// the parity comes after the group, so a rebuilt frame is
+					// usually older than the state, and was counted as a drop.
+					if (rebuilt && recover_lost(js)) {
+						VirtualGamepadMetrics::inc(m_metrics.fec_recovered);
+						continue;
+					}
+					if (!accept_frame(js)) continue;
+					if (rebuilt) VirtualGamepadMetrics::inc(m_metrics.fec_recovered);
+
+					// buttons by the event channel only while frames come from its sender.
+					// a sender restarted without --events, or another one, has no / another "es".
+					if (m_event_buttons_valid) {
+						int64_t es = 0;
+						auto itr = js.find("frame");
+						if (itr != js.end() && itr->is_object()) {
+							auto e = itr->find("es");
+							if (e != itr->end() && e->is_number_integer()) es = e->get<int64_t>();
+						}
+						if (es != m_evt_rx.GetStart()) m_event_buttons_valid = false;
+					}
 
-				// LogDebug("dataqueue size = %ld\n", dataqueue.size());
-				while (!dataqueue.empty())
-				{
-					std::vector<char> pkt = dataqueue.front();
-					// m_js = njson::from_cbor(pkt);
-					std::string str = pkt.data();
-					m_js = njson::parse(str);
-					dataqueue.pop_front();
+					m_js = std::move(js);
+					memcpy(&m_peer_addr, &from_addr, from_addrlen);
+					m_peer_addrlen = from_addrlen;
+					break;
 				}
 
 			} else if (m_mode == em_Mode::SEND) {
+				// events ahead of the frame, it carries the same buttons, and the
+				// run of the event channel, so the receiver knows it's still used.
+				send_button_events();
+				if (m_events_enabled && m_evt_tx.GetStart()) m_js["frame"]["es"] = m_evt_tx.GetStart();
+
 				std::list<std::vector<char>> dataqueue;
-				std::vector<char> pkt(1500);
-				std::stringstream ss;
-				ss /* << std::setw(4) */ << m_js << std::endl;
-				std::string ss_str = ss.str();
-				// auto cbor = njson::to_cbor(m_js);
-				// auto json_size = ss_str.size();
-				// auto cbor_size = cbor.size();
-				if (ss_str.size() + 1 < pkt.size()) {
-					pkt.assign(ss_str.begin(), ss_str.end());
-					pkt.resize(ss_str.size() + 1);
-					pkt.back() = '\0';
+				std::vector<char> pkt;
+				if (encode_packet(m_js, pkt, 1500)) {
 					dataqueue.push_back(pkt);
 				} else {
 					LogError("ERROR!! pkt size is not enough.\n");
 					return false;
 				}
 
+				bool dropped = false;
 				while (!dataqueue.empty())
 				{
+					TRACE_SCOPE("socket.send");
 					std::vector<char> pkt = dataqueue.front();
-					int stat = sendto(m_sock, pkt.data(), pkt.size(), 0, m_ai->ai_addr, m_ai->ai_addrlen);
+					int stat = sendto(m_sock, pkt.data(), pkt.size(), 0, (struct sockaddr *)&m_dest_addr, m_dest_addrlen);
+					if (stat < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+					{
+						// receive queue is full (unix socket), drop the frame as UDP does.
+						VirtualGamepadMetrics::inc(m_metrics.send_errors);
+						dropped = true;
+						break;
+					}
 					if (stat < 1)
 					{
 						LogError("ERROR!! send UDP packet.\n");
+						VirtualGamepadMetrics::inc(m_metrics.send_errors);
 						close();	// to reconnect.
-						std::this_thread::sleep_for(std::chrono::milliseconds(WAIT_FOR_RECONNECT));
+						if (m_reconnect_wait) {
+							TRACE_SCOPE("reconnect_wait");
+							std::this_thread::sleep_for(std::chrono::milliseconds(WAIT_FOR_RECONNECT));
+						}
 						return false;
 					}
+					VirtualGamepadMetrics::inc(m_metrics.packets_out);
+					VirtualGamepadMetrics::inc(m_metrics.bytes_out, stat);
 					dataqueue.pop_front();
 				}
+
+				// same frame over the redundant paths.
+				for (auto &path : m_paths) {
+					TRACE_SCOPE("socket.send_path");
+					send_extra(pkt, path.addr, path.addrlen);
+				}
+
+				// parity when a group is complete, over all paths.
+				if (m_fec_enc.enabled() && !dropped) {
+					TRACE_SCOPE("fec");
+					m_fec_enc.set_loss(m_peer_loss);
+					std::vector<std::vector<char>> parity;
+					m_fec_enc.add(m_seq, pkt, parity);
+					for (auto &p : parity) {
+						send_extra(p, m_dest_addr, m_dest_addrlen);
+						for (auto &path : m_paths) send_extra(p, path.addr, path.addrlen);
+					}
+				}
+
+				recv_control();
+				if (dropped) return false;
+			}
+		}
+
+		return true;
+	}
+};
+
+#if !defined(_WIN32)
+// same host only, over unix domain datagram socket in the abstract namespace.
+// "name:service/unix" -> "@vgmpad:service", name is ignored.
+// the sender binds to an auto assigned address, so the receiver can send ping back.
+class VirtualGamepadUnix : public VirtualGamepadUDP
+{
+public:
+	static std::unique_ptr<VirtualGamepadUnix> Create(const std::string &name, const std::string &service, em_Mode mode)
+	{
+		auto vgmpad = std::make_unique<VirtualGamepadUnix>();
+		auto ret = vgmpad->open(name, service, mode);
+
+		LogInfo("======== Virtual Gamepad ========\n");
+
+		if (!ret) {
+			LogError("virtual gamepad -- can't opened\n");
+		} else {
+			std::string mode_str;
+			if (mode == em_Mode::RECEIVE) {
+				mode_str = "Receive";
+			} else if (mode == em_Mode::SEND) {
+				mode_str = "Send";
+			} else {
+				mode_str = "None";
+			}
+			LogSuccess("virtual gamepad -- opened(%s) @%s\n", mode_str.c_str(), socket_name(service).c_str());
+		}
+
+		return vgmpad;
+	}
+
+	VirtualGamepadUnix() {}
+
+	// abstract socket name, without leading '\0'.
+	static std::string socket_name(const std::string &service)
+	{
+		return "vgmpad:" + service;
+	}
+
+	bool open(const std::string &name, const std::string &service, em_Mode mode) override
+	{
+		m_mode = mode;
+		m_name = name;
+		m_service = service;
+
+		auto path = socket_name(service);
+		struct sockaddr_un addr = {};
+		addr.sun_family = AF_UNIX;
+		if (service.empty() || path.size() + 1 > sizeof addr.sun_path) {
+			LogError("ERROR!! unix socket name: service=%s.\n", service.c_str());
+			return false;
+		}
+		memcpy(addr.sun_path + 1, path.data(), path.size());	// sun_path[0] = '\0' : abstract.
+		auto addrlen = socklen_t(offsetof(struct sockaddr_un, sun_path) + 1 + path.size());
+
+		m_sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+		if ( m_sock < 0 ) {
+			LogError("ERROR!! create socket\n");
+			return false;
+		}
+
+		int yes = 1;
+#if defined(SO_TIMESTAMP)
+		setsockopt(m_sock, SOL_SOCKET, SO_TIMESTAMP, (const char*)&yes, sizeof yes);
+#endif
+		if (ioctl(m_sock, FIONBIO, (const char *)&yes) < 0) {
+			LogError("ERROR!! VirtualGamepadUnix ioctl FIONBIO\n");
+			return false;
+		}
+
+		if (mode == em_Mode::SEND) {
+			memcpy(&m_dest_addr, &addr, addrlen);
+			m_dest_addrlen = addrlen;
+
+			// autobind, for ping from receiver.
+			sa_family_t family = AF_UNIX;
+			if (::bind(m_sock, (struct sockaddr *)&family, sizeof family) != 0) {
+				LogError("ERROR!! bind\n");
+				return false;
+			}
+
+			LogInfo("SUCCESS!! open virtual gamepad(SEND).\n");
+
+		} else if (mode == em_Mode::RECEIVE) {
+			if (::bind(m_sock, (struct sockaddr *)&addr, addrlen) != 0) {
+				LogError("ERROR!! bind @%s: %s\n", path.c_str(), strerror(errno));
+				return false;
+			}
+
+			LogInfo("SUCCESS!! open virtual gamepad(RECEIVE).\n");
+		}
+
+		return true;
+	}
+};
+
+// TCP, for sites where only TCP gets through.
+//   frame = length (4 bytes, big endian) + packet.
+//   receiver listens, sender connects. TCP_NODELAY, and TCP_QUICKACK after each read.
+//   sender : latest wins. while the socket is backpressured, a new frame replaces
+//            the one waiting, instead of queueing stale frames in the socket buffer.
+//   receiver : every complete frame is read and decoded, the latest one is used.
+//              one sender at a time, another one is accepted when it has closed
+//              or been silent for TAKEOVER_IDLE.
+// input events (axis motion, button down / up) of a replaced frame are kept in
+// the newer one, and the seq gap it leaves is counted as coalesced, not as drops.
+// the frame's state itself is gone (not in GetRecovered()).
+// ping / pong go on the same connection.
+class VirtualGamepadTCP : public VirtualGamepad
+{
+protected:
+	static constexpr auto WAIT_FOR_RECONNECT = 500;	// [msec].
+	static constexpr auto CONNECT_TIMEOUT = 1000;	// [msec].
+	static constexpr int64_t TAKEOVER_IDLE = 1'000'000;	// [usec], a new sender replaces one silent this long.
+	static constexpr size_t MAX_FRAME = 65536;
+	static constexpr int SNDBUF = 16 * 1024;	// small, so backpressure shows up early.
+
+	int m_listen = -1;	// RECEIVE mode.
+	int m_sock = -1;	// connection.
+
+	// SEND mode, frame being written, and the latest frame waiting for it.
+	// RECEIVE mode, control frames (ping) being written, one after another.
+	std::vector<char> m_out;
+	size_t m_out_pos = 0;
+	std::vector<char> m_next;
+	njson m_next_flags;		// input events of m_next, kept if it is replaced.
+	uint32_t m_next_skip = 0;	// frames m_next replaced.
+
+	// SEND mode, connect in progress since [usec], finished in poll(). 0: not connecting.
+	int64_t m_connect_start = 0;
+
+	// received, not yet a complete frame.
+	std::vector<char> m_in;
+	int64_t m_ts_in = 0;	// RECEIVE mode, last data from the sender [usec].
+
+	static void put_frame(const std::vector<char> &pkt, std::vector<char> &out)
+	{
+		uint32_t len = pkt.size();
+		out.resize(4 + pkt.size());
+		out[0] = char(len >> 24);
+		out[1] = char(len >> 16);
+		out[2] = char(len >> 8);
+		out[3] = char(len);
+		memcpy(out.data() + 4, pkt.data(), pkt.size());
+	}
+
+	static void set_nodelay(int sock)
+	{
+		int yes = 1;
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&yes, sizeof yes);
+	}
+
+	// delayed ACK holds the window update on a one-way stream, re-armed after each read.
+	static void set_quickack(int sock)
+	{
+#if defined(TCP_QUICKACK)
+		int yes = 1;
+		setsockopt(sock, IPPROTO_TCP, TCP_QUICKACK, (const char*)&yes, sizeof yes);
+#endif
+	}
+
+	void close_connection()
+	{
+		if (m_sock >= 0) ::close(m_sock);
+		m_sock = -1;
+		m_out.clear();
+		m_out_pos = 0;
+		m_next.clear();
+		m_in.clear();
+		m_connect_start = 0;
+	}
+
+	// wait for the connect in progress, up to time_out [msec].
+	// 1: connected, 0: not yet, -1: failed.
+	int finish_connect(int time_out)
+	{
+		struct pollfd pfd = { m_sock, POLLOUT, 0 };
+		int n = ::poll(&pfd, 1, time_out);
+		if (n == 0) return 0;
+		int err = 0;
+		socklen_t errlen = sizeof err;
+		if (n < 0 || getsockopt(m_sock, SOL_SOCKET, SO_ERROR, &err, &errlen) != 0 || err != 0) {
+			LogError("ERROR!! connect %s:%s: %s\n", m_name.c_str(), m_service.c_str(), strerror(err ? err : errno));
+			return -1;
+		}
+		m_connect_start = 0;
+		m_connected = true;
+
+		return 1;
+	}
+
+	// write m_out, then m_next. false on error (connection closed).
+	bool flush_out()
+	{
+		while (true) {
+			if (m_out_pos >= m_out.size()) {
+				if (m_next.empty()) return true;
+				m_out.swap(m_next);
+				m_next.clear();
+				m_out_pos = 0;
+			}
+
+			TRACE_SCOPE("socket.send");
+			auto stat = ::send(m_sock, m_out.data() + m_out_pos, m_out.size() - m_out_pos, MSG_NOSIGNAL);
+			if (stat < 0) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK) return true;	// backpressured.
+				return false;
+			}
+			m_out_pos += stat;
+			VirtualGamepadMetrics::inc(m_metrics.bytes_out, stat);
+			if (m_out_pos >= m_out.size()) VirtualGamepadMetrics::inc(m_metrics.packets_out);
+		}
+	}
+
+	// arrival time stamp by kernel, of the last segment read. (no SO_TIMESTAMP on stream socket)
+	static void set_timestamping(int sock)
+	{
+#if defined(SO_TIMESTAMPING)
+		int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+		setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, (const char*)&flags, sizeof flags);
+#endif
+	}
+
+	// read everything available into m_in. false if the connection is closed.
+	// t_arrive : arrival time of the last data read [usec], unchanged if not supported.
+	bool read_in(int64_t &t_arrive)
+	{
+		char buf[4096];
+		while (true) {
+			char ctrl[256];
+			struct iovec iov = { buf, sizeof buf };
+			struct msghdr msg = {};
+			msg.msg_iov = &iov;
+			msg.msg_iovlen = 1;
+			msg.msg_control = ctrl;
+			msg.msg_controllen = sizeof ctrl;
+			auto stat = recvmsg(m_sock, &msg, 0);
+			if (stat == 0) return false;
+			if (stat < 0) return (errno == EAGAIN || errno == EWOULDBLOCK);
+			m_in.insert(m_in.end(), buf, buf + stat);
+			m_ts_in = get_time_us();
+			VirtualGamepadMetrics::inc(m_metrics.bytes_in, stat);
+			set_quickack(m_sock);
+
+#if defined(SO_TIMESTAMPING)
+			for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+				if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+					struct timespec ts[3];
+					memcpy(ts, CMSG_DATA(cmsg), sizeof ts);
+					if (ts[0].tv_sec) t_arrive = int64_t(ts[0].tv_sec) * 1'000'000 + ts[0].tv_nsec / 1000;
+				}
 			}
+#endif
 		}
+	}
+
+	// take complete frames from m_in. false on broken framing.
+	template<typename F>
+	bool take_frames(F &&func)
+	{
+		size_t pos = 0;
+		while (m_in.size() - pos >= 4) {
+			auto p = (const uint8_t *)m_in.data() + pos;
+			uint32_t len = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+			if (len == 0 || len > MAX_FRAME) return false;
+			if (m_in.size() - pos - 4 < len) break;
+			func(std::vector<char>(m_in.begin() + pos + 4, m_in.begin() + pos + 4 + len));
+			pos += 4 + len;
+		}
+		m_in.erase(m_in.begin(), m_in.begin() + pos);
+		return true;
+	}
+
+	// queued behind the rest of a partly written one, a frame is never cut in the stream.
+	bool send_control(const std::vector<char> &pkt) override
+	{
+		if (m_sock < 0) return false;
+
+		if (m_out_pos >= m_out.size()) {
+			m_out.clear();
+			m_out_pos = 0;
+		}
+		if (m_out.size() - m_out_pos > MAX_FRAME) return false;	// the peer doesn't read.
+
+		std::vector<char> frame;
+		put_frame(pkt, frame);
+		m_out.insert(m_out.end(), frame.begin(), frame.end());
+		if (!flush_out()) {
+			LogError("ERROR!! send TCP control frame: %s\n", strerror(errno));
+			return false;
+		}
+
+		return true;
+	}
+
+public:
+	static std::unique_ptr<VirtualGamepadTCP> Create(const std::string &name, const std::string &service, em_Mode mode)
+	{
+		auto vgmpad = std::make_unique<VirtualGamepadTCP>();
+		auto ret = vgmpad->open(name, service, mode);
+
+		LogInfo("======== Virtual Gamepad ========\n");
+
+		if (!ret) {
+			LogError("virtual gamepad -- can't opened\n");
+		} else {
+			std::string mode_str;
+			if (mode == em_Mode::RECEIVE) {
+				mode_str = "Receive";
+			} else if (mode == em_Mode::SEND) {
+				mode_str = "Send";
+			} else {
+				mode_str = "None";
+			}
+			LogSuccess("virtual gamepad -- opened(%s) %s:%s\n", mode_str.c_str(), name.c_str(), service.c_str());
+		}
+
+		return vgmpad;
+	}
+
+	// Is Gamepad Attached.
+	bool IsAttached() const override { return (m_sock >= 0 || m_listen >= 0); }
+
+	bool Poll( uint32_t timeout=0 ) override
+	{
+		return receive(timeout);
+	}
+
+	VirtualGamepadTCP() {}
+
+	virtual ~VirtualGamepadTCP()
+	{
+		close();
+	}
+
+	bool open(const std::string &name, const std::string &service, em_Mode mode) override
+	{
+		m_mode = mode;
+		m_name = name;
+		m_service = service;
+
+		if (m_ai) {
+			freeaddrinfo(m_ai);
+			m_ai = nullptr;
+		}
+		addrinfo fo = {
+			AI_PASSIVE,
+			AF_UNSPEC,
+			SOCK_STREAM, IPPROTO_TCP,
+			0, 0,
+			NULL, NULL
+		};
+		const char *n = (name.empty() || name == "") ? nullptr : name.c_str();
+		const char *s = (service.empty() || service == "") ? nullptr : service.c_str();
+		int erc = getaddrinfo(n, s, &fo, &m_ai);
+		if (erc != 0)
+		{
+			LogError("ERROR!! getaddrinfo(errno=%d): name=%s, service=%s.\n", erc, name.c_str(), service.c_str());
+			return false;
+		}
+
+		if (mode == em_Mode::SEND) {
+			m_sock = socket(m_ai->ai_family, m_ai->ai_socktype, 0);
+			if (m_sock < 0) {
+				LogError("ERROR!! create socket\n");
+				return false;
+			}
+			set_nodelay(m_sock);
+			set_timestamping(m_sock);
+			setsockopt(m_sock, SOL_SOCKET, SO_SNDBUF, (const char*)&SNDBUF, sizeof SNDBUF);
+
+			// connect with time out.
+			int yes = 1;
+			ioctl(m_sock, FIONBIO, (const char *)&yes);
+			if (::connect(m_sock, m_ai->ai_addr, m_ai->ai_addrlen) != 0 && errno != EINPROGRESS) {
+				LogError("ERROR!! connect %s:%s: %s\n", name.c_str(), service.c_str(), strerror(errno));
+				close_connection();
+				return false;
+			}
+			m_connect_start = get_time_us();
+			if (!m_reconnect_wait) {
+				// don't block the caller (vgmpad_loadgen), finished in poll().
+				LogInfo("SUCCESS!! open virtual gamepad(SEND), connecting.\n");
+				return true;
+			}
+			auto ret = finish_connect(CONNECT_TIMEOUT);
+			if (ret != 1) {
+				if (ret == 0) LogError("ERROR!! connect %s:%s: time out\n", name.c_str(), service.c_str());
+				close_connection();
+				return false;
+			}
+
+			LogInfo("SUCCESS!! open virtual gamepad(SEND).\n");
+
+		} else if (mode == em_Mode::RECEIVE) {
+			m_listen = socket(m_ai->ai_family, m_ai->ai_socktype, 0);
+			if (m_listen < 0) {
+				LogError("ERROR!! create socket\n");
+				return false;
+			}
+			int yes = 1;
+			setsockopt(m_listen, SOL_SOCKET, SO_REUSEADDR, (const char*)&yes, sizeof yes);
+			if (::bind(m_listen, m_ai->ai_addr, m_ai->ai_addrlen) != 0 || ::listen(m_listen, 1) != 0) {
+				LogError("ERROR!! bind / listen: %s\n", strerror(errno));
+				::close(m_listen);
+				m_listen = -1;
+				return false;
+			}
+			ioctl(m_listen, FIONBIO, (const char *)&yes);
+
+			LogInfo("SUCCESS!! open virtual gamepad(RECEIVE).\n");
+		}
+
+		return true;
+	}
+
+	bool close() override
+	{
+		bool ret = (m_sock >= 0 || m_listen >= 0);
+
+		close_connection();
+		if (m_listen >= 0) ::close(m_listen);
+		m_listen = -1;
+		m_connected = false;
+
+		if (m_ai) {
+			freeaddrinfo(m_ai);
+			m_ai = nullptr;
+		}
+
+		return ret;
+	}
+
+	bool poll(int64_t time_out = 33) override
+	{
+		if (m_mode == em_Mode::SEND) {
+			if (m_sock < 0) {
+				TRACE_SCOPE("open");
+				VirtualGamepadMetrics::inc(m_metrics.reconnects);
+				if (!open(m_name, m_service, m_mode)) {
+					if (m_reconnect_wait) {
+						TRACE_SCOPE("reconnect_wait");
+						std::this_thread::sleep_for(std::chrono::milliseconds(WAIT_FOR_RECONNECT));
+					}
+					return false;
+				}
+			}
+			if (m_connect_start) {
+				auto ret = finish_connect(0);
+				if (ret == 0 && get_time_us() - m_connect_start < CONNECT_TIMEOUT * 1000) return false;
+				if (ret != 1) {
+					if (ret == 0) LogError("ERROR!! connect %s:%s: time out\n", m_name.c_str(), m_service.c_str());
+					VirtualGamepadMetrics::inc(m_metrics.send_errors);
+					close_connection();	// to reconnect.
+					return false;
+				}
+				LogInfo("TCP connected.\n");
+			}
+
+			// latest wins. the replaced frame's input events go with the new one.
+			if (!m_next.empty()) {
+				VirtualGamepadMetrics::inc(m_metrics.coalesced);
+				carry_flags(m_next_flags, m_js);
+				m_js["frame"]["skip"] = m_next_skip + 1;
+			}
+			std::vector<char> pkt;
+			if (!encode_packet(m_js, pkt, MAX_FRAME)) {
+				LogError("ERROR!! pkt size is not enough.\n");
+				return false;
+			}
+			put_frame(pkt, m_next);
+			m_next_flags = { { "axis_motion", m_js.value("axis_motion", false) },
+				{ "button_down", m_js.value("button_down", false) }, { "button_up", m_js.value("button_up", false) } };
+			m_next_skip = m_js["frame"].value("skip", uint32_t(0));
+
+			if (!flush_out()) {
+				LogError("ERROR!! send TCP frame: %s\n", strerror(errno));
+				VirtualGamepadMetrics::inc(m_metrics.send_errors);
+				close_connection();	// to reconnect.
+				return false;
+			}
+
+			// control packets from receiver (ping).
+			TRACE_SCOPE("socket.recv_control");
+			int64_t t_arrive = 0;
+			bool alive = read_in(t_arrive);
+			if (!t_arrive) t_arrive = get_time_us();
+			if (!take_frames([&](const std::vector<char> &p) { on_control(p, t_arrive); }) || !alive) {
+				LogError("ERROR!! TCP connection closed.\n");
+				close_connection();
+				return false;
+			}
+
+			return true;
+		}
+
+		// RECEIVE mode.
+		if (m_listen < 0) {
+			TRACE_SCOPE("open");
+			VirtualGamepadMetrics::inc(m_metrics.reconnects);
+			if (!open(m_name, m_service, m_mode)) return false;
+		}
+
+		// wait for a connection, or data.
+		{
+			TRACE_SCOPE("socket.recv");
+			struct pollfd pfd = { (m_sock >= 0) ? m_sock : m_listen, POLLIN, 0 };
+			::poll(&pfd, 1, int(time_out));
+
+			// a new sender replaces the current one only if it has closed or gone
+			// silent, a stray connection (port scan) doesn't cut the session off.
+			int sock = ::accept(m_listen, nullptr, nullptr);
+			if (sock >= 0 && m_sock >= 0 && get_time_us() - m_ts_in < TAKEOVER_IDLE) {
+				LogVerbose("TCP connection refused, a sender is connected.\n");
+				::close(sock);
+				sock = -1;
+			}
+			if (sock >= 0) {
+				close_connection();
+				m_ts_in = get_time_us();
+				m_sock = sock;
+				int yes = 1;
+				ioctl(m_sock, FIONBIO, (const char *)&yes);
+				set_nodelay(m_sock);
+				set_timestamping(m_sock);
+				LogInfo("TCP connection accepted.\n");
+			}
+		}
+
+		if (m_sock < 0) {
+			VirtualGamepadMetrics::inc(m_metrics.empty_polls);
+			clear_axis_button_status();
+			return false;
+		}
+
+		// the rest of control frames.
+		if (m_out_pos < m_out.size() && !flush_out()) {
+			LogInfo("TCP connection closed.\n");
+			close_connection();
+			return false;
+		}
+
+		int64_t t_arrive = 0;
+		bool alive = read_in(t_arrive);
+		// every frame is decoded, older ones only for their input events.
+		njson latest;
+		uint32_t coalesced = 0;
+		bool framing = take_frames([&](std::vector<char> &&p) {
+			VirtualGamepadMetrics::inc(m_metrics.packets_in);
+			njson js;
+			if (!decode_packet(p, js)) {
+				VirtualGamepadMetrics::inc(m_metrics.parse_errors);
+				return;
+			}
+			if (!latest.empty()) {
+				carry_flags(latest, js);
+				VirtualGamepadMetrics::inc(m_metrics.coalesced);
+				coalesced++;
+			}
+			// replaced by the sender.
+			auto itr = js.find("frame");
+			if (itr != js.end() && itr->is_object()) coalesced += itr->value("skip", uint32_t(0));
+			latest = std::move(js);
+		});
+		if (!framing) {
+			LogError("ERROR!! TCP framing.\n");
+			alive = false;
+		}
+		if (!alive) {
+			LogInfo("TCP connection closed.\n");
+			close_connection();
+		}
+
+		if (latest.empty()) {
+			VirtualGamepadMetrics::inc(m_metrics.empty_polls);
+			clear_axis_button_status();
+			return false;
+		}
+
+		m_ts_arrive = t_arrive;
+		m_ts_sock = get_time_us();
+		m_js = std::move(latest);
+		m_coalesced = coalesced;
 
 		return true;
 	}
 };
+#endif	// !_WIN32
 
 std::ostream &operator<<(std::ostream &ostr, const VirtualGamepad &vg)
 {
@@ -1031,3 +2657,5 @@ std::ostream &operator<<(std::ostream &ostr, const VirtualGamepad &vg)
 
 	return ostr;
 }
+
+#endif
@@ -0,0 +1,401 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#ifndef __VIRTUAL_GAMEPAD_METRICS_H__
+#define __VIRTUAL_GAMEPAD_METRICS_H__
+
+#include <cstdio>
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// lock-free latency histogram, log-linear buckets (HDR histogram style).
+// 16 sub buckets per power of two, about 6% resolution from 1 [usec] to 2^41 [usec].
+class LatencyHistogram
+{
+public:
+	static constexpr int SUB_BITS = 4;
+	static constexpr int SUB_COUNT = 1 << SUB_BITS;
+	static constexpr int MAX_MSB = 40;
+	static constexpr int NUM_BUCKETS = SUB_COUNT + (MAX_MSB - SUB_BITS + 1) * SUB_COUNT;
+
+	struct Snapshot {
+		std::vector<uint64_t> counts;
+		uint64_t count = 0;
+		int64_t sum = 0;
+		int64_t max = 0;
+
+		// value at p (0.0 - 1.0).
+		int64_t percentile(double p) const
+		{
+			if (count == 0) return 0;
+			uint64_t rank = std::max<uint64_t>(1, uint64_t(p * count + 0.5));
+			uint64_t acc = 0;
+			for (int i = 0; i < int(counts.size()); i++) {
+				acc += counts[i];
+				if (acc >= rank) return std::min(max, bucket_upper(i));
+			}
+			return max;
+		}
+
+		// number of values <= le.
+		uint64_t count_le(int64_t le) const
+		{
+			uint64_t acc = 0;
+			for (int i = 0; i < int(counts.size()) && bucket_upper(i) <= le; i++) acc += counts[i];
+			return acc;
+		}
+
+		double mean() const { return count ? double(sum) / count : 0.0; }
+	};
+
+	static int bucket_index(int64_t v)
+	{
+		if (v < SUB_COUNT) return (v < 0) ? 0 : int(v);
+
+		int msb = 63 - __builtin_clzll(uint64_t(v));
+		if (msb > MAX_MSB) return NUM_BUCKETS - 1;
+
+		int sub = int((v >> (msb - SUB_BITS)) & (SUB_COUNT - 1));
+		return SUB_COUNT + (msb - SUB_BITS) * SUB_COUNT + sub;
+	}
+
+	static int64_t bucket_lower(int idx)
+	{
+		if (idx < SUB_COUNT) return idx;
+
+		int msb = (idx - SUB_COUNT) / SUB_COUNT + SUB_BITS;
+		int sub = idx % SUB_COUNT;
+		return int64_t(SUB_COUNT + sub) << (msb - SUB_BITS);
+	}
+
+	static int64_t bucket_upper(int idx)
+	{
+		if (idx < SUB_COUNT) return idx;
+
+		int msb = (idx - SUB_COUNT) / SUB_COUNT + SUB_BITS;
+		return bucket_lower(idx) + (int64_t(1) << (msb - SUB_BITS)) - 1;
+	}
+
+	void record(int64_t v)
+	{
+		if (v < 0) v = 0;
+		m_counts[bucket_index(v)].fetch_add(1, std::memory_order_relaxed);
+		m_sum.fetch_add(v, std::memory_order_relaxed);
+
+		auto cur = m_max.load(std::memory_order_relaxed);
+		while (v > cur && !m_max.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {}
+	}
+
+	Snapshot snapshot() const
+	{
+		Snapshot s;
+		s.counts.resize(NUM_BUCKETS);
+		for (int i = 0; i < NUM_BUCKETS; i++) s.counts[i] = m_counts[i].load(std::memory_order_relaxed);
+		s.count = 0;
+		for (auto &c : s.counts) s.count += c;
+		s.sum = m_sum.load(std::memory_order_relaxed);
+		s.max = m_max.load(std::memory_order_relaxed);
+
+		return s;
+	}
+
+private:
+	std::atomic<uint64_t> m_counts[NUM_BUCKETS] = {};
+	std::atomic<int64_t> m_sum{0};
+	std::atomic<int64_t> m_max{0};
+};
+
+// counters and histograms of one VirtualGamepad session.
+// updated by the send/receive loop, read from any thread.
+struct VirtualGamepadMetrics
+{
+	std::atomic<uint64_t> packets_in{0};
+	std::atomic<uint64_t> bytes_in{0};
+	std::atomic<uint64_t> packets_out{0};
+	std::atomic<uint64_t> bytes_out{0};
+	std::atomic<uint64_t> parse_errors{0};
+	std::atomic<uint64_t> send_errors{0};
+	std::atomic<uint64_t> drops{0};		// gap of sequence number.
+	std::atomic<uint64_t> drops_rebuilt{0};	// of drops, rebuilt later from parity (FEC). lost = drops - drops_rebuilt.
+	std::atomic<uint64_t> coalesced{0};	// replaced by a newer frame (TCP), sender : before sent, receiver : read at once.
+	std::atomic<uint64_t> duplicates{0};	// copy of a received frame, over another path (UDP).
+	std::atomic<uint64_t> late{0};		// older than a received frame, reordered (UDP).
+	std::atomic<uint64_t> fec_recovered{0};	// lost frame rebuilt from parity (UDP).
+	std::atomic<uint64_t> hist_recovered{0};	// lost frame's state carried in the next frame.
+	std::atomic<uint64_t> event_retransmits{0};	// button events sent again, not acked in time (UDP).
+	std::atomic<uint64_t> events_lost{0};	// button events given up on by the sender (UDP).
+	std::atomic<uint64_t> reconnects{0};
+	std::atomic<uint64_t> empty_polls{0};
+
+	LatencyHistogram latency;	// one-way latency, sender time stamp to receive [usec].
+
+	// per-stage latency of a frame [usec]. allocated on first use (receiver only),
+	// a sender-only process (e.g. vgmpad_loadgen with many pads) does not pay for it.
+	struct StageHistograms {
+		LatencyHistogram input;		// SDL event -> update().
+		LatencyHistogram queue;		// update() -> encode start.
+		LatencyHistogram encode;	// encode start -> send.
+		LatencyHistogram wire;		// send -> arrival (or receive, if no kernel time stamp).
+		LatencyHistogram socket;	// arrival -> receive, waiting for receive loop.
+		LatencyHistogram decode;	// receive -> decoded.
+		LatencyHistogram output;	// decoded -> output by application.
+		LatencyHistogram total;		// first stamp -> last stamp.
+	};
+
+	VirtualGamepadMetrics() {}
+	VirtualGamepadMetrics(const VirtualGamepadMetrics &) = delete;
+	VirtualGamepadMetrics &operator=(const VirtualGamepadMetrics &) = delete;
+	~VirtualGamepadMetrics() { delete m_stages.load(); }
+
+	StageHistograms &stages()
+	{
+		auto p = m_stages.load(std::memory_order_acquire);
+		if (!p) {
+			auto n = new StageHistograms;
+			if (m_stages.compare_exchange_strong(p, n, std::memory_order_acq_rel)) {
+				p = n;
+			} else {
+				delete n;
+			}
+		}
+		return *p;
+	}
+
+	struct Snapshot {
+		std::map<std::string, uint64_t> counters;
+		std::map<std::string, double> gauges;
+		std::map<std::string, LatencyHistogram::Snapshot> histograms;
+	};
+
+	static void inc(std::atomic<uint64_t> &c, uint64_t n = 1) { c.fetch_add(n, std::memory_order_relaxed); }
+
+	Snapshot snapshot() const
+	{
+		auto get = [](const std::atomic<uint64_t> &c) { return c.load(std::memory_order_relaxed); };
+
+		Snapshot s;
+		s.counters["packets_in"] = get(packets_in);
+		s.counters["bytes_in"] = get(bytes_in);
+		s.counters["packets_out"] = get(packets_out);
+		s.counters["bytes_out"] = get(bytes_out);
+		s.counters["parse_errors"] = get(parse_errors);
+		s.counters["send_errors"] = get(send_errors);
+		s.counters["drops"] = get(drops);
+		s.counters["drops_rebuilt"] = get(drops_rebuilt);
+		s.gauges["lost_frames"] = double(get(drops) - get(drops_rebuilt));
+		s.counters["coalesced"] = get(coalesced);
+		s.counters["duplicates"] = get(duplicates);
+		s.counters["late"] = get(late);
+		s.counters["fec_recovered"] = get(fec_recovered);
+		s.counters["hist_recovered"] = get(hist_recovered);
+		s.counters["event_retransmits"] = get(event_retransmits);
+		s.counters["events_lost"] = get(events_lost);
+		s.counters["reconnects"] = get(reconnects);
+		s.counters["empty_polls"] = get(empty_polls);
+		s.histograms["latency_us"] = latency.snapshot();
+		if (auto p = m_stages.load(std::memory_order_acquire)) {
+			s.histograms["stage_input_us"] = p->input.snapshot();
+			s.histograms["stage_queue_us"] = p->queue.snapshot();
+			s.histograms["stage_encode_us"] = p->encode.snapshot();
+			s.histograms["stage_wire_us"] = p->wire.snapshot();
+			s.histograms["stage_socket_us"] = p->socket.snapshot();
+			s.histograms["stage_decode_us"] = p->decode.snapshot();
+			s.histograms["stage_output_us"] = p->output.snapshot();
+			s.histograms["stage_total_us"] = p->total.snapshot();
+		}
+
+		return s;
+	}
+
+	// Prometheus text exposition format.
+	static std::string to_prometheus(const Snapshot &s, const std::string &labels = "")
+	{
+		static const int64_t le_list[] = {
+			100, 250, 500, 1'000, 2'500, 5'000, 10'000, 25'000, 50'000,
+			100'000, 250'000, 500'000, 1'000'000, 2'500'000, 5'000'000,
+		};
+		auto lb = [&](const std::string &extra) -> std::string {
+			std::string l = labels;
+			if (!extra.empty()) l += (l.empty() ? "" : ",") + extra;
+			return l.empty() ? "" : "{" + l + "}";
+		};
+
+		std::stringstream ss;
+		for (auto &[name, val] : s.counters) {
+			ss << "# TYPE vgmpad_" << name << "_total counter\n";
+			ss << "vgmpad_" << name << "_total" << lb("") << " " << val << "\n";
+		}
+		for (auto &[name, val] : s.gauges) {
+			ss << "# TYPE vgmpad_" << name << " gauge\n";
+			ss << "vgmpad_" << name << lb("") << " " << val << "\n";
+		}
+		for (auto &[name, h] : s.histograms) {
+			ss << "# TYPE vgmpad_" << name << " histogram\n";
+			for (auto le : le_list) {
+				ss << "vgmpad_" << name << "_bucket" << lb("le=\"" + std::to_string(le) + "\"") << " " << h.count_le(le) << "\n";
+			}
+			ss << "vgmpad_" << name << "_bucket" << lb("le=\"+Inf\"") << " " << h.count << "\n";
+			ss << "vgmpad_" << name << "_sum" << lb("") << " " << h.sum << "\n";
+			ss << "vgmpad_" << name << "_count" << lb("") << " " << h.count << "\n";
+		}
+
+		return ss.str();
+	}
+
+private:
+	std::atomic<StageHistograms *> m_stages{nullptr};
+};
+
+// export metrics text periodically to a file, and/or serve it at http://127.0.0.1:port/ .
+class MetricsExporter
+{
+public:
+	using Source = std::function<std::string()>;
+
+	MetricsExporter() {}
+	virtual ~MetricsExporter() { stop(); }
+
+	bool start(Source source, const std::string &file_path, int http_port, int interval_ms = 1000)
+	{
+		m_source = source;
+		m_file_path = file_path;
+		m_interval = std::chrono::milliseconds(interval_ms);
+
+		if (http_port > 0) {
+			m_sock = socket(AF_INET, SOCK_STREAM, 0);
+			if (m_sock < 0) return false;
+
+			int yes = 1;
+			setsockopt(m_sock, SOL_SOCKET, SO_REUSEADDR, (const char*)&yes, sizeof yes);
+			sockaddr_in addr = {};
+			addr.sin_family = AF_INET;
+			addr.sin_port = htons(uint16_t(http_port));
+			addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			if (::bind(m_sock, (sockaddr *)&addr, sizeof addr) != 0 || ::listen(m_sock, 4) != 0) {
+				::close(m_sock);
+				m_sock = -1;
+				return false;
+			}
+		}
+
+		m_running = true;
+		m_thread = std::thread([this]() { run(); });
+
+		return true;
+	}
+
+	void stop()
+	{
+		if (!m_running) return;
+
+		m_running = false;
+		if (m_thread.joinable()) m_thread.join();
+		if (m_sock >= 0) ::close(m_sock);
+		m_sock = -1;
+		write_file();
+	}
+
+private:
+	void write_file()
+	{
+		if (m_file_path.empty() || !m_source) return;
+
+		// write and rename, readers never see partial file.
+		auto tmp = m_file_path + ".tmp";
+		if (auto fp = fopen(tmp.c_str(), "w")) {
+			auto text = m_source();
+			fwrite(text.data(), 1, text.size(), fp);
+			fclose(fp);
+			rename(tmp.c_str(), m_file_path.c_str());
+		}
+	}
+
+	void serve()
+	{
+		int fd = accept(m_sock, nullptr, nullptr);
+		if (fd < 0) return;
+
+		// read request header (ignored), any path returns metrics.
+		char buf[1024];
+		pollfd pfd = { fd, POLLIN, 0 };
+		if (::poll(&pfd, 1, 100) > 0) {
+			auto r = recv(fd, buf, sizeof buf, 0);
+			(void)r;
+		}
+
+		auto body = m_source();
+		std::string res = "HTTP/1.0 200 OK\r\n"
+			"Content-Type: text/plain; version=0.0.4\r\n"
+			"Content-Length: " + std::to_string(body.size()) + "\r\n"
+			"Connection: close\r\n\r\n" + body;
+		size_t off = 0;
+		while (off < res.size()) {
+			auto n = ::send(fd, res.data() + off, res.size() - off, MSG_NOSIGNAL);
+			if (n <= 0) break;
+			off += n;
+		}
+		::close(fd);
+	}
+
+	void run()
+	{
+		auto t_next = std::chrono::steady_clock::now();
+		while (m_running) {
+			auto now = std::chrono::steady_clock::now();
+			if (now >= t_next) {
+				write_file();
+				t_next = now + m_interval;
+			}
+
+			if (m_sock >= 0) {
+				pollfd pfd = { m_sock, POLLIN, 0 };
+				if (::poll(&pfd, 1, 100) > 0) serve();
+			} else {
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			}
+		}
+	}
+
+	Source m_source;
+	std::string m_file_path;
+	std::chrono::milliseconds m_interval{1000};
+	int m_sock = -1;
+	std::atomic<bool> m_running{false};
+	std::thread m_thread;
+};
+
+#endif
@@ -21,6 +21,8 @@
  */
 
 #include "devGamepad.h"
+
+#include <chrono>
 // #include "devInput.h"
 
 // #include "logging.h"
@@ -87,6 +89,17 @@ std::unique_ptr<GamepadDevice> GamepadDevice::Create( const char* name )
 }
 
 
+// event_wall_time
+int64_t GamepadDevice::event_wall_time() const
+{
+	// event.common.timestamp is SDL_GetTicks() [msec] when the event was queued,
+	// convert its age to wall clock.
+	uint32_t age = SDL_GetTicks() - event.common.timestamp;
+	auto now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	return now - int64_t(age) * 1000;
+}
+
+
 // Poll
 bool GamepadDevice::Poll( uint32_t timeout )
 {
@@ -94,16 +107,21 @@ bool GamepadDevice::Poll( uint32_t timeout )
 	button_down = false;
 	button_up   = false;
 
+	// several events may be merged into one poll, keep the first (oldest).
+	int64_t oldest = 0;
 	while (SDL_PollEvent(&event)) {
 		switch (event.type) {
 		case SDL_CONTROLLERAXISMOTION:
 			axis_motion = true;
+			if (!oldest) oldest = event_wall_time();
 			break;
 		case SDL_CONTROLLERBUTTONDOWN:
 			button_down = true;
+			if (!oldest) oldest = event_wall_time();
 			break;
 		case SDL_CONTROLLERBUTTONUP:
 			button_up = true;
+			if (!oldest) oldest = event_wall_time();
 			break;
 		case SDL_CONTROLLERDEVICEADDED:
 			LogInfo("*** Gamepad Attached ***\n");
@@ -118,6 +136,7 @@ bool GamepadDevice::Poll( uint32_t timeout )
 		}
 		// LogInfo("[GamePad]: Event: %d\n", event.type);
     }
+	if (oldest) event_time = oldest;
 
 	return true;	
 }
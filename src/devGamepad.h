@@ -30,17 +30,14 @@
 #include <vector>
 #include <string>
 
-#define LogInfo printf
-#define LogError printf
-#define LogSuccess printf
-#define LogVerbose printf
-#define LogDebug printf
+#include "devGamepadSource.h"
+#include "Logger.h"
 
 /**
  * Gamepad device
  * @ingroup input
  */
-class GamepadDevice
+class GamepadDevice : public GamepadSource
 {
 public:
 	/**
@@ -59,60 +56,65 @@ public:
 	/**
 	 * Poll the device for updates
 	 */
-	bool Poll( uint32_t timeout=0 );
+	bool Poll( uint32_t timeout=0 ) override;
 
 	// Open 1st device.
 	void Open1stDevice();
 
 	// Is Gamepad Attached.
-	bool IsAttached() const { return SDL_GameControllerGetAttached(Gamepad); }
+	bool IsAttached() const override { return SDL_GameControllerGetAttached(Gamepad); }
 
 	// Get Axis.
 	int16_t GetAxis(SDL_GameControllerAxis axis) const {
 		return SDL_GameControllerGetAxis(Gamepad, axis);
 	}
-	int16_t GetAxis_Left_X() const { return GetAxis(SDL_CONTROLLER_AXIS_LEFTX); }
-	int16_t GetAxis_Left_Y() const { return GetAxis(SDL_CONTROLLER_AXIS_LEFTY); }
-	int16_t GetAxis_Right_X() const { return GetAxis(SDL_CONTROLLER_AXIS_RIGHTX); }
-	int16_t GetAxis_Right_Y() const { return GetAxis(SDL_CONTROLLER_AXIS_RIGHTY); }
-	int16_t GetAxis_Trigger_L() const { return GetAxis(SDL_CONTROLLER_AXIS_TRIGGERLEFT); }
-	int16_t GetAxis_Trigger_R() const { return GetAxis(SDL_CONTROLLER_AXIS_TRIGGERRIGHT); }
+	int16_t GetAxis_Left_X() const override { return GetAxis(SDL_CONTROLLER_AXIS_LEFTX); }
+	int16_t GetAxis_Left_Y() const override { return GetAxis(SDL_CONTROLLER_AXIS_LEFTY); }
+	int16_t GetAxis_Right_X() const override { return GetAxis(SDL_CONTROLLER_AXIS_RIGHTX); }
+	int16_t GetAxis_Right_Y() const override { return GetAxis(SDL_CONTROLLER_AXIS_RIGHTY); }
+	int16_t GetAxis_Trigger_L() const override { return GetAxis(SDL_CONTROLLER_AXIS_TRIGGERLEFT); }
+	int16_t GetAxis_Trigger_R() const override { return GetAxis(SDL_CONTROLLER_AXIS_TRIGGERRIGHT); }
 
 	// Is Axis Motion.
-	bool IsAxisMotion() const { return axis_motion; }
+	bool IsAxisMotion() const override { return axis_motion; }
 
 	// Get Button.
 	uint8_t GetButton(SDL_GameControllerButton button) const {
 		return SDL_GameControllerGetButton(Gamepad, button);
 	}
-	uint8_t GetButton_A() const { return GetButton(SDL_CONTROLLER_BUTTON_A); }
-	uint8_t GetButton_B() const { return GetButton(SDL_CONTROLLER_BUTTON_B); }
-	uint8_t GetButton_X() const { return GetButton(SDL_CONTROLLER_BUTTON_X); }
-	uint8_t GetButton_Y() const { return GetButton(SDL_CONTROLLER_BUTTON_Y); }
-	uint8_t GetButton_Back() const { return GetButton(SDL_CONTROLLER_BUTTON_BACK); }
-	uint8_t GetButton_Guide() const { return GetButton(SDL_CONTROLLER_BUTTON_GUIDE); }
-	uint8_t GetButton_Start() const { return GetButton(SDL_CONTROLLER_BUTTON_START); }
-	uint8_t GetButton_Stick_L() const { return GetButton(SDL_CONTROLLER_BUTTON_LEFTSTICK); }
-	uint8_t GetButton_Stick_R() const { return GetButton(SDL_CONTROLLER_BUTTON_RIGHTSTICK); }
-	uint8_t GetButton_Shoulder_L() const { return GetButton(SDL_CONTROLLER_BUTTON_LEFTSHOULDER); }
-	uint8_t GetButton_Shoulder_R() const { return GetButton(SDL_CONTROLLER_BUTTON_RIGHTSHOULDER); }
-	uint8_t GetButton_Dpad_U() const { return GetButton(SDL_CONTROLLER_BUTTON_DPAD_UP); }
-	uint8_t GetButton_Dpad_D() const { return GetButton(SDL_CONTROLLER_BUTTON_DPAD_DOWN); }
-	uint8_t GetButton_Dpad_L() const { return GetButton(SDL_CONTROLLER_BUTTON_DPAD_LEFT); }
-	uint8_t GetButton_Dpad_R() const { return GetButton(SDL_CONTROLLER_BUTTON_DPAD_RIGHT); }
+	uint8_t GetButton_A() const override { return GetButton(SDL_CONTROLLER_BUTTON_A); }
+	uint8_t GetButton_B() const override { return GetButton(SDL_CONTROLLER_BUTTON_B); }
+	uint8_t GetButton_X() const override { return GetButton(SDL_CONTROLLER_BUTTON_X); }
+	uint8_t GetButton_Y() const override { return GetButton(SDL_CONTROLLER_BUTTON_Y); }
+	uint8_t GetButton_Back() const override { return GetButton(SDL_CONTROLLER_BUTTON_BACK); }
+	uint8_t GetButton_Guide() const override { return GetButton(SDL_CONTROLLER_BUTTON_GUIDE); }
+	uint8_t GetButton_Start() const override { return GetButton(SDL_CONTROLLER_BUTTON_START); }
+	uint8_t GetButton_Stick_L() const override { return GetButton(SDL_CONTROLLER_BUTTON_LEFTSTICK); }
+	uint8_t GetButton_Stick_R() const override { return GetButton(SDL_CONTROLLER_BUTTON_RIGHTSTICK); }
+	uint8_t GetButton_Shoulder_L() const override { return GetButton(SDL_CONTROLLER_BUTTON_LEFTSHOULDER); }
+	uint8_t GetButton_Shoulder_R() const override { return GetButton(SDL_CONTROLLER_BUTTON_RIGHTSHOULDER); }
+	uint8_t GetButton_Dpad_U() const override { return GetButton(SDL_CONTROLLER_BUTTON_DPAD_UP); }
+	uint8_t GetButton_Dpad_D() const override { return GetButton(SDL_CONTROLLER_BUTTON_DPAD_DOWN); }
+	uint8_t GetButton_Dpad_L() const override { return GetButton(SDL_CONTROLLER_BUTTON_DPAD_LEFT); }
+	uint8_t GetButton_Dpad_R() const override { return GetButton(SDL_CONTROLLER_BUTTON_DPAD_RIGHT); }
 
 	// Is Button Down/Up.
-	bool IsButtonDown() const { return button_down; }
-	bool IsButtonUp() const { return button_up; }
+	bool IsButtonDown() const override { return button_down; }
+	bool IsButtonUp() const override { return button_up; }
 
+	// Time of the latest input event.
+	int64_t GetEventTime() const override { return event_time; }
 
 protected:
+	int64_t event_wall_time() const;
+
 	SDL_GameController *Gamepad;
 
 	SDL_Event event;
 	bool axis_motion;
 	bool button_down;
 	bool button_up;
+	int64_t event_time = 0;	// wall clock [usec].
 };
 
 #endif
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2021, edgecraft. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "devSynthetic.h"
+#include "devGamepad.h"	// Log###.
+
+
+// Create
+std::unique_ptr<SyntheticGamepad> SyntheticGamepad::Create( const char* spec )
+{
+	std::string s(spec ? spec : "");
+	std::string pattern_str = s;
+	double rate = 60.0;
+	uint32_t seed = 1;
+
+	auto pos = s.find(':');
+	if (pos != std::string::npos) {
+		pattern_str = s.substr(0, pos);
+		auto rest = s.substr(pos + 1);
+		auto pos_seed = rest.find(':');
+		try {
+			rate = std::stod(rest.substr(0, pos_seed));
+			if (pos_seed != std::string::npos) seed = std::stoul(rest.substr(pos_seed + 1));
+		} catch (std::exception &e) {
+			LogError("synthetic gamepad -- invalid spec %s\n", s.c_str());
+			return nullptr;
+		}
+	}
+
+	em_Pattern pattern;
+	if (pattern_str == "" || pattern_str == "mixed") pattern = em_Pattern::MIXED;
+	else if (pattern_str == "idle") pattern = em_Pattern::IDLE;
+	else if (pattern_str == "sticks") pattern = em_Pattern::STICKS;
+	else if (pattern_str == "random") pattern = em_Pattern::RANDOM;
+	else if (pattern_str == "storm") pattern = em_Pattern::STORM;
+	else {
+		LogError("synthetic gamepad -- unknown pattern %s\n", pattern_str.c_str());
+		return nullptr;
+	}
+	if (rate <= 0.0) {
+		LogError("synthetic gamepad -- invalid rate %f\n", rate);
+		return nullptr;
+	}
+
+	auto gpad = std::make_unique<SyntheticGamepad>(pattern, rate, seed);
+	LogSuccess("synthetic gamepad -- %s, %.1f events/sec, seed %u\n", pattern_str.c_str(), rate, seed);
+
+	return gpad;
+}
+
+
+// constructor
+SyntheticGamepad::SyntheticGamepad( em_Pattern pattern, double rate, uint32_t seed )
+	: pattern(pattern), rate(rate), rng(seed)
+{
+}
+
+
+// Poll
+bool SyntheticGamepad::Poll( uint32_t )
+{
+	auto now = std::chrono::steady_clock::now();
+	double dt = first_poll ? 0.0 : std::chrono::duration<double>(now - last_poll).count();
+	first_poll = false;
+	last_poll = now;
+
+	Step(dt);
+
+	// events are generated here, stamp them as they happened now.
+	if (axis_motion || button_down || button_up) {
+		event_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+
+	return true;
+}
+
+
+// Step
+void SyntheticGamepad::Step( double dt )
+{
+	axis_motion = false;
+	button_down = false;
+	button_up   = false;
+
+	t += dt;
+	pending += dt * rate;
+
+	// same as SDL, several events may be merged into one poll.
+	while (pending >= 1.0) {
+		pending -= 1.0;
+
+		switch (pattern) {
+		case em_Pattern::STICKS:
+			stick_event();
+			break;
+		case em_Pattern::RANDOM:
+			random_event();
+			break;
+		case em_Pattern::STORM:
+			button_event();
+			break;
+		case em_Pattern::MIXED:
+			random_event();
+			if (std::uniform_int_distribution<int>(0, 9)(rng) == 0) button_event();
+			break;
+		case em_Pattern::IDLE:
+		default:
+			;
+		}
+	}
+}
+
+
+// left stick: circle, right stick: figure eight, triggers: triangle. (period 2 sec)
+void SyntheticGamepad::stick_event()
+{
+	const double w = M_PI * t;
+	const double tri = 1.0 - std::abs(std::fmod(t, 2.0) - 1.0);
+	const int16_t next[NUM_AXIS] = {
+		int16_t(32767 * std::cos(w)),
+		int16_t(32767 * std::sin(w)),
+		int16_t(32767 * std::sin(w)),
+		int16_t(32767 * std::sin(2.0 * w)),
+		int16_t(32767 * tri),
+		int16_t(32767 * (1.0 - tri)),
+	};
+
+	for (int i = 0; i < NUM_AXIS; i++) {
+		if (axis[i] != next[i]) axis_motion = true;
+		axis[i] = next[i];
+	}
+}
+
+
+// random walk, triggers stay positive.
+void SyntheticGamepad::random_event()
+{
+	std::normal_distribution<double> step(0.0, 2048.0);
+
+	for (int i = 0; i < NUM_AXIS; i++) {
+		const int lo = (i < 4) ? -32768 : 0;
+		axis[i] = int16_t(std::clamp(int(axis[i] + step(rng)), lo, 32767));
+	}
+	axis_motion = true;
+}
+
+
+// toggle random button.
+void SyntheticGamepad::button_event()
+{
+	auto n = std::uniform_int_distribution<int>(0, NUM_BUTTON - 1)(rng);
+
+	buttons ^= uint16_t(1 << n);
+	if ((buttons >> n) & 1) button_down = true;
+	else button_up = true;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2021, edgecraft. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __DEV_SYNTHETIC_H__
+#define __DEV_SYNTHETIC_H__
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+
+#include "devGamepadSource.h"
+
+/**
+ * Synthetic gamepad, for load generation without controller.
+ * @ingroup input
+ */
+class SyntheticGamepad : public GamepadSource
+{
+public:
+	enum class em_Pattern : int {
+		IDLE,		// nothing is touched.
+		STICKS,		// scripted sticks (circle, figure eight) and triggers.
+		RANDOM,		// random walk of sticks and triggers.
+		STORM,		// random button presses / releases.
+		MIXED,		// random walk + button storm at 1/10 rate.
+	};
+
+	/**
+	 * Create synthetic gamepad
+	 * spec : pattern[:rate[:seed]]
+	 *   pattern : idle, sticks, random, storm, mixed.
+	 *   rate    : input events per second.
+	 */
+	static std::unique_ptr<SyntheticGamepad> Create( const char* spec="mixed" );
+
+	// constructor
+	SyntheticGamepad( em_Pattern pattern, double rate=60.0, uint32_t seed=1 );
+
+	/**
+	 * Destructor
+	 */
+	virtual ~SyntheticGamepad() {}
+
+	/**
+	 * Poll for updates, advance by elapsed time since last poll
+	 */
+	bool Poll( uint32_t timeout=0 ) override;
+
+	/**
+	 * Advance by dt [sec] (deterministic)
+	 */
+	void Step( double dt );
+
+	em_Pattern GetPattern() const { return pattern; }
+	double GetRate() const { return rate; }
+
+	// Is Gamepad Attached.
+	bool IsAttached() const override { return true; }
+
+	// Get Axis.
+	int16_t GetAxis_Left_X() const override { return axis[0]; }
+	int16_t GetAxis_Left_Y() const override { return axis[1]; }
+	int16_t GetAxis_Right_X() const override { return axis[2]; }
+	int16_t GetAxis_Right_Y() const override { return axis[3]; }
+	int16_t GetAxis_Trigger_L() const override { return axis[4]; }
+	int16_t GetAxis_Trigger_R() const override { return axis[5]; }
+
+	// Is Axis Motion.
+	bool IsAxisMotion() const override { return axis_motion; }
+
+	// Get Button.
+	uint8_t GetButton(int n) const { return (buttons >> n) & 1; }
+	uint8_t GetButton_A() const override { return GetButton(0); }
+	uint8_t GetButton_B() const override { return GetButton(1); }
+	uint8_t GetButton_X() const override { return GetButton(2); }
+	uint8_t GetButton_Y() const override { return GetButton(3); }
+	uint8_t GetButton_Back() const override { return GetButton(4); }
+	uint8_t GetButton_Guide() const override { return GetButton(5); }
+	uint8_t GetButton_Start() const override { return GetButton(6); }
+	uint8_t GetButton_Stick_L() const override { return GetButton(7); }
+	uint8_t GetButton_Stick_R() const override { return GetButton(8); }
+	uint8_t GetButton_Shoulder_L() const override { return GetButton(9); }
+	uint8_t GetButton_Shoulder_R() const override { return GetButton(10); }
+	uint8_t GetButton_Dpad_U() const override { return GetButton(11); }
+	uint8_t GetButton_Dpad_D() const override { return GetButton(12); }
+	uint8_t GetButton_Dpad_L() const override { return GetButton(13); }
+	uint8_t GetButton_Dpad_R() const override { return GetButton(14); }
+
+	// Is Button Down/Up.
+	bool IsButtonDown() const override { return button_down; }
+	bool IsButtonUp() const override { return button_up; }
+
+	// Time of the latest input event.
+	int64_t GetEventTime() const override { return event_time; }
+
+	static constexpr int NUM_AXIS = 6;
+	static constexpr int NUM_BUTTON = 15;
+
+protected:
+	void stick_event();
+	void random_event();
+	void button_event();
+
+	em_Pattern pattern;
+	double rate;	// [events/sec].
+
+	std::mt19937 rng;
+	std::chrono::steady_clock::time_point last_poll;
+	bool first_poll = true;
+	double t = 0.0;		// [sec].
+	double pending = 0.0;	// events not yet generated.
+
+	int16_t axis[NUM_AXIS] = {};
+	uint16_t buttons = 0;
+
+	bool axis_motion = false;
+	bool button_down = false;
+	bool button_up = false;
+	int64_t event_time = 0;	// wall clock [usec], stamped by Poll().
+};
+
+#endif
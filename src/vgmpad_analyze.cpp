@@ -0,0 +1,495 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+// analyze recorded sessions in parallel.
+//   input: binary recording (--record), archive (vgmpad_archive pack), or
+//          captured stdout of vgmpad_send/vgmpad_recv. directories are searched recursively.
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cmath>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#if defined(USE_EXPERIMENTAL_FS)
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+#else
+#include <filesystem>
+namespace fs = std::filesystem;
+#endif
+
+#include "json.hpp"
+#include "Logger.h"
+#include "VirtualGamepadMetrics.h"
+#include "GamepadRecord.h"
+#include "GamepadArchive.h"
+#include "JsonFrames.h"
+
+using njson = nlohmann::json;
+
+struct Config {
+	int num_threads = 1;
+	double fps = 30.0;		// of captured stdout, which has no time stamp.
+	int deadzone = 8000;	// stick / trigger is active beyond this.
+	bool json = false;
+};
+
+// events per second, histogram bins (lower bound).
+static constexpr int RATE_BINS[] = { 0, 1, 5, 10, 20, 50, 100, 200 };
+static constexpr int NUM_RATE_BINS = sizeof(RATE_BINS) / sizeof(RATE_BINS[0]);
+
+// "0", "1-4", ... "200+".
+static std::string rate_label(int bin)
+{
+	auto lo = std::to_string(RATE_BINS[bin]);
+	if (bin == NUM_RATE_BINS - 1) return lo + "+";
+	auto hi = RATE_BINS[bin + 1] - 1;
+	return (hi == RATE_BINS[bin]) ? lo : lo + "-" + std::to_string(hi);
+}
+
+// statistics of one session (file).
+struct Session {
+	std::string path;
+	std::string kind;		// record, archive, stdout.
+	std::string error;
+	uint64_t bytes = 0;
+
+	uint64_t frames = 0;
+	int64_t ts_first = 0;
+	int64_t ts_last = 0;
+
+	// sequence numbers (record, archive).
+	bool has_seq = false;
+	uint32_t seq_first = 0;
+	uint32_t seq_max = 0;
+	uint64_t lost = 0;
+	uint64_t reordered = 0;
+	uint64_t duplicated = 0;
+
+	// ts_recv - ts_send, receiver recordings only.
+	std::unique_ptr<LatencyHistogram> latency = std::make_unique<LatencyHistogram>();
+	// ts difference between consecutive frames.
+	std::unique_ptr<LatencyHistogram> interval = std::make_unique<LatencyHistogram>();
+
+	// input events (axis motion, button down/up) per second.
+	uint64_t rate_hist[NUM_RATE_BINS] = {};
+	uint64_t axis_events = 0;
+	uint64_t button_events = 0;
+	uint64_t presses[GamepadState::NUM_BUTTON] = {};
+
+	// per axis.
+	uint64_t active[GamepadState::NUM_AXIS] = {};
+	double sum_abs[GamepadState::NUM_AXIS] = {};
+	int max_abs[GamepadState::NUM_AXIS] = {};
+
+	double duration() const { return (ts_last - ts_first) / 1e6; }
+};
+
+// accumulate frames of one session.
+class Analyzer
+{
+public:
+	static constexpr uint32_t SEQ_WINDOW = 4096;	// duplicates are detected within this.
+
+	Analyzer(Session &s, const Config &cfg) : m_s(s), m_cfg(cfg), m_seen(SEQ_WINDOW) {}
+
+	void add(const GamepadArchiveFrame &f, bool has_seq)
+	{
+		auto &s = m_s;
+
+		if (s.frames == 0) {
+			s.ts_first = f.ts;
+			m_window_start = f.ts;
+		} else if (f.ts > s.ts_last) {
+			s.interval->record(f.ts - s.ts_last);
+		}
+		s.ts_last = std::max(s.ts_last, f.ts);
+		s.frames++;
+
+		if (has_seq) add_seq(f.seq);
+		if (f.ts_send > 0 && f.ts_recv > 0) s.latency->record(f.ts_recv - f.ts_send);
+
+		// input rate.
+		while (f.ts - m_window_start >= 1'000'000) {
+			close_window();
+			m_window_start += 1'000'000;
+		}
+		if (f.state.flags) m_window_events++;
+		if (f.state.flags & GamepadState::FLAG_AXIS_MOTION) s.axis_events++;
+		if (f.state.flags & (GamepadState::FLAG_BUTTON_DOWN | GamepadState::FLAG_BUTTON_UP)) s.button_events++;
+
+		auto pressed = f.state.buttons & ~m_buttons;
+		for (int i = 0; i < GamepadState::NUM_BUTTON; i++) {
+			if (pressed & (1 << i)) s.presses[i]++;
+		}
+		m_buttons = f.state.buttons;
+
+		// stick activity.
+		for (int i = 0; i < GamepadState::NUM_AXIS; i++) {
+			int v = std::abs(int(f.state.axis[i]));
+			if (v > m_cfg.deadzone) s.active[i]++;
+			s.sum_abs[i] += v;
+			s.max_abs[i] = std::max(s.max_abs[i], v);
+		}
+	}
+
+	void finish()
+	{
+		if (m_s.frames > 0) close_window();
+		if (m_s.has_seq) {
+			auto expected = uint64_t(m_s.seq_max - m_s.seq_first) + 1;
+			auto unique = m_s.frames - m_s.duplicated;
+			m_s.lost = (expected > unique) ? expected - unique : 0;
+		}
+	}
+
+private:
+	void add_seq(uint32_t seq)
+	{
+		auto &s = m_s;
+
+		if (!s.has_seq) {
+			s.has_seq = true;
+			s.seq_first = s.seq_max = seq;
+			m_seen[seq % SEQ_WINDOW] = true;
+			return;
+		}
+
+		if (int32_t(seq - s.seq_max) > 0) {
+			// clear slots skipped over.
+			auto gap = std::min<uint32_t>(seq - s.seq_max, SEQ_WINDOW);
+			for (uint32_t i = 1; i <= gap; i++) m_seen[(s.seq_max + i) % SEQ_WINDOW] = false;
+			s.seq_max = seq;
+			m_seen[seq % SEQ_WINDOW] = true;
+		} else if (s.seq_max - seq < SEQ_WINDOW) {
+			if (m_seen[seq % SEQ_WINDOW]) {
+				s.duplicated++;
+			} else {
+				m_seen[seq % SEQ_WINDOW] = true;
+				s.reordered++;
+			}
+			if (int32_t(seq - s.seq_first) < 0) s.seq_first = seq;
+		} else {
+			s.reordered++;	// too old to tell.
+		}
+	}
+
+	void close_window()
+	{
+		int bin = NUM_RATE_BINS - 1;
+		while (bin > 0 && m_window_events < uint64_t(RATE_BINS[bin])) bin--;
+		m_s.rate_hist[bin]++;
+		m_window_events = 0;
+	}
+
+	Session &m_s;
+	const Config &m_cfg;
+	std::vector<bool> m_seen;
+	int64_t m_window_start = 0;
+	uint64_t m_window_events = 0;
+	uint16_t m_buttons = 0;
+};
+
+static bool has_magic(const std::string &path, const char (&expected)[8])
+{
+	char magic[8] = {};
+	std::ifstream ifs(path, std::ios::binary);
+	ifs.read(magic, sizeof magic);
+	return ifs && std::equal(magic, magic + sizeof magic, expected);
+}
+
+static void analyze(Session &s, const Config &cfg)
+{
+	Analyzer a(s, cfg);
+
+	if (has_magic(s.path, GamepadRecordHeader::MAGIC)) {
+		s.kind = "record";
+		GamepadRecordReader reader;
+		if (!reader.open(s.path)) {
+			s.error = "can't read";
+			return;
+		}
+		for (auto slot = reader.next_frame(0); slot < reader.slots(); slot = reader.next_frame(slot + 1)) {
+			auto &r = reader[slot];
+			a.add({ r.seq, r.ts, r.frame.ts_send, r.frame.ts_recv, r.frame.state }, true);
+		}
+	} else if (has_magic(s.path, GamepadArchiveHeader::MAGIC)) {
+		s.kind = "archive";
+		GamepadArchiveReader reader;
+		if (!reader.open(s.path)) {
+			s.error = "can't read";
+			return;
+		}
+		std::vector<GamepadArchiveFrame> frames;
+		for (size_t i = 0; i < reader.chunks().size(); i++) {
+			frames.clear();
+			if (!reader.read_chunk(i, frames)) {
+				s.error = "broken chunk";
+				break;
+			}
+			for (auto &f : frames) a.add(f, true);
+		}
+	} else {
+		s.kind = "stdout";
+		std::string text;
+		if (!json_frames::read_file(s.path, text)) {
+			s.error = "can't read";
+			return;
+		}
+		// frames are assumed to be printed at fps.
+		uint64_t n = 0;
+		json_frames::for_each_object(text.data(), text.size(), [&](const char *p, size_t len) {
+			auto js = njson::parse(p, p + len, nullptr, false);
+			GamepadArchiveFrame f = {};
+			if (js.is_discarded() || !json_frames::to_state(js, f.state)) return;
+			f.ts = int64_t(n++ * 1'000'000 / cfg.fps);
+			a.add(f, false);
+		});
+	}
+
+	a.finish();
+	if (s.frames == 0 && s.error.empty()) s.error = "no frame";
+}
+
+// files, and files under directories.
+static void collect(const std::string &arg, std::vector<std::string> &paths)
+{
+	if (fs::is_directory(arg)) {
+		for (auto &e : fs::recursive_directory_iterator(arg)) {
+			if (fs::is_regular_file(e.path())) paths.push_back(e.path().string());
+		}
+	} else {
+		paths.push_back(arg);
+	}
+}
+
+static const char *AXIS_NAMES[GamepadState::NUM_AXIS] = {
+	"Left_X", "Left_Y", "Right_X", "Right_Y", "Trigger_L", "Trigger_R",
+};
+static const char *BUTTON_NAMES[GamepadState::NUM_BUTTON] = {
+	"A", "B", "X", "Y", "Back", "Guide", "Start", "Stick_L", "Stick_R",
+	"Shoulder_L", "Shoulder_R", "Dpad_U", "Dpad_D", "Dpad_L", "Dpad_R",
+};
+
+static njson to_json(const Session &s)
+{
+	njson js = {
+		{ "path", s.path },
+		{ "kind", s.kind },
+		{ "frames", s.frames },
+		{ "duration_sec", s.duration() },
+	};
+	if (!s.error.empty()) js["error"] = s.error;
+	if (s.frames == 0) return js;
+
+	if (s.has_seq) {
+		auto expected = s.frames - s.duplicated + s.lost;
+		js["loss"] = {
+			{ "lost", s.lost },
+			{ "reordered", s.reordered },
+			{ "duplicated", s.duplicated },
+			{ "loss_rate", expected ? double(s.lost) / expected : 0.0 },
+			{ "reorder_rate", s.frames ? double(s.reordered) / s.frames : 0.0 },
+		};
+	}
+
+	auto percentiles = [](const LatencyHistogram &h) {
+		auto snap = h.snapshot();
+		return njson{
+			{ "count", snap.count },
+			{ "mean_us", snap.mean() },
+			{ "p50_us", snap.percentile(0.50) },
+			{ "p90_us", snap.percentile(0.90) },
+			{ "p99_us", snap.percentile(0.99) },
+			{ "p999_us", snap.percentile(0.999) },
+			{ "max_us", snap.max },
+		};
+	};
+	if (s.latency->snapshot().count > 0) js["latency"] = percentiles(*s.latency);
+	js["interval"] = percentiles(*s.interval);
+
+	njson rate = njson::object();
+	for (int i = 0; i < NUM_RATE_BINS; i++) rate[rate_label(i)] = s.rate_hist[i];
+	js["events_per_sec"] = rate;
+	js["axis_events"] = s.axis_events;
+	js["button_events"] = s.button_events;
+
+	njson presses = njson::object();
+	for (int i = 0; i < GamepadState::NUM_BUTTON; i++) presses[BUTTON_NAMES[i]] = s.presses[i];
+	js["button_presses"] = presses;
+
+	njson axes = njson::object();
+	for (int i = 0; i < GamepadState::NUM_AXIS; i++) {
+		axes[AXIS_NAMES[i]] = {
+			{ "active_ratio", s.frames ? double(s.active[i]) / s.frames : 0.0 },
+			{ "mean_abs", s.frames ? s.sum_abs[i] / s.frames : 0.0 },
+			{ "max_abs", s.max_abs[i] },
+		};
+	}
+	js["axes"] = axes;
+
+	return js;
+}
+
+static void print_text(const Session &s)
+{
+	printf("== %s (%s)\n", s.path.c_str(), s.kind.c_str());
+	if (!s.error.empty()) printf("  error    : %s\n", s.error.c_str());
+	if (s.frames == 0) return;
+
+	printf("  frames   : %lu in %.1f sec (%.1f fps)\n", (unsigned long)s.frames, s.duration(),
+		s.duration() > 0 ? (s.frames - 1) / s.duration() : 0.0);
+	if (s.has_seq) {
+		auto expected = s.frames - s.duplicated + s.lost;
+		printf("  loss     : lost %lu (%.3f %%), reordered %lu (%.3f %%), duplicated %lu\n",
+			(unsigned long)s.lost, expected ? 100.0 * s.lost / expected : 0.0,
+			(unsigned long)s.reordered, 100.0 * s.reordered / s.frames, (unsigned long)s.duplicated);
+	}
+
+	auto print_hist = [](const char *name, const LatencyHistogram &h) {
+		auto snap = h.snapshot();
+		if (snap.count == 0) return;
+		printf("  %-8s : mean %.0f, p50 %ld, p90 %ld, p99 %ld, p99.9 %ld, max %ld [usec]\n", name, snap.mean(),
+			(long)snap.percentile(0.50), (long)snap.percentile(0.90), (long)snap.percentile(0.99),
+			(long)snap.percentile(0.999), (long)snap.max);
+	};
+	print_hist("latency", *s.latency);
+	print_hist("interval", *s.interval);
+
+	printf("  events   : axis %lu, button %lu. seconds by events/sec:", (unsigned long)s.axis_events, (unsigned long)s.button_events);
+	for (int i = 0; i < NUM_RATE_BINS; i++) {
+		printf(" %s:%lu", rate_label(i).c_str(), (unsigned long)s.rate_hist[i]);
+	}
+	printf("\n");
+
+	printf("  presses  :");
+	for (int i = 0; i < GamepadState::NUM_BUTTON; i++) {
+		if (s.presses[i]) printf(" %s:%lu", BUTTON_NAMES[i], (unsigned long)s.presses[i]);
+	}
+	printf("\n");
+
+	for (int i = 0; i < GamepadState::NUM_AXIS; i++) {
+		printf("  %-9s: active %5.1f %%, mean |v| %7.0f, max |v| %5d\n", AXIS_NAMES[i],
+			100.0 * s.active[i] / s.frames, s.sum_abs[i] / s.frames, s.max_abs[i]);
+	}
+}
+
+static void print_usage()
+{
+	LogInfo("usage: vgmpad_analyze FILE|DIR... [options]\n");
+	LogInfo("  FILE : binary recording (--record of vgmpad_send/vgmpad_recv), archive (vgmpad_archive pack),\n");
+	LogInfo("         or captured stdout of vgmpad_send/vgmpad_recv. DIR is searched recursively.\n");
+	LogInfo("  -j N          : number of worker threads. (default: number of CPUs)\n");
+	LogInfo("  --fps N       : frame rate of captured stdout, which has no time stamp. (default: 30)\n");
+	LogInfo("  --deadzone N  : stick / trigger is active beyond N. (default: 8000)\n");
+	LogInfo("  --json        : print results as JSON.\n");
+}
+
+int main(int argc, char *argv[])
+{
+	Config cfg;
+	cfg.num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<std::string> paths;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		auto has_next = (i + 1 < argc);
+		if (arg == "-j" && has_next) {
+			cfg.num_threads = std::atoi(argv[++i]);
+		} else if (arg == "--fps" && has_next) {
+			cfg.fps = std::atof(argv[++i]);
+		} else if (arg == "--deadzone" && has_next) {
+			cfg.deadzone = std::atoi(argv[++i]);
+		} else if (arg == "--json") {
+			cfg.json = true;
+		} else if (arg.rfind("-", 0) == 0) {
+			print_usage();
+			exit(EXIT_FAILURE);
+		} else {
+			collect(arg, paths);
+		}
+	}
+	if (paths.empty() || cfg.num_threads < 1 || cfg.fps <= 0.0) {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	// largest first, so a big file doesn't start last.
+	std::vector<Session> sessions(paths.size());
+	for (size_t i = 0; i < paths.size(); i++) {
+		sessions[i].path = paths[i];
+		std::error_code ec;
+		auto size = fs::file_size(paths[i], ec);
+		sessions[i].bytes = ec ? 0 : size;
+	}
+	std::vector<size_t> order(sessions.size());
+	for (size_t i = 0; i < order.size(); i++) order[i] = i;
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sessions[a].bytes > sessions[b].bytes; });
+
+	// thread pool, each worker takes the next file.
+	auto t_start = std::chrono::steady_clock::now();
+	std::atomic<size_t> next{0};
+	auto worker = [&]() {
+		for (size_t i; (i = next.fetch_add(1)) < order.size(); ) {
+			analyze(sessions[order[i]], cfg);
+		}
+	};
+	std::vector<std::thread> threads;
+	auto num_threads = std::min<size_t>(cfg.num_threads, sessions.size());
+	for (size_t n = 0; n < num_threads; n++) threads.emplace_back(worker);
+	for (auto &t : threads) t.join();
+	auto sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+	uint64_t bytes = 0, frames = 0;
+	for (auto &s : sessions) {
+		bytes += s.bytes;
+		frames += s.frames;
+	}
+
+	if (cfg.json) {
+		njson js = {
+			{ "sessions", njson::array() },
+			{ "files", sessions.size() },
+			{ "frames", frames },
+			{ "bytes", bytes },
+			{ "threads", num_threads },
+			{ "elapsed_sec", sec },
+		};
+		for (auto &s : sessions) js["sessions"].push_back(to_json(s));
+		printf("%s\n", js.dump(2).c_str());
+	} else {
+		for (auto &s : sessions) print_text(s);
+		printf("== %zu files, %lu frames, %.1f MB in %.2f sec (%.1f MB/sec, %zu threads)\n",
+			sessions.size(), (unsigned long)frames, bytes / 1e6, sec, bytes / 1e6 / std::max(sec, 1e-9), num_threads);
+	}
+
+	return EXIT_SUCCESS;
+}
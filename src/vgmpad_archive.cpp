@@ -0,0 +1,262 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+// convert recordings to the columnar archive (GamepadArchive.h), and read it.
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "json.hpp"
+#include "Logger.h"
+#include "GamepadRecord.h"
+#include "GamepadArchive.h"
+#include "JsonFrames.h"
+
+using njson = nlohmann::json;
+
+static void print_usage()
+{
+	LogInfo("usage: vgmpad_archive pack INPUT OUTPUT [--fps N]\n");
+	LogInfo("       vgmpad_archive info ARCHIVE\n");
+	LogInfo("       vgmpad_archive cat ARCHIVE [--from SEC] [--to SEC]\n");
+	LogInfo("  pack : INPUT is a binary recording (--record of vgmpad_send/vgmpad_recv),\n");
+	LogInfo("         or captured stdout of vgmpad_send/vgmpad_recv.\n");
+	LogInfo("  --fps N   : frame rate of captured stdout, which has no time stamp. (default: 30)\n");
+	LogInfo("  info : chunks, sizes and decode speed.\n");
+	LogInfo("  cat  : print frames as JSON, one per line.\n");
+}
+
+static int64_t now_usec()
+{
+	auto t = std::chrono::system_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::microseconds>(t).count();
+}
+
+static bool is_record(const std::string &path)
+{
+	char magic[sizeof(GamepadRecordHeader::MAGIC)] = {};
+	std::ifstream ifs(path, std::ios::binary);
+	ifs.read(magic, sizeof magic);
+	return ifs && std::equal(magic, magic + sizeof magic, GamepadRecordHeader::MAGIC);
+}
+
+static int pack(const std::string &input, const std::string &output, double fps)
+{
+	GamepadArchiveWriter writer;
+	uint64_t input_size = 0;
+
+	if (is_record(input)) {
+		GamepadRecordReader reader;
+		if (!reader.open(input)) {
+			LogError("ERROR!! can't read %s\n", input.c_str());
+			return EXIT_FAILURE;
+		}
+		auto h = reader.header();
+		if (!writer.open(output, h->source, h->mode == 1, h->ts_start)) {
+			LogError("ERROR!! can't open %s\n", output.c_str());
+			return EXIT_FAILURE;
+		}
+		for (auto slot = reader.next_frame(0); slot < reader.slots(); slot = reader.next_frame(slot + 1)) {
+			auto &r = reader[slot];
+			writer.write({ r.seq, r.ts, r.frame.ts_send, r.frame.ts_recv, r.frame.state });
+		}
+		input_size = sizeof(GamepadRecordHeader) + reader.slots() * sizeof(GamepadRecord);
+	} else {
+		std::string text;
+		if (!json_frames::read_file(input, text)) {
+			LogError("ERROR!! can't read %s\n", input.c_str());
+			return EXIT_FAILURE;
+		}
+		input_size = text.size();
+
+		// no time stamp in stdout, frames are assumed to be printed at fps.
+		auto ts_start = now_usec();
+		if (!writer.open(output, "", false, ts_start)) {
+			LogError("ERROR!! can't open %s\n", output.c_str());
+			return EXIT_FAILURE;
+		}
+		uint32_t seq = 0;
+		for (auto &js : json_frames::parse(text)) {
+			GamepadArchiveFrame f = {};
+			if (!json_frames::to_state(js, f.state)) continue;
+			f.seq = seq;
+			f.ts = ts_start + int64_t(int64_t(seq) * 1'000'000 / fps);
+			writer.write(f);
+			seq++;
+		}
+	}
+
+	auto frames = writer.GetFrames();
+	if (!writer.close()) {
+		LogError("ERROR!! can't write %s\n", output.c_str());
+		return EXIT_FAILURE;
+	}
+
+	std::ifstream ifs(output, std::ios::binary | std::ios::ate);
+	uint64_t output_size = ifs.tellg();
+	printf("%lu frames, %lu -> %lu bytes (%.1f -> %.2f bytes/frame), 1/%.1f\n",
+		(unsigned long)frames, (unsigned long)input_size, (unsigned long)output_size,
+		frames ? double(input_size) / frames : 0.0, frames ? double(output_size) / frames : 0.0,
+		output_size ? double(input_size) / output_size : 0.0);
+
+	return EXIT_SUCCESS;
+}
+
+static int info(const std::string &path)
+{
+	GamepadArchiveReader reader;
+	if (!reader.open(path)) {
+		LogError("ERROR!! can't read %s\n", path.c_str());
+		return EXIT_FAILURE;
+	}
+
+	auto h = reader.header();
+	auto &chunks = reader.chunks();
+	auto frames = reader.frames();
+	printf("source   : %.*s (%s)\n", int(sizeof h->source), h->source, h->mode ? "receive" : "send");
+	printf("chunks   : %zu (%u frames/chunk)\n", chunks.size(), h->chunk_frames);
+	printf("frames   : %lu\n", (unsigned long)frames);
+	if (!chunks.empty()) {
+		printf("duration : %.1f sec\n", (chunks.back().ts_last - chunks.front().ts_first) / 1e6);
+	}
+	printf("size     : %zu bytes (%.2f bytes/frame)\n", reader.size(), frames ? double(reader.size()) / frames : 0.0);
+
+	// bytes per column.
+	static const char *names[GamepadArchiveChunk::NUM_COLUMNS] = {
+		"ts", "seq", "ts_send", "ts_recv",
+		"axis_Left_X", "axis_Left_Y", "axis_Right_X", "axis_Right_Y", "axis_Trigger_L", "axis_Trigger_R",
+		"buttons", "flags",
+	};
+	uint64_t column_size[GamepadArchiveChunk::NUM_COLUMNS] = {};
+	for (auto &ix : chunks) {
+		auto &c = *(const GamepadArchiveChunk *)((const char *)h + ix.offset);
+		for (int i = 0; i < GamepadArchiveChunk::NUM_COLUMNS; i++) column_size[i] += c.column_size[i];
+	}
+	for (int i = 0; i < GamepadArchiveChunk::NUM_COLUMNS; i++) {
+		printf("  %-16s %10lu bytes (%.3f bytes/frame)\n", names[i], (unsigned long)column_size[i],
+			frames ? double(column_size[i]) / frames : 0.0);
+	}
+
+	// decode speed.
+	std::vector<GamepadArchiveFrame> decoded;
+	decoded.reserve(h->chunk_frames);
+	uint64_t num = 0;
+	auto t0 = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < chunks.size(); i++) {
+		decoded.clear();
+		if (!reader.read_chunk(i, decoded)) {
+			LogError("ERROR!! broken chunk %zu\n", i);
+			return EXIT_FAILURE;
+		}
+		num += decoded.size();
+	}
+	auto sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	printf("decode   : %.1f M frames/sec, %.0f MB/sec (as %zu bytes/frame records)\n",
+		num / std::max(sec, 1e-9) / 1e6, num * sizeof(GamepadRecord) / std::max(sec, 1e-9) / 1e6, sizeof(GamepadRecord));
+
+	return EXIT_SUCCESS;
+}
+
+static int cat(const std::string &path, double from, double to)
+{
+	GamepadArchiveReader reader;
+	if (!reader.open(path)) {
+		LogError("ERROR!! can't read %s\n", path.c_str());
+		return EXIT_FAILURE;
+	}
+
+	auto &chunks = reader.chunks();
+	if (chunks.empty()) return EXIT_SUCCESS;
+	auto ts0 = chunks.front().ts_first;
+	auto t_from = ts0 + int64_t(from * 1'000'000);
+	auto t_to = (to > 0) ? ts0 + int64_t(to * 1'000'000) : INT64_MAX;
+
+	std::vector<GamepadArchiveFrame> frames;
+	for (auto i = reader.find(t_from); i < chunks.size() && chunks[i].ts_first <= t_to; i++) {
+		frames.clear();
+		if (!reader.read_chunk(i, frames)) {
+			LogError("ERROR!! broken chunk %zu\n", i);
+			return EXIT_FAILURE;
+		}
+		for (auto &f : frames) {
+			if (f.ts < t_from || f.ts > t_to) continue;
+			njson js = {
+				{ "seq", f.seq },
+				{ "ts", f.ts },
+				{ "ts_send", f.ts_send },
+				{ "ts_recv", f.ts_recv },
+				{ "axis", f.state.axis },
+				{ "buttons", f.state.buttons },
+				{ "flags", f.state.flags },
+			};
+			printf("%s\n", js.dump().c_str());
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3) {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	std::string command = argv[1];
+	std::vector<std::string> args;
+	double fps = 30.0;
+	double from = 0.0, to = 0.0;	// [sec].
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		auto has_next = (i + 1 < argc);
+		if (arg == "--fps" && has_next) {
+			fps = std::atof(argv[++i]);
+		} else if (arg == "--from" && has_next) {
+			from = std::atof(argv[++i]);
+		} else if (arg == "--to" && has_next) {
+			to = std::atof(argv[++i]);
+		} else if (arg.rfind("--", 0) == 0) {
+			print_usage();
+			exit(EXIT_FAILURE);
+		} else {
+			args.push_back(arg);
+		}
+	}
+
+	if (command == "pack" && args.size() == 2 && fps > 0.0) {
+		return pack(args[0], args[1], fps);
+	} else if (command == "info" && args.size() == 1) {
+		return info(args[0]);
+	} else if (command == "cat" && args.size() == 1) {
+		return cat(args[0], from, to);
+	}
+
+	print_usage();
+	return EXIT_FAILURE;
+}
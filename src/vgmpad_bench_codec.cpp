@@ -0,0 +1,417 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <functional>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+
+#include <atomic>
+#include <chrono>
+
+#if defined(USE_EXPERIMENTAL_FS)
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+#else
+#include <filesystem>
+namespace fs = std::filesystem;
+#endif
+
+#ifdef USE_SRT
+#include <srt.h>
+#endif
+#include "VirtualGamepad.h"
+#include "JsonFrames.h"
+
+// count heap allocations.
+static std::atomic<uint64_t> alloc_count{0};
+
+void *operator new(size_t size)
+{
+	alloc_count.fetch_add(1, std::memory_order_relaxed);
+	if (auto p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+// virtual gamepad without transport, only codec.
+class BenchGamepad : public VirtualGamepad
+{
+public:
+	bool IsAttached() const override { return true; }
+	bool Poll( uint32_t =0 ) override { return false; }
+	bool open(const std::string &, const std::string &, em_Mode) override { return true; }
+	bool close() override { return true; }
+	bool poll(int64_t = 33) override { return true; }
+};
+
+struct Codec {
+	std::string name;
+	std::function<bool(const VirtualGamepad &, njson &, std::vector<char> &)> encode;
+	std::function<bool(const std::vector<char> &, njson &, VirtualGamepad &)> decode;
+};
+
+static std::vector<Codec> codec_list()
+{
+	std::vector<Codec> list;
+
+	// current path. to_json + stringstream, njson::parse + from_json.
+	list.push_back({
+		"json",
+		[](const VirtualGamepad &vg, njson &js, std::vector<char> &pkt) -> bool {
+			to_json(js, vg);
+			return VirtualGamepad::encode_packet(js, pkt, 1500);
+		},
+		[](const std::vector<char> &pkt, njson &js, VirtualGamepad &vg) -> bool {
+			if (!VirtualGamepad::decode_packet(pkt, js)) return false;
+			from_json(js, vg);
+			return true;
+		},
+	});
+
+	// candidate. CBOR (see commented out code in VirtualGamepad.h).
+	list.push_back({
+		"cbor",
+		[](const VirtualGamepad &vg, njson &js, std::vector<char> &pkt) -> bool {
+			to_json(js, vg);
+			pkt.clear();
+			njson::to_cbor(js, pkt);
+			return true;
+		},
+		[](const std::vector<char> &pkt, njson &js, VirtualGamepad &vg) -> bool {
+			js = njson::from_cbor(pkt);
+			from_json(js, vg);
+			return true;
+		},
+	});
+
+	return list;
+}
+
+struct Sequence {
+	std::string name;
+	std::vector<njson> frames;
+};
+
+static njson make_frame(const std::vector<int> &axis, uint16_t buttons, bool axis_motion, bool down, bool up)
+{
+	static const char *axis_name[] = {
+		"axis_Left_X", "axis_Left_Y", "axis_Right_X", "axis_Right_Y", "axis_Trigger_L", "axis_Trigger_R",
+	};
+	static const char *button_name[] = {
+		"button_A", "button_B", "button_X", "button_Y", "button_Back", "button_Guide", "button_Start",
+		"button_Stick_L", "button_Stick_R", "button_Shoulder_L", "button_Shoulder_R",
+		"button_Dpad_U", "button_Dpad_D", "button_Dpad_L", "button_Dpad_R",
+	};
+
+	njson js;
+	js["axis_motion"] = axis_motion;
+	js["button_down"] = down;
+	js["button_up"] = up;
+	for (int i = 0; i < 6; i++) js[axis_name[i]] = int16_t(axis[i]);
+	for (int i = 0; i < 15; i++) js[button_name[i]] = uint8_t((buttons >> i) & 1);
+
+	return js;
+}
+
+static std::vector<Sequence> synthetic_sequences(size_t num, uint32_t seed)
+{
+	std::vector<Sequence> list;
+
+	// nothing is touched.
+	{
+		Sequence seq = { "idle", {} };
+		for (size_t i = 0; i < num; i++) {
+			seq.frames.push_back(make_frame({ 0, 0, 0, 0, 0, 0 }, 0, false, false, false));
+		}
+		list.push_back(std::move(seq));
+	}
+
+	// both sticks draw circles, triggers saw.
+	{
+		Sequence seq = { "sticks", {} };
+		for (size_t i = 0; i < num; i++) {
+			auto t = i * 0.05;
+			int x = int(32767 * std::cos(t));
+			int y = int(32767 * std::sin(t));
+			int trg = int(i * 331 % 32768);
+			seq.frames.push_back(make_frame({ x, y, -y, x, trg, 32767 - trg }, 0, true, false, false));
+		}
+		list.push_back(std::move(seq));
+	}
+
+	// random walk of sticks, random button presses.
+	{
+		Sequence seq = { "random", {} };
+		std::mt19937 rng(seed);
+		std::uniform_int_distribution<int> step(-2048, 2048);
+		std::uniform_int_distribution<int> btn(0, 15 * 8 - 1);
+		std::vector<int> axis(6, 0);
+		uint16_t buttons = 0;
+		for (size_t i = 0; i < num; i++) {
+			for (auto &a : axis) a = std::clamp(a + step(rng), -32768, 32767);
+			auto b = btn(rng);
+			bool down = false, up = false;
+			if (b < 15) {
+				buttons ^= uint16_t(1 << b);
+				down = (buttons >> b) & 1;
+				up = !down;
+			}
+			seq.frames.push_back(make_frame(axis, buttons, true, down, up));
+		}
+		list.push_back(std::move(seq));
+	}
+
+	return list;
+}
+
+struct Stat {
+	double frames_per_sec = 0;
+	double mbytes_per_sec = 0;
+	double p50 = 0, p99 = 0, max = 0;	// [nsec].
+	double allocs = 0;	// per frame.
+};
+
+struct Result {
+	std::string codec;
+	std::string sequence;
+	size_t frames = 0;
+	double bytes = 0;	// per frame.
+	Stat encode;
+	Stat decode;
+};
+
+static Stat summarize(std::vector<double> &ns, size_t bytes, uint64_t allocs)
+{
+	Stat st;
+	if (ns.empty()) return st;
+
+	double total = 0;
+	for (auto &e : ns) total += e;
+	std::sort(ns.begin(), ns.end());
+	auto pct = [&](double p) { return ns[std::min(ns.size() - 1, size_t(p * ns.size()))]; };
+
+	st.frames_per_sec = ns.size() / (total * 1e-9);
+	st.mbytes_per_sec = bytes / (total * 1e-9) / 1e6;
+	st.p50 = pct(0.50);
+	st.p99 = pct(0.99);
+	st.max = ns.back();
+	st.allocs = double(allocs) / ns.size();
+
+	return st;
+}
+
+static Result run(const Codec &codec, const Sequence &seq)
+{
+	using clock = std::chrono::steady_clock;
+
+	Result res;
+	res.codec = codec.name;
+	res.sequence = seq.name;
+	res.frames = seq.frames.size();
+
+	BenchGamepad src, dst;
+	njson js_enc, js_dec;
+	std::vector<char> pkt;
+	std::vector<std::vector<char>> pkts;
+	pkts.reserve(seq.frames.size());
+	std::vector<double> ns;
+	ns.reserve(seq.frames.size());
+
+	// encode.
+	size_t bytes = 0;
+	uint64_t allocs = 0;
+	for (auto &frame : seq.frames) {
+		from_json(frame, src);
+
+		auto a0 = alloc_count.load(std::memory_order_relaxed);
+		auto t0 = clock::now();
+		codec.encode(src, js_enc, pkt);
+		auto t1 = clock::now();
+		allocs += alloc_count.load(std::memory_order_relaxed) - a0;
+
+		ns.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count());
+		bytes += pkt.size();
+		pkts.push_back(pkt);
+	}
+	res.bytes = double(bytes) / std::max<size_t>(1, seq.frames.size());
+	res.encode = summarize(ns, bytes, allocs);
+
+	// decode.
+	ns.clear();
+	allocs = 0;
+	for (auto &p : pkts) {
+		auto a0 = alloc_count.load(std::memory_order_relaxed);
+		auto t0 = clock::now();
+		codec.decode(p, js_dec, dst);
+		auto t1 = clock::now();
+		allocs += alloc_count.load(std::memory_order_relaxed) - a0;
+
+		ns.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count());
+	}
+	res.decode = summarize(ns, bytes, allocs);
+
+	return res;
+}
+
+static void print_table(const std::vector<Result> &results)
+{
+	printf("%-6s %-16s %8s %7s | %10s %8s %8s %8s %9s %7s | %10s %8s %8s %8s %9s %7s\n",
+		"codec", "sequence", "frames", "B/frm",
+		"enc fr/s", "MB/s", "p50[ns]", "p99[ns]", "max[ns]", "alloc",
+		"dec fr/s", "MB/s", "p50[ns]", "p99[ns]", "max[ns]", "alloc");
+	for (auto &r : results) {
+		printf("%-6s %-16s %8zu %7.1f | %10.0f %8.2f %8.0f %8.0f %9.0f %7.1f | %10.0f %8.2f %8.0f %8.0f %9.0f %7.1f\n",
+			r.codec.c_str(), r.sequence.c_str(), r.frames, r.bytes,
+			r.encode.frames_per_sec, r.encode.mbytes_per_sec, r.encode.p50, r.encode.p99, r.encode.max, r.encode.allocs,
+			r.decode.frames_per_sec, r.decode.mbytes_per_sec, r.decode.p50, r.decode.p99, r.decode.max, r.decode.allocs);
+	}
+}
+
+static njson to_json_result(const std::vector<Result> &results)
+{
+	auto stat = [](const Stat &st) -> njson {
+		return {
+			{ "frames_per_sec", st.frames_per_sec },
+			{ "mbytes_per_sec", st.mbytes_per_sec },
+			{ "p50_ns", st.p50 },
+			{ "p99_ns", st.p99 },
+			{ "max_ns", st.max },
+			{ "allocs_per_frame", st.allocs },
+		};
+	};
+
+	njson js = njson::array();
+	for (auto &r : results) {
+		js.push_back({
+			{ "codec", r.codec },
+			{ "sequence", r.sequence },
+			{ "frames", r.frames },
+			{ "bytes_per_frame", r.bytes },
+			{ "encode", stat(r.encode) },
+			{ "decode", stat(r.decode) },
+		});
+	}
+
+	return js;
+}
+
+static void print_usage()
+{
+	LogInfo("usage: vgmpad_bench_codec [options]\n");
+	LogInfo("  --frames N      : number of synthetic frames per sequence. (default: 100000)\n");
+	LogInfo("  --seed N        : seed of random sequence. (default: 1)\n");
+	LogInfo("  --input FILE    : recorded sequence, captured stdout of vgmpad_send/vgmpad_recv. (repeatable)\n");
+	LogInfo("  --codec NAME    : run only this codec. (json, cbor)\n");
+	LogInfo("  --json [FILE]   : print results as JSON (to FILE if given).\n");
+}
+
+int main(int argc, char *argv[])
+{
+	size_t num_frames = 100'000;
+	uint32_t seed = 1;
+	std::vector<std::string> inputs;
+	std::string codec_name = "";
+	bool out_json = false;
+	std::string json_path = "";
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		auto has_next = (i + 1 < argc);
+		if (arg == "--frames" && has_next) {
+			num_frames = std::stoul(argv[++i]);
+		} else if (arg == "--seed" && has_next) {
+			seed = std::stoul(argv[++i]);
+		} else if (arg == "--input" && has_next) {
+			inputs.push_back(argv[++i]);
+		} else if (arg == "--codec" && has_next) {
+			codec_name = argv[++i];
+		} else if (arg == "--json") {
+			out_json = true;
+			if (has_next && argv[i + 1][0] != '-') json_path = argv[++i];
+		} else {
+			print_usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	auto sequences = synthetic_sequences(num_frames, seed);
+	for (auto &path : inputs) {
+		std::string text;
+		if (!json_frames::read_file(path, text)) {
+			LogError("ERROR!! can't read %s\n", path.c_str());
+			return EXIT_FAILURE;
+		}
+
+		// keep only frames which have gamepad status.
+		Sequence seq = { fs::path(path).filename().string(), {} };
+		BenchGamepad vg;
+		for (auto &js : json_frames::parse(text)) {
+			try {
+				from_json(js, vg);
+			} catch (njson::exception &e) {
+				continue;
+			}
+			seq.frames.push_back(std::move(js));
+		}
+		if (seq.frames.empty()) {
+			LogError("ERROR!! no gamepad frames in %s\n", path.c_str());
+			return EXIT_FAILURE;
+		}
+		sequences.push_back(std::move(seq));
+	}
+
+	std::vector<Result> results;
+	for (auto &codec : codec_list()) {
+		if (codec_name != "" && codec_name != codec.name) continue;
+		for (auto &seq : sequences) {
+			results.push_back(run(codec, seq));
+		}
+	}
+	if (results.empty()) {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if (!out_json) {
+		print_table(results);
+	} else if (json_path == "") {
+		std::cout << std::setw(2) << to_json_result(results) << std::endl;
+	} else {
+		std::ofstream ofs(json_path);
+		ofs << std::setw(2) << to_json_result(results) << std::endl;
+		if (!ofs) {
+			LogError("ERROR!! can't write %s\n", json_path.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,358 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_set>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#ifdef USE_SRT
+#include <srt.h>
+#endif
+#include "VirtualGamepad.h"
+#include "devSynthetic.h"
+
+auto Usleep = [](uint64_t t) -> void {
+	std::this_thread::sleep_for(std::chrono::microseconds(t));
+};
+
+struct Config {
+	std::vector<std::string> protocols = { "udp", "srt" };
+	int port = 14300;	// udp: port, srt: port + 1.
+	int send_port = 0;	// sender sends to this port instead, e.g. vgmpad_netem. udp: port, srt: port + 1.
+	double rate = 100.0;	// [Hz].
+	double duration = 10.0;	// [sec].
+	std::string send_mode = "sleep";	// sleep, deadline.
+	std::string recv_mode = "spin";	// spin, fps.
+	double recv_fps = 30.0;
+	int srt_latency = -1;	// [msec].
+	std::string synthetic = "mixed:100";
+};
+
+struct Result {
+	std::string protocol;
+	uint64_t sent = 0;
+	uint64_t send_error = 0;
+	uint64_t received = 0;
+	uint64_t lost = 0;
+	uint64_t duplicated = 0;
+	uint64_t reordered = 0;
+	std::vector<int64_t> latency;	// [usec].
+	std::map<std::string, LatencyHistogram::Snapshot> stages;	// per-stage breakdown.
+	int64_t clock_offset = 0;	// [usec].
+	int64_t clock_rtt = -1;	// [usec], < 0 : not estimated.
+};
+
+static std::unique_ptr<VirtualGamepad> create(const std::string &protocol, const std::string &name, int port, VirtualGamepad::em_Mode mode, const Config &cfg)
+{
+	std::unique_ptr<VirtualGamepad> vgmpad;
+	auto service = std::to_string(port);
+
+	if (protocol == "udp") {
+		vgmpad = VirtualGamepadUDP::Create(name, service, mode);
+#if !defined(_WIN32)
+	} else if (protocol == "unix") {
+		vgmpad = VirtualGamepadUnix::Create(name, service, mode);
+	} else if (protocol == "tcp") {
+		vgmpad = VirtualGamepadTCP::Create(name, service, mode);
+#endif
+	} else {
+		auto srt = std::make_unique<VirtualGamepadSRT>();
+		srt->SetLatency(cfg.srt_latency);
+		if (!srt->open(name, service, mode)) {
+			LogError("ERROR!! open virtual gamepad(SRT) %s:%s\n", name.c_str(), service.c_str());
+			return nullptr;
+		}
+		vgmpad = std::move(srt);
+	}
+
+	return vgmpad;
+}
+
+static Result run(const std::string &protocol, int port, int send_port, const Config &cfg)
+{
+	Result res;
+	res.protocol = protocol;
+
+	auto rx = create(protocol, "", port, VirtualGamepad::em_Mode::RECEIVE, cfg);
+	if (!rx) return res;
+
+	std::atomic<bool> stop_recv{false};
+	uint32_t seq_first = 0, seq_last = 0;
+	std::thread th_recv([&]() {
+		uint32_t seq_prev = rx->GetSeq();
+		std::unordered_set<uint32_t> seen;
+		auto on_frame = [&]() {
+			auto seq = rx->GetSeq();
+			if (seq == seq_prev) return;
+			seq_prev = seq;
+
+			if (!seen.insert(seq).second) {
+				res.duplicated++;
+				return;
+			}
+			if (res.received == 0) seq_first = seq;
+			if (seq < seq_last) res.reordered++;
+			seq_first = std::min(seq_first, seq);
+			seq_last = std::max(seq_last, seq);
+			res.received++;
+			res.latency.push_back(rx->GetRecvTime() - rx->GetSendTime());
+			rx->MarkOutput();
+		};
+
+		while (!stop_recv) {
+			if (cfg.recv_mode == "fps") {
+				while (rx->receive(0)) on_frame();
+				Usleep((1.0 / cfg.recv_fps) * 1'000'000.0);
+			} else {
+				if (rx->receive(0)) on_frame();
+				else std::this_thread::yield();
+			}
+		}
+	});
+
+	auto tx = create(protocol, "localhost", send_port, VirtualGamepad::em_Mode::SEND, cfg);
+	if (!tx) {
+		stop_recv = true;
+		th_recv.join();
+		return res;
+	}
+
+	auto gamepad = SyntheticGamepad::Create(cfg.synthetic.c_str());
+	if (!gamepad) {
+		stop_recv = true;
+		th_recv.join();
+		return res;
+	}
+
+	// send.
+	auto period = std::chrono::duration<double>(1.0 / cfg.rate);
+	auto t_start = std::chrono::steady_clock::now();
+	auto t_end = t_start + std::chrono::duration<double>(cfg.duration);
+	auto t_next = t_start;
+	while (std::chrono::steady_clock::now() < t_end) {
+		gamepad->Step(period.count());
+		tx->update(gamepad);
+		if (tx->send(0)) res.sent++;
+		else res.send_error++;
+
+		if (cfg.send_mode == "deadline") {
+			t_next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(period);
+			auto now = std::chrono::steady_clock::now();
+			if (now < t_next) tx->wait_control(std::chrono::duration_cast<std::chrono::microseconds>(t_next - now).count());
+		} else {
+			tx->wait_control(period.count() * 1'000'000.0);
+		}
+	}
+
+	// drain.
+	auto t_drain = std::max(200, cfg.srt_latency * 2);
+	std::this_thread::sleep_for(std::chrono::milliseconds(t_drain));
+	stop_recv = true;
+	th_recv.join();
+
+	if (res.received > 0) {
+		auto expected = uint64_t(seq_last - seq_first) + 1;
+		res.lost = (expected > res.received) ? expected - res.received : 0;
+	}
+
+	if (rx->GetClock().IsValid()) {
+		res.clock_offset = rx->GetClock().GetOffset();
+		res.clock_rtt = rx->GetClock().GetRtt();
+	}
+	for (auto &[name, h] : rx->GetMetricsSnapshot().histograms) {
+		if (name.rfind("stage_", 0) == 0) res.stages[name.substr(6, name.size() - 6 - 3)] = h;
+	}
+
+	tx.reset();
+	rx.reset();
+
+	return res;
+}
+
+static int64_t percentile(const std::vector<int64_t> &sorted, double p)
+{
+	if (sorted.empty()) return 0;
+	return sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))];
+}
+
+static njson summarize(Result &r)
+{
+	std::sort(r.latency.begin(), r.latency.end());
+
+	njson stages = njson::object();
+	for (auto &[name, h] : r.stages) {
+		if (h.count == 0) continue;
+		stages[name] = { { "p50_us", h.percentile(0.50) }, { "p99_us", h.percentile(0.99) }, { "max_us", h.max } };
+	}
+
+	return {
+		{ "protocol", r.protocol },
+		{ "sent", r.sent },
+		{ "send_error", r.send_error },
+		{ "received", r.received },
+		{ "lost", r.lost },
+		{ "duplicated", r.duplicated },
+		{ "reordered", r.reordered },
+		{ "p50_us", percentile(r.latency, 0.50) },
+		{ "p99_us", percentile(r.latency, 0.99) },
+		{ "p999_us", percentile(r.latency, 0.999) },
+		{ "max_us", r.latency.empty() ? 0 : r.latency.back() },
+		{ "stages", stages },
+		{ "clock_offset_us", r.clock_offset },
+		{ "clock_rtt_us", r.clock_rtt },
+	};
+}
+
+static void print_usage()
+{
+	LogInfo("usage: vgmpad_bench_e2e [options]\n");
+	LogInfo("  --protocol P      : udp, srt, tcp, unix or both (udp and srt). (default: both)\n");
+	LogInfo("  --port N          : udp uses N, srt uses N+1. (default: 14300)\n");
+	LogInfo("  --send-port N     : sender sends to N (udp) / N+1 (srt), e.g. vgmpad_netem. (default: --port)\n");
+	LogInfo("  --rate HZ         : send rate. (default: 100)\n");
+	LogInfo("  --duration SEC    : (default: 10)\n");
+	LogInfo("  --send-mode M     : sleep (same as vgmpad_send), deadline. (default: sleep)\n");
+	LogInfo("  --recv-mode M     : spin, fps (same as vgmpad_recv). (default: spin)\n");
+	LogInfo("  --recv-fps N      : loop rate of 'fps' receive mode. (default: 30)\n");
+	LogInfo("  --srt-latency MS  : SRTO_LATENCY. (default: libsrt default)\n");
+	LogInfo("  --synthetic SPEC  : synthetic gamepad, pattern[:rate[:seed]]. (default: mixed:100)\n");
+	LogInfo("  --json [FILE]     : print results as JSON (to FILE if given).\n");
+}
+
+int main(int argc, char *argv[])
+{
+	Config cfg;
+	bool out_json = false;
+	std::string json_path = "";
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		auto has_next = (i + 1 < argc);
+		if (arg == "--protocol" && has_next) {
+			std::string p = argv[++i];
+			if (p == "both") cfg.protocols = { "udp", "srt" };
+#if defined(_WIN32)
+			else if (p == "udp" || p == "srt") cfg.protocols = { p };
+#else
+			else if (p == "udp" || p == "srt" || p == "tcp" || p == "unix") cfg.protocols = { p };
+#endif
+			else { print_usage(); exit(EXIT_FAILURE); }
+		} else if (arg == "--port" && has_next) {
+			cfg.port = std::stoi(argv[++i]);
+		} else if (arg == "--send-port" && has_next) {
+			cfg.send_port = std::stoi(argv[++i]);
+		} else if (arg == "--rate" && has_next) {
+			cfg.rate = std::stod(argv[++i]);
+		} else if (arg == "--duration" && has_next) {
+			cfg.duration = std::stod(argv[++i]);
+		} else if (arg == "--send-mode" && has_next) {
+			cfg.send_mode = argv[++i];
+		} else if (arg == "--recv-mode" && has_next) {
+			cfg.recv_mode = argv[++i];
+		} else if (arg == "--recv-fps" && has_next) {
+			cfg.recv_fps = std::stod(argv[++i]);
+		} else if (arg == "--srt-latency" && has_next) {
+			cfg.srt_latency = std::stoi(argv[++i]);
+		} else if (arg == "--synthetic" && has_next) {
+			cfg.synthetic = argv[++i];
+		} else if (arg == "--json") {
+			out_json = true;
+			if (has_next && argv[i + 1][0] != '-') json_path = argv[++i];
+		} else {
+			print_usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (cfg.rate <= 0 || cfg.recv_fps <= 0) {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+
+#ifdef USE_SRT
+	if (srt_startup() < 0) {
+		LogError("Unable to initialize SRT: %s\n", srt_getlasterror_str());
+		return EXIT_FAILURE;
+	}
+#endif
+
+	njson results = njson::array();
+	for (auto &protocol : cfg.protocols) {
+		auto offset = (protocol == "udp") ? 0 : (protocol == "srt") ? 1 : (protocol == "unix") ? 2 : 3;
+		auto send_port = (cfg.send_port > 0) ? cfg.send_port : cfg.port;
+		auto res = run(protocol, cfg.port + offset, send_port + offset, cfg);
+		results.push_back(summarize(res));
+	}
+
+#ifdef USE_SRT
+	srt_cleanup();
+#endif
+
+	if (!out_json) {
+		printf("\nsend: %s, recv: %s, rate: %.1f Hz, duration: %.1f sec, srt latency: %d ms\n",
+			cfg.send_mode.c_str(), cfg.recv_mode.c_str(), cfg.rate, cfg.duration, cfg.srt_latency);
+		printf("%-8s %8s %8s %8s %8s %8s %8s | %10s %10s %10s %10s\n",
+			"protocol", "sent", "snd_err", "recv", "lost", "dup", "reorder", "p50[us]", "p99[us]", "p99.9[us]", "max[us]");
+		for (auto &r : results) {
+			printf("%-8s %8lu %8lu %8lu %8lu %8lu %8lu | %10ld %10ld %10ld %10ld\n",
+				r["protocol"].get<std::string>().c_str(),
+				r["sent"].get<uint64_t>(), r["send_error"].get<uint64_t>(),
+				r["received"].get<uint64_t>(), r["lost"].get<uint64_t>(),
+				r["duplicated"].get<uint64_t>(), r["reordered"].get<uint64_t>(),
+				r["p50_us"].get<int64_t>(), r["p99_us"].get<int64_t>(),
+				r["p999_us"].get<int64_t>(), r["max_us"].get<int64_t>());
+		}
+
+		// where the latency comes from.
+		printf("\n%-8s %-8s | %10s %10s %10s\n", "protocol", "stage", "p50[us]", "p99[us]", "max[us]");
+		for (auto &r : results) {
+			for (auto name : { "input", "queue", "encode", "wire", "socket", "decode", "output", "total" }) {
+				if (!r["stages"].contains(name)) continue;
+				auto &st = r["stages"][name];
+				printf("%-8s %-8s | %10ld %10ld %10ld\n", r["protocol"].get<std::string>().c_str(), name,
+					st["p50_us"].get<int64_t>(), st["p99_us"].get<int64_t>(), st["max_us"].get<int64_t>());
+			}
+			printf("%-8s %-8s | offset %ld [us], rtt %ld [us]\n", r["protocol"].get<std::string>().c_str(), "clock",
+				r["clock_offset_us"].get<int64_t>(), r["clock_rtt_us"].get<int64_t>());
+		}
+	} else if (json_path == "") {
+		std::cout << std::setw(2) << results << std::endl;
+	} else {
+		std::ofstream ofs(json_path);
+		ofs << std::setw(2) << results << std::endl;
+		if (!ofs) {
+			LogError("ERROR!! can't write %s\n", json_path.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
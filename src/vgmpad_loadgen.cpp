@@ -0,0 +1,326 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <signal.h>
+#include <sys/resource.h>
+
+#ifdef USE_SRT
+#include <srt.h>
+#endif
+#include "VirtualGamepad.h"
+#include "devSynthetic.h"
+
+static std::atomic<bool> signal_recieved{false};
+
+static void sig_handler(int signo)
+{
+	if( signo == SIGINT )
+	{
+		signal_recieved = true;
+	}
+}
+
+struct Config {
+	std::string name;
+	std::string service;
+	std::string protocol;
+	int num_pads = 1000;
+	int num_threads = 4;
+	double rate = 10.0;	// [Hz] per pad.
+	double duration = 10.0;	// [sec]. 0: until SIGINT.
+	std::string synthetic = "mixed:60";
+	uint32_t seed = 1;
+	int srt_latency = -1;	// [msec].
+};
+
+struct Pad {
+	std::unique_ptr<VirtualGamepad> vgmpad;
+	std::unique_ptr<SyntheticGamepad> gamepad;
+};
+
+struct alignas(64) Counter {
+	std::atomic<uint64_t> sent{0};
+	std::atomic<uint64_t> error{0};
+	std::atomic<uint64_t> late{0};
+};
+
+static double cpu_time()
+{
+	rusage ru = {};
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+}
+
+// each pad needs its own socket.
+static void raise_fd_limit(int num_pads)
+{
+	rlimit rl = {};
+	if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return;
+
+	rlim_t need = rlim_t(num_pads) * 2 + 64;
+	if (rl.rlim_cur >= need) return;
+
+	rl.rlim_cur = std::min(need, rl.rlim_max);
+	setrlimit(RLIMIT_NOFILE, &rl);
+	if (rl.rlim_cur < need) {
+		LogError("WARNING!! RLIMIT_NOFILE(%lu) is too small for %d pads.\n", (unsigned long)rl.rlim_cur, num_pads);
+	}
+}
+
+// the pad is returned even if open fails (opened = false), it keeps name:service
+// and reconnects in send().
+static std::unique_ptr<VirtualGamepad> create(const Config &cfg, bool &opened)
+{
+	std::unique_ptr<VirtualGamepad> vgmpad;
+	if (cfg.protocol == "udp") {
+		vgmpad = std::make_unique<VirtualGamepadUDP>();
+#if !defined(_WIN32)
+	} else if (cfg.protocol == "unix") {
+		vgmpad = std::make_unique<VirtualGamepadUnix>();
+	} else if (cfg.protocol == "tcp") {
+		vgmpad = std::make_unique<VirtualGamepadTCP>();
+#endif
+	} else {
+		auto srt = std::make_unique<VirtualGamepadSRT>();
+		srt->SetLatency(cfg.srt_latency);
+		vgmpad = std::move(srt);
+	}
+
+	// a pad down must not stall the other pads of the thread.
+	vgmpad->SetReconnectWait(false);
+	opened = vgmpad->open(cfg.name, cfg.service, VirtualGamepad::em_Mode::SEND);
+
+	return vgmpad;
+}
+
+// pads are sent in order of their phase, every pad once per period.
+static void worker(std::vector<Pad> &pads, const Config &cfg, Counter &cnt,
+	std::chrono::steady_clock::time_point t_start, int index, int stride)
+{
+	using clock = std::chrono::steady_clock;
+
+	auto period = std::chrono::duration<double>(1.0 / cfg.rate);
+	auto slot = period / cfg.num_pads;
+	auto t_end = t_start + std::chrono::duration<double>(cfg.duration);
+
+	for (int64_t round = 0; !signal_recieved; round++) {
+		for (int i = index; i < cfg.num_pads && !signal_recieved; i += stride) {
+			auto deadline = t_start + std::chrono::duration_cast<clock::duration>(period * round + slot * i);
+			if (cfg.duration > 0 && deadline >= t_end) return;
+
+			if (clock::now() > deadline + std::chrono::duration_cast<clock::duration>(period)) cnt.late++;
+			std::this_thread::sleep_until(deadline);
+
+			auto &pad = pads[i];
+			pad.gamepad->Step(period.count());
+			pad.vgmpad->update(pad.gamepad);
+			if (pad.vgmpad->send(0)) cnt.sent++;
+			else cnt.error++;
+		}
+	}
+}
+
+static void print_usage()
+{
+	LogInfo("usage: vgmpad_loadgen [host_name]:port[/protocol] [options]\n");
+	LogInfo("  protocol: srt, udp, tcp, unix (same host). If not specified, it is 'srt'.\n");
+	LogInfo("  --pads N          : number of virtual senders. (default: 1000)\n");
+	LogInfo("  --threads N       : number of sender threads. (default: 4)\n");
+	LogInfo("  --rate HZ         : send rate per pad. (default: 10)\n");
+	LogInfo("  --duration SEC    : 0 runs until SIGINT. (default: 10)\n");
+	LogInfo("  --synthetic SPEC  : synthetic gamepad, pattern[:rate]. (default: mixed:60)\n");
+	LogInfo("  --seed N          : seed of 1st pad, incremented per pad. (default: 1)\n");
+	LogInfo("  --srt-latency MS  : SRTO_LATENCY. (default: libsrt default)\n");
+	LogInfo("  --json [FILE]     : print summary as JSON (to FILE if given).\n");
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	Config cfg;
+	std::tie(cfg.name, cfg.service, cfg.protocol) = VirtualGamepad::get_name_service(argv[1]);
+	if (cfg.name == "" && cfg.service == "" && cfg.protocol == "") {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	bool out_json = false;
+	std::string json_path = "";
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		auto has_next = (i + 1 < argc);
+		if (arg == "--pads" && has_next) {
+			cfg.num_pads = std::stoi(argv[++i]);
+		} else if (arg == "--threads" && has_next) {
+			cfg.num_threads = std::stoi(argv[++i]);
+		} else if (arg == "--rate" && has_next) {
+			cfg.rate = std::stod(argv[++i]);
+		} else if (arg == "--duration" && has_next) {
+			cfg.duration = std::stod(argv[++i]);
+		} else if (arg == "--synthetic" && has_next) {
+			cfg.synthetic = argv[++i];
+		} else if (arg == "--seed" && has_next) {
+			cfg.seed = std::stoul(argv[++i]);
+		} else if (arg == "--srt-latency" && has_next) {
+			cfg.srt_latency = std::stoi(argv[++i]);
+		} else if (arg == "--json") {
+			out_json = true;
+			if (has_next && argv[i + 1][0] != '-') json_path = argv[++i];
+		} else {
+			print_usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (cfg.num_pads <= 0 || cfg.num_threads <= 0 || cfg.rate <= 0 || cfg.duration < 0) {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+	cfg.num_threads = std::min(cfg.num_threads, cfg.num_pads);
+
+	// synthetic pattern and rate. seed is given per pad.
+	auto synthetic = SyntheticGamepad::Create(cfg.synthetic.c_str());
+	if (!synthetic) {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+
+#ifdef USE_SRT
+	if (srt_startup() < 0) {
+		LogError("Unable to initialize SRT: %s\n", srt_getlasterror_str());
+		return EXIT_FAILURE;
+	}
+#endif
+
+	if( signal(SIGINT, sig_handler) == SIG_ERR )
+		LogError("can't catch SIGINT\n");
+
+	raise_fd_limit(cfg.num_pads);
+
+	LogInfo("======== open %d virtual gamepads(%s) %s:%s ========\n",
+		cfg.num_pads, cfg.protocol.c_str(), cfg.name.c_str(), cfg.service.c_str());
+	std::vector<Pad> pads(cfg.num_pads);
+	int open_error = 0;
+	for (int i = 0; i < cfg.num_pads && !signal_recieved; i++) {
+		pads[i].gamepad = std::make_unique<SyntheticGamepad>(synthetic->GetPattern(), synthetic->GetRate(), cfg.seed + i);
+		bool opened = false;
+		pads[i].vgmpad = create(cfg, opened);
+		if (!opened) open_error++;	// retried in send().
+	}
+
+	// run.
+	std::vector<Counter> counters(cfg.num_threads);
+	auto cpu_start = cpu_time();
+	auto t_start = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (int n = 0; n < cfg.num_threads; n++) {
+		threads.emplace_back(worker, std::ref(pads), std::cref(cfg), std::ref(counters[n]), t_start, n, cfg.num_threads);
+	}
+
+	auto total = [&](auto member) {
+		uint64_t sum = 0;
+		for (auto &c : counters) sum += (c.*member).load(std::memory_order_relaxed);
+		return sum;
+	};
+
+	// report every second.
+	uint64_t sent_prev = 0;
+	double cpu_prev = cpu_start;
+	auto t_prev = t_start;
+	auto t_end = t_start + std::chrono::duration<double>(cfg.duration);
+	while (!signal_recieved && (cfg.duration == 0 || std::chrono::steady_clock::now() < t_end)) {
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+
+		auto now = std::chrono::steady_clock::now();
+		auto cpu = cpu_time();
+		auto sent = total(&Counter::sent);
+		double dt = std::chrono::duration<double>(now - t_prev).count();
+		printf("[%6.1f sec] %10.1f pkt/s (target %.1f), cpu %6.1f %% /1000 pads, error %lu, late %lu\n",
+			std::chrono::duration<double>(now - t_start).count(),
+			(sent - sent_prev) / dt, cfg.num_pads * cfg.rate,
+			(cpu - cpu_prev) / dt * 100.0 / (cfg.num_pads / 1000.0),
+			(unsigned long)total(&Counter::error), (unsigned long)total(&Counter::late));
+		fflush(stdout);
+
+		sent_prev = sent;
+		cpu_prev = cpu;
+		t_prev = now;
+	}
+	signal_recieved = true;
+	for (auto &th : threads) th.join();
+
+	auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+	auto cpu_used = cpu_time() - cpu_start;
+	njson summary = {
+		{ "protocol", cfg.protocol },
+		{ "pads", cfg.num_pads },
+		{ "threads", cfg.num_threads },
+		{ "open_error", open_error },
+		{ "rate_per_pad", cfg.rate },
+		{ "elapsed_sec", elapsed },
+		{ "sent", total(&Counter::sent) },
+		{ "send_error", total(&Counter::error) },
+		{ "late", total(&Counter::late) },
+		{ "pkt_per_sec", total(&Counter::sent) / elapsed },
+		{ "target_pkt_per_sec", cfg.num_pads * cfg.rate },
+		{ "cpu_percent", cpu_used / elapsed * 100.0 },
+		{ "cpu_percent_per_1000_pads", cpu_used / elapsed * 100.0 / (cfg.num_pads / 1000.0) },
+	};
+
+	pads.clear();
+
+#ifdef USE_SRT
+	srt_cleanup();
+#endif
+
+	if (!out_json) {
+		printf("======== summary ========\n");
+		for (auto &[key, val] : summary.items()) {
+			std::cout << key << " = " << val << std::endl;
+		}
+	} else if (json_path == "") {
+		std::cout << std::setw(2) << summary << std::endl;
+	} else {
+		std::ofstream ofs(json_path);
+		ofs << std::setw(2) << summary << std::endl;
+		if (!ofs) {
+			LogError("ERROR!! can't write %s\n", json_path.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
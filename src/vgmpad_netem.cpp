@@ -0,0 +1,355 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <cstdlib>
+#include <vector>
+#include <queue>
+#include <random>
+
+#include <chrono>
+#include <thread>
+#include <signal.h>
+#include <poll.h>
+
+#ifdef USE_SRT
+#include <srt.h>
+#endif
+#include "VirtualGamepad.h"
+
+// userspace UDP proxy with network impairment, like 'tc qdisc netem' but no root needed.
+//
+//   sender --> [listen] vgmpad_netem [upstream] --> receiver
+//          <--                                  <--
+//
+// SRT runs on UDP, so this works for both '/udp' and '/srt'.
+
+static bool signal_recieved = false;
+
+static void sig_handler(int signo)
+{
+	// only the flag, no log: not async-signal-safe.
+	if( signo == SIGINT )
+	{
+		signal_recieved = true;
+	}
+}
+
+struct Impairment {
+	double loss = 0.0;		// [%].
+	double loss_corr = 0.0;	// [%]. probability to repeat previous loss decision (burst).
+	double delay = 0.0;		// [msec].
+	double jitter = 0.0;	// [msec]. normal distribution, sigma.
+	double dup = 0.0;		// [%].
+	double reorder = 0.0;	// [%].
+	double reorder_gap = 0.0;	// [msec]. extra hold of reordered packet. 0: auto.
+	bool keep_order = false;	// jitter does not reorder.
+};
+
+struct Direction {
+	std::string label;
+	Impairment imp;
+	std::mt19937 rng;
+	bool last_lost = false;
+	std::chrono::steady_clock::time_point last_release;
+
+	// statistics.
+	uint64_t in = 0;
+	uint64_t out = 0;
+	uint64_t lost = 0;
+	uint64_t duplicated = 0;
+	uint64_t reordered = 0;
+
+	double uniform() { return std::uniform_real_distribution<double>(0.0, 100.0)(rng); }
+};
+
+struct Packet {
+	std::chrono::steady_clock::time_point release;
+	uint64_t order;
+	int dir;	// 0: forward(listen -> upstream), 1: backward.
+	std::vector<char> data;
+
+	bool operator>(const Packet &rhs) const
+	{
+		return (release != rhs.release) ? release > rhs.release : order > rhs.order;
+	}
+};
+
+static addrinfo *resolve(const std::string &name, const std::string &service, bool passive)
+{
+	addrinfo fo = {
+		passive ? AI_PASSIVE : 0,
+		AF_UNSPEC,
+		SOCK_DGRAM, IPPROTO_UDP,
+		0, 0,
+		NULL, NULL
+	};
+	addrinfo *ai = nullptr;
+	const char *n = (name.empty()) ? nullptr : name.c_str();
+	const char *s = (service.empty()) ? nullptr : service.c_str();
+	int erc = getaddrinfo(n, s, &fo, &ai);
+	if (erc != 0) {
+		LogError("ERROR!! getaddrinfo(errno=%d): name=%s, service=%s.\n", erc, name.c_str(), service.c_str());
+		return nullptr;
+	}
+
+	return ai;
+}
+
+static void print_stat(const Direction &d)
+{
+	LogInfo("%-9s in %8lu, out %8lu, lost %8lu, dup %8lu, reorder %8lu\n", d.label.c_str(),
+		(unsigned long)d.in, (unsigned long)d.out, (unsigned long)d.lost,
+		(unsigned long)d.duplicated, (unsigned long)d.reordered);
+}
+
+static void print_usage()
+{
+	LogInfo("usage: vgmpad_netem [listen_host]:port target_host:port [options]\n");
+	LogInfo("  impairment (both directions, unless prefixed by --fwd- / --bwd-, e.g. --fwd-loss 5):\n");
+	LogInfo("  --loss PCT        : packet loss.\n");
+	LogInfo("  --loss-corr PCT   : loss correlation, makes burst loss.\n");
+	LogInfo("  --delay MS        : constant delay.\n");
+	LogInfo("  --jitter MS       : delay variation (normal distribution, sigma).\n");
+	LogInfo("  --dup PCT         : duplication.\n");
+	LogInfo("  --reorder PCT     : held back packets, overtaken by following packets.\n");
+	LogInfo("  --reorder-gap MS  : hold time of reordered packet. (default: delay + 3 * jitter + 5)\n");
+	LogInfo("  --keep-order      : jitter does not reorder packets.\n");
+	LogInfo("  --seed N          : random seed. (default: 1)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3) {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	auto [ listen_name, listen_service, listen_protocol ] = VirtualGamepad::get_name_service(argv[1]);
+	auto [ target_name, target_service, target_protocol ] = VirtualGamepad::get_name_service(argv[2]);
+	if (listen_service == "" || target_name == "" || target_service == "") {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	Direction dir[2];
+	dir[0].label = "forward";
+	dir[1].label = "backward";
+	uint32_t seed = 1;
+	for (int i = 3; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--keep-order") {
+			dir[0].imp.keep_order = dir[1].imp.keep_order = true;
+			continue;
+		}
+		if (i + 1 >= argc) {
+			print_usage();
+			exit(EXIT_FAILURE);
+		}
+		if (arg == "--seed") {
+			char *end = nullptr;
+			seed = std::strtoul(argv[++i], &end, 10);
+			if (end == argv[i] || *end != '\0') {
+				print_usage();
+				exit(EXIT_FAILURE);
+			}
+			continue;
+		}
+
+		// which direction.
+		std::vector<Impairment *> imps = { &dir[0].imp, &dir[1].imp };
+		if (arg.rfind("--fwd-", 0) == 0) {
+			imps = { &dir[0].imp };
+			arg = "--" + arg.substr(6);
+		} else if (arg.rfind("--bwd-", 0) == 0) {
+			imps = { &dir[1].imp };
+			arg = "--" + arg.substr(6);
+		}
+
+		char *end = nullptr;
+		double val = std::strtod(argv[++i], &end);
+		if (end == argv[i] || *end != '\0') {
+			print_usage();
+			exit(EXIT_FAILURE);
+		}
+		for (auto imp : imps) {
+			if (arg == "--loss") imp->loss = val;
+			else if (arg == "--loss-corr") imp->loss_corr = val;
+			else if (arg == "--delay") imp->delay = val;
+			else if (arg == "--jitter") imp->jitter = val;
+			else if (arg == "--dup") imp->dup = val;
+			else if (arg == "--reorder") imp->reorder = val;
+			else if (arg == "--reorder-gap") imp->reorder_gap = val;
+			else {
+				print_usage();
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+	dir[0].rng.seed(seed);
+	dir[1].rng.seed(seed + 1);
+	for (auto &d : dir) {
+		if (d.imp.reorder_gap <= 0.0) d.imp.reorder_gap = d.imp.delay + 3.0 * d.imp.jitter + 5.0;
+	}
+
+	if( signal(SIGINT, sig_handler) == SIG_ERR )
+		LogError("can't catch SIGINT\n");
+
+	// sockets.
+	auto ai_listen = resolve(listen_name, listen_service, true);
+	auto ai_target = resolve(target_name, target_service, false);
+	if (!ai_listen || !ai_target) return EXIT_FAILURE;
+
+	int sock[2];
+	sock[0] = socket(ai_listen->ai_family, SOCK_DGRAM, 0);
+	sock[1] = socket(ai_target->ai_family, SOCK_DGRAM, 0);
+	if (sock[0] < 0 || sock[1] < 0) {
+		LogError("ERROR!! create socket\n");
+		return EXIT_FAILURE;
+	}
+	int yes = 1;
+	setsockopt(sock[0], SOL_SOCKET, SO_REUSEADDR, (const char*)&yes, sizeof yes);
+	if (::bind(sock[0], ai_listen->ai_addr, ai_listen->ai_addrlen) != 0) {
+		LogError("ERROR!! bind %s:%s\n", listen_name.c_str(), listen_service.c_str());
+		return EXIT_FAILURE;
+	}
+	for (auto s : sock) {
+		if (ioctl(s, FIONBIO, (const char *)&yes) < 0) {
+			LogError("ERROR!! ioctl FIONBIO\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	sockaddr_storage peer = {};	// latest sender on listen side.
+	socklen_t peer_len = 0;
+
+	LogInfo("======== vgmpad_netem %s:%s --> %s:%s ========\n",
+		listen_name.c_str(), listen_service.c_str(), target_name.c_str(), target_service.c_str());
+	for (auto &d : dir) {
+		LogInfo("%-9s loss %.2f%% (corr %.1f%%), delay %.1f ms, jitter %.1f ms, dup %.2f%%, reorder %.2f%% (gap %.1f ms)%s\n",
+			d.label.c_str(), d.imp.loss, d.imp.loss_corr, d.imp.delay, d.imp.jitter,
+			d.imp.dup, d.imp.reorder, d.imp.reorder_gap, d.imp.keep_order ? ", keep order" : "");
+	}
+
+	using clock = std::chrono::steady_clock;
+	std::priority_queue<Packet, std::vector<Packet>, std::greater<Packet>> queue;
+	uint64_t order = 0;
+
+	auto schedule = [&](int n, std::vector<char> &&data) {
+		auto &d = dir[n];
+		auto &imp = d.imp;
+		auto now = clock::now();
+		d.in++;
+
+		// loss.
+		bool lost = (imp.loss_corr > 0.0 && d.uniform() < imp.loss_corr) ? d.last_lost : (d.uniform() < imp.loss);
+		d.last_lost = lost;
+		if (lost) {
+			d.lost++;
+			return;
+		}
+
+		int copies = (d.uniform() < imp.dup) ? 2 : 1;
+		if (copies == 2) d.duplicated++;
+
+		for (int c = 0; c < copies; c++) {
+			double ms = imp.delay;
+			if (imp.jitter > 0.0) ms += std::normal_distribution<double>(0.0, imp.jitter)(d.rng);
+			ms = std::max(0.0, ms);
+
+			auto release = now + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(ms));
+			if (imp.keep_order) release = std::max(release, d.last_release);
+			if (d.uniform() < imp.reorder) {
+				release += std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(imp.reorder_gap));
+				d.reordered++;
+			} else {
+				d.last_release = std::max(d.last_release, release);
+			}
+
+			queue.push({ release, order++, n, (c + 1 < copies) ? data : std::move(data) });
+		}
+	};
+
+	std::vector<char> buf(65536);
+	auto t_stat = clock::now();
+	while (!signal_recieved) {
+		// wait until next release or packet.
+		int timeout = 100;
+		if (!queue.empty()) {
+			auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(queue.top().release - clock::now()).count();
+			timeout = int(std::clamp<int64_t>(wait, 0, 100));
+		}
+		pollfd pfd[2] = { { sock[0], POLLIN, 0 }, { sock[1], POLLIN, 0 } };
+		::poll(pfd, 2, timeout);
+
+		// receive.
+		for (int n = 0; n < 2; n++) {
+			while (true) {
+				sockaddr_storage from = {};
+				socklen_t from_len = sizeof(from);
+				auto len = recvfrom(sock[n], buf.data(), buf.size(), 0, (sockaddr *)&from, &from_len);
+				if (len < 0) break;
+
+				if (n == 0) {
+					peer = from;
+					peer_len = from_len;
+				}
+				schedule(n, std::vector<char>(buf.begin(), buf.begin() + len));
+			}
+		}
+
+		// release.
+		auto now = clock::now();
+		while (!queue.empty() && queue.top().release <= now) {
+			auto &pkt = queue.top();
+			auto &d = dir[pkt.dir];
+			ssize_t stat;
+			if (pkt.dir == 0) {
+				stat = sendto(sock[1], pkt.data.data(), pkt.data.size(), 0, ai_target->ai_addr, ai_target->ai_addrlen);
+			} else if (peer_len > 0) {
+				stat = sendto(sock[0], pkt.data.data(), pkt.data.size(), 0, (sockaddr *)&peer, peer_len);
+			} else {
+				stat = -1;
+			}
+			if (stat >= 0) d.out++;
+			queue.pop();
+		}
+
+		if (now - t_stat >= std::chrono::seconds(5)) {
+			for (auto &d : dir) print_stat(d);
+			t_stat = now;
+		}
+	}
+
+	LogInfo("======== statistics ========\n");
+	for (auto &d : dir) print_stat(d);
+
+	::close(sock[0]);
+	::close(sock[1]);
+	freeaddrinfo(ai_listen);
+	freeaddrinfo(ai_target);
+
+	return EXIT_SUCCESS;
+}
@@ -47,26 +47,89 @@ namespace fs = std::filesystem;
 #include <srt.h>
 #endif
 #include "VirtualGamepad.h"
+#include "GamepadRecord.h"
+#include "OutputSink.h"
+#include "SharedState.h"
+#include "JitterBuffer.h"
 
 auto Usleep = [](uint64_t t) -> void {
 	std::this_thread::sleep_for(std::chrono::microseconds(t));
 };
 
+static constexpr int64_t JITTER_TICK = 2'000;	// [usec], receive loop with --jitter-buffer.
+
 static bool signal_recieved = false;
+static volatile sig_atomic_t trace_dump_requested = 0;
 
 static void sig_handler(int signo)
 {
+	// only the flag, no log: not async-signal-safe.
 	if( signo == SIGINT )
 	{
-		LogVerbose("received SIGINT\n");
 		signal_recieved = true;
 	}
+	else if( signo == SIGUSR1 )
+	{
+		trace_dump_requested = 1;
+	}
 }
 
 static void print_usage()
 {
 	LogInfo("usage: vgmpad_recv [host_name]:port[/protocol]\n");
-	LogInfo("  protocol: srt, udp. If not specified, it is 'srt'.\n");
+	LogInfo("  protocol: srt, udp, tcp, unix (same host). If not specified, it is 'srt'.\n");
+	LogInfo("  --srt-latency MS : SRT latency. (default: libsrt default, 120)\n");
+	LogInfo("  --rendezvous HOST:PORT : punch a direct path, through vgmpad_rendezvous at HOST:PORT.\n");
+	LogInfo("      udp, srt only. frames through the relay arrive at the port above, until / unless punching succeeds.\n");
+	LogInfo("  --session ID : pairs the sender and the receiver at the rendezvous server.\n");
+	LogInfo("  --punch-timeout MS : give up punching after MS. (default: 5000)\n");
+	LogInfo("  --output SINK : where the received state is written. (default: pretty)\n");
+	LogInfo("      pretty         : pretty printed JSON to stdout every loop.\n");
+	LogInfo("      ndjson[:PATH]  : compact JSON per line every loop, buffered.\n");
+	LogInfo("      changes[:PATH] : compact JSON per line, only when sticks or buttons changed.\n");
+	LogInfo("      binary[:PATH]  : 64 bytes GamepadRecord per new frame, to a file, FIFO or pipe.\n");
+	LogInfo("      none           : nothing.\n");
+	LogInfo("  --jitter-buffer [MAX_MS] : output frames at the pace they were sent, delayed by the measured jitter,\n");
+	LogInfo("      at most MAX_MS. (default: 50) output, --shm get the frames as played out, --record as arrived.\n");
+	LogInfo("  --record FILE : record every frame to FILE (binary, see GamepadRecord.h).\n");
+	LogInfo("  --shm NAME : publish every frame to POSIX shared memory NAME (e.g. /vgmpad, see SharedState.h).\n");
+	LogInfo("  --trace FILE : record spans of the loop, write Chrome trace JSON to FILE at exit or on SIGUSR1.\n");
+	LogInfo("      (needs build with -DVGMPAD_TRACE=YES)\n");
+	LogInfo("  --metrics-file PATH : write metrics (Prometheus text format) to PATH every second.\n");
+	LogInfo("  --metrics-port N : serve metrics at http://127.0.0.1:N/metrics .\n");
+	LogInfo("  --stages : print per-stage latency breakdown at exit.\n");
+}
+
+// jitter buffer in the metrics, next to the counters of the session.
+static void add_jitter_metrics(VirtualGamepadMetrics::Snapshot &s, const JitterBuffer &jitter)
+{
+	if (!jitter.IsEnabled()) return;
+
+	s.gauges["jitter_target_us"] = jitter.GetTarget();
+	s.counters["jitter_late"] = jitter.GetLate();
+}
+
+static void print_stages(const VirtualGamepadMetrics::Snapshot &s)
+{
+	LogInfo("%-8s | %10s %10s %10s %10s\n", "stage", "count", "p50[us]", "p99[us]", "max[us]");
+	for (auto name : { "input", "queue", "encode", "wire", "socket", "decode", "output", "total" }) {
+		auto itr = s.histograms.find(std::string("stage_") + name + "_us");
+		if (itr == s.histograms.end() || itr->second.count == 0) continue;
+		auto &h = itr->second;
+		LogInfo("%-8s | %10lu %10ld %10ld %10ld\n", name, h.count, h.percentile(0.50), h.percentile(0.99), h.max);
+	}
+	auto offset = s.gauges.find("clock_offset_us");
+	auto rtt = s.gauges.find("clock_rtt_us");
+	if (offset != s.gauges.end() && rtt != s.gauges.end()) {
+		LogInfo("clock offset (sender - receiver): %.0f [us], rtt: %.0f [us]\n", offset->second, rtt->second);
+	} else {
+		LogInfo("clock offset: not estimated, no answer to ping. (sender time stamps are used as is)\n");
+	}
+	auto target = s.gauges.find("jitter_target_us");
+	auto late = s.counters.find("jitter_late");
+	if (target != s.gauges.end() && late != s.counters.end()) {
+		LogInfo("jitter buffer target: %.0f [us], late: %lu\n", target->second, late->second);
+	}
 }
 
 int main(int argc, char *argv[])
@@ -82,6 +145,64 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
+	std::string metrics_file;
+	int metrics_port = 0;
+	int srt_latency = -1;
+	rendezvous::Config rdv;
+	std::string trace_file;
+	std::string record_file;
+	std::string shm_name;
+	std::string output = "pretty";
+	bool stages = false;
+	double jitter_ms = 0.0;
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		auto has_next = (i + 1 < argc);
+		if (arg == "--srt-latency" && has_next) {
+			srt_latency = std::atoi(argv[++i]);
+		} else if (arg == "--rendezvous" && has_next) {
+			if (!rdv.set_server(argv[++i])) {
+				print_usage();
+				exit(EXIT_FAILURE);
+			}
+		} else if (arg == "--session" && has_next) {
+			rdv.session = argv[++i];
+		} else if (arg == "--punch-timeout" && has_next) {
+			rdv.timeout = std::atoi(argv[++i]);
+		} else if (arg == "--output" && has_next) {
+			output = argv[++i];
+		} else if (arg == "--jitter-buffer") {
+			jitter_ms = (has_next && argv[i + 1][0] != '-') ? std::atof(argv[++i]) : 50.0;
+			if (jitter_ms <= 0.0) {
+				print_usage();
+				exit(EXIT_FAILURE);
+			}
+		} else if (arg == "--record" && has_next) {
+			record_file = argv[++i];
+		} else if (arg == "--shm" && has_next) {
+			shm_name = argv[++i];
+		} else if (arg == "--trace" && has_next) {
+			trace_file = argv[++i];
+		} else if (arg == "--metrics-file" && has_next) {
+			metrics_file = argv[++i];
+		} else if (arg == "--metrics-port" && has_next) {
+			metrics_port = std::atoi(argv[++i]);
+		} else if (arg == "--stages") {
+			stages = true;
+		} else {
+			print_usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (rdv.service.empty() != rdv.session.empty()) {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+	if (rdv.enabled() && protocol != "udp" && protocol != "srt") {
+		LogError("ERROR!! --rendezvous needs udp or srt.\n");
+		exit(EXIT_FAILURE);
+	}
+
 	if (SDL_Init(SDL_INIT_GAMECONTROLLER | SDL_INIT_VIDEO) != 0) {
 		LogError("Unable to initialize SDL: %s\n", SDL_GetError());
 		return EXIT_FAILURE;
@@ -100,30 +221,187 @@ int main(int argc, char *argv[])
 	 */
 	if( signal(SIGINT, sig_handler) == SIG_ERR )
 		LogError("can't catch SIGINT\n");
+	if( signal(SIGUSR1, sig_handler) == SIG_ERR )
+		LogError("can't catch SIGUSR1\n");
+	// reader of --output pipe may go away.
+	signal(SIGPIPE, SIG_IGN);
+
+	if (!trace_file.empty()) {
+#if defined(VGMPAD_TRACE)
+		Trace::start(trace_file);
+		Trace::set_thread_name("vgmpad_recv");
+#else
+		LogError("WARNING!! built without VGMPAD_TRACE, --trace is ignored.\n");
+#endif
+	}
 
 	std::unique_ptr<VirtualGamepad> vgmpad;
 	if (protocol == "udp") {
-		vgmpad = VirtualGamepadUDP::Create(name, service, VirtualGamepad::em_Mode::RECEIVE);
+		vgmpad = VirtualGamepadUDP::Create(name, service, VirtualGamepad::em_Mode::RECEIVE, rdv);
+#if !defined(_WIN32)
+	} else if (protocol == "unix") {
+		vgmpad = VirtualGamepadUnix::Create(name, service, VirtualGamepad::em_Mode::RECEIVE);
+	} else if (protocol == "tcp") {
+		vgmpad = VirtualGamepadTCP::Create(name, service, VirtualGamepad::em_Mode::RECEIVE);
+#endif
 	} else {
-		vgmpad = VirtualGamepadSRT::Create(name, service, VirtualGamepad::em_Mode::RECEIVE);
+		vgmpad = VirtualGamepadSRT::Create(name, service, VirtualGamepad::em_Mode::RECEIVE, srt_latency, rdv);
 	}
 	if (!vgmpad) {
 		LogError("ERROR!! create virtual gamepad.\n");
 		return EXIT_FAILURE;
 	}
-    njson js;
+
+	auto sink = OutputSink::Create(output);
+	if (!sink) {
+		LogError("ERROR!! output %s\n", output.c_str());
+		print_usage();
+		return EXIT_FAILURE;
+	}
+
+	GamepadRecordWriter recorder;
+	if (!record_file.empty()) {
+		if (!recorder.open(record_file, argv[1], true)) {
+			LogError("ERROR!! open record file %s\n", record_file.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+
+	SharedStateWriter shm;
+	if (!shm_name.empty()) {
+		if (!shm.open(shm_name, argv[1])) {
+			if (errno == EBUSY) {
+				LogError("ERROR!! open shared memory %s: in use by pid %d\n", shm_name.c_str(), int(shm.GetOwner()));
+			} else {
+				LogError("ERROR!! open shared memory %s: %s\n", shm_name.c_str(), strerror(errno));
+			}
+			return EXIT_FAILURE;
+		}
+	}
+
+	JitterBuffer jitter(jitter_ms * 1000.0);
+	GamepadState playout = {};	// last frame played out by the jitter buffer.
+
+	MetricsExporter metrics;
+	if (!metrics_file.empty() || metrics_port > 0) {
+		auto labels = "mode=\"recv\",protocol=\"" + protocol + "\"";
+		auto source = [&vgmpad, &jitter, labels]() -> std::string {
+			auto s = vgmpad->GetMetricsSnapshot();
+			add_jitter_metrics(s, jitter);
+			return VirtualGamepadMetrics::to_prometheus(s, labels);
+		};
+		if (!metrics.start(source, metrics_file, metrics_port)) {
+			LogError("ERROR!! start metrics exporter.\n");
+			return EXIT_FAILURE;
+		}
+	}
+	uint32_t seq_last = vgmpad->GetSeq();
 	while (!signal_recieved) {
-		int64_t time_out = 33; // [msec].
-		vgmpad->Poll(time_out);
+		TRACE_SCOPE("frame");
+		{
+			TRACE_SCOPE("receive");
+			int64_t time_out = jitter.IsEnabled() ? 0 : 33; // [msec].
+			vgmpad->Poll(time_out);
+		}
+
+		// button events, each one to the event ring, even if released in the same poll.
+		if (shm.IsOpen() && !vgmpad->GetEvents().empty()) {
+			auto t_recv = VirtualGamepad::get_time_us();
+			for (auto &e : vgmpad->GetEvents()) {
+				auto state = vgmpad->get_state();
+				state.buttons = e.buttons;
+				state.flags = e.down ? GamepadState::FLAG_BUTTON_DOWN : GamepadState::FLAG_BUTTON_UP;
+				shm.publish(vgmpad->GetSeq(), vgmpad->GetClock().to_local(e.ts), t_recv, state);
+			}
+		}
+
+		// lost frames, rebuilt from the previous states carried in a new frame, or
+		// by parity (FEC) after newer ones, also without a new frame. the older ones
+		// don't move the latest state of --shm back (events only), and aren't
+		// recorded after newer frames.
+		auto &clock = vgmpad->GetClock();
+		for (auto &r : vgmpad->GetRecovered()) {
+			if (jitter.IsEnabled()) {
+				jitter.push({ r.seq, clock.to_sender(r.ts_send), vgmpad->GetRecvTime(), r.state }, false);
+			} else if (shm.IsOpen()) {
+				shm.publish(r.seq, r.ts_send, vgmpad->GetRecvTime(), r.state);
+			}
+			if (recorder.IsOpen() && int32_t(r.seq - seq_last) > 0) recorder.write(r.seq, r.ts_send, vgmpad->GetRecvTime(), r.state);
+		}
+
+		// new frame.
+		if (vgmpad->GetSeq() != seq_last) {
+			seq_last = vgmpad->GetSeq();
 
-		// std::cout << vgmpad << std::endl;
-		to_json(js, *vgmpad);
-		std::cout << std::setw(2) << js << std::endl;
+			auto state = vgmpad->get_state();
+			auto frame = state;
+			if (!vgmpad->GetEvents().empty()) {
+				// published one by one above.
+				frame.flags &= ~(GamepadState::FLAG_BUTTON_DOWN | GamepadState::FLAG_BUTTON_UP);
+			}
+			if (jitter.IsEnabled()) {
+				jitter.push({ seq_last, clock.to_sender(vgmpad->GetSendTime()), vgmpad->GetRecvTime(), frame });
+			} else if (shm.IsOpen()) {
+				TRACE_SCOPE("publish");
+				shm.publish(seq_last, vgmpad->GetSendTime(), vgmpad->GetRecvTime(), frame);
+			}
+			if (recorder.IsOpen()) {
+				TRACE_SCOPE("record");
+				recorder.write(seq_last, vgmpad->GetSendTime(), vgmpad->GetRecvTime(), state);
+			}
+		}
 
-		auto fps = 30.0;
-		Usleep((1.0 / fps) * 1'000'000.0);
+		// frames due, at the pace they were sent. the sink is written per frame played,
+		// with its own seq and time stamps.
+		if (jitter.IsEnabled()) {
+			TRACE_SCOPE("jitter");
+			JitterBuffer::Frame f;
+			while (jitter.pop(VirtualGamepad::get_time_us(), f)) {
+				if (shm.IsOpen()) shm.publish(f.seq, clock.to_local(f.ts_send), f.ts_recv, f.state);
+				playout = f.state;
+				vgmpad->set_state(playout);
+				TRACE_SCOPE("output");
+				sink->write(*vgmpad, { f.seq, clock.to_local(f.ts_send), f.ts_recv });
+				if (f.seq == vgmpad->GetSeq()) vgmpad->MarkOutput();
+			}
+			vgmpad->set_state(playout);
+		} else {
+			TRACE_SCOPE("output");
+			sink->write(*vgmpad, OutputSink::Latest(*vgmpad));
+			vgmpad->MarkOutput();
+		}
+		sink->flush();
+
+		if (trace_dump_requested) {
+			trace_dump_requested = 0;
+			Trace::dump();
+		}
+
+		TRACE_SCOPE("sleep");
+		if (jitter.IsEnabled()) {
+			// until the next frame is due, new frames are looked for every JITTER_TICK.
+			auto next = jitter.next();
+			auto wait = next ? next - VirtualGamepad::get_time_us() : JITTER_TICK;
+			Usleep(std::clamp<int64_t>(wait, 0, JITTER_TICK));
+		} else {
+			auto fps = 30.0;
+			Usleep((1.0 / fps) * 1'000'000.0);
+		}
 	}
 
+	metrics.stop();
+	sink.reset();
+	shm.close();
+	recorder.close();
+	if (Trace::enabled()) Trace::dump();
+	if (stages) {
+		auto s = vgmpad->GetMetricsSnapshot();
+		add_jitter_metrics(s, jitter);
+		print_stages(s);
+	}
+
+	vgmpad.reset();	// close before srt_cleanup().
+
 #ifdef USE_SRT
 	if (srt_cleanup() != 0) {
 		LogError("Unable to cleanup SRT: %s\n", srt_getlasterror_str());
@@ -0,0 +1,200 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+// rendezvous server for hole punching, see Rendezvous.h.
+// tells the sender and the receiver of a session each other's public address.
+// it sees only the register messages, frames never go through it.
+
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <map>
+
+#include <chrono>
+#include <signal.h>
+
+#include "json.hpp"
+#include "Logger.h"
+#include "Rendezvous.h"
+
+using njson = nlohmann::json;
+
+static bool signal_recieved = false;
+
+static void sig_handler(int signo)
+{
+	// only the flag, no log: not async-signal-safe.
+	if( signo == SIGINT )
+	{
+		signal_recieved = true;
+	}
+}
+
+static void print_usage()
+{
+	LogInfo("usage: vgmpad_rendezvous [host_name]:port [options]\n");
+	LogInfo("  --ttl SEC : forget a side which doesn't register again in SEC. (default: 30)\n");
+}
+
+// a registered side of a session.
+struct Member
+{
+	struct sockaddr_storage addr = {};
+	socklen_t addrlen = 0;
+	std::chrono::steady_clock::time_point last;
+};
+
+static bool send_peer(int sock, const std::string &session, const Member &to, const Member &peer)
+{
+	auto [ host, port ] = rendezvous::host_port(peer.addr);
+	auto js = rendezvous::message("peer", session);
+	js["rdv"]["addr"] = host;
+	js["rdv"]["port"] = port;
+	js["rdv"]["you"] = rendezvous::to_string(to.addr);
+
+	return rendezvous::send_message(sock, js, to.addr, to.addrlen);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	std::string arg1 = argv[1];
+	auto pos = arg1.rfind(':');
+	if (pos == std::string::npos) {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+	std::string name = arg1.substr(0, pos);
+	std::string service = arg1.substr(pos + 1);
+
+	int ttl = 30;
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		auto has_next = (i + 1 < argc);
+		if (arg == "--ttl" && has_next) {
+			ttl = std::atoi(argv[++i]);
+		} else {
+			print_usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (ttl <= 0) {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if( signal(SIGINT, sig_handler) == SIG_ERR )
+		LogError("can't catch SIGINT\n");
+
+	struct addrinfo hints = {};
+	hints.ai_flags = AI_PASSIVE;
+	hints.ai_socktype = SOCK_DGRAM;
+	struct addrinfo *ai = nullptr;
+	int erc = getaddrinfo(name.empty() ? nullptr : name.c_str(), service.c_str(), &hints, &ai);
+	if (erc != 0) {
+		LogError("ERROR!! getaddrinfo(errno=%d): name=%s, service=%s.\n", erc, name.c_str(), service.c_str());
+		return EXIT_FAILURE;
+	}
+	int sock = socket(ai->ai_family, ai->ai_socktype, 0);
+	if (sock < 0 || ::bind(sock, ai->ai_addr, ai->ai_addrlen) != 0) {
+		LogError("ERROR!! bind %s:%s\n", name.c_str(), service.c_str());
+		return EXIT_FAILURE;
+	}
+	freeaddrinfo(ai);
+	LogInfo("rendezvous server on %s:%s\n", name.c_str(), service.c_str());
+
+	// session -> role ("send", "recv") -> member.
+	std::map<std::string, std::map<std::string, Member>> sessions;
+	auto expire = std::chrono::seconds(ttl);
+	auto last_sweep = std::chrono::steady_clock::now();
+
+	std::vector<char> pkt(rendezvous::MAX_PACKET);
+	while (!signal_recieved) {
+#if defined(_WIN32)
+		WSAPOLLFD pfd = { SOCKET(sock), POLLIN, 0 };
+		int n = WSAPoll(&pfd, 1, 1000);
+#else
+		struct pollfd pfd = { sock, POLLIN, 0 };
+		int n = ::poll(&pfd, 1, 1000);
+#endif
+		auto now = std::chrono::steady_clock::now();
+
+		if (now - last_sweep >= std::chrono::seconds(1)) {
+			last_sweep = now;
+			for (auto itr = sessions.begin(); itr != sessions.end(); ) {
+				auto &members = itr->second;
+				for (auto m = members.begin(); m != members.end(); ) {
+					if (now - m->second.last >= expire) {
+						LogInfo("%s/%s: expired.\n", itr->first.c_str(), m->first.c_str());
+						m = members.erase(m);
+					} else {
+						++m;
+					}
+				}
+				itr = members.empty() ? sessions.erase(itr) : std::next(itr);
+			}
+		}
+		if (n <= 0) continue;
+
+		struct sockaddr_storage from;
+		socklen_t fromlen = sizeof from;
+		const int stat = recvfrom(sock, pkt.data(), int(pkt.size()), 0, (struct sockaddr *)&from, &fromlen);
+		if (stat <= 0) continue;
+
+		njson msg;
+		if (!rendezvous::decode_message(pkt.data(), stat, msg)) continue;
+		if (rendezvous::get_string(msg, "op") != "register") continue;
+		auto session = rendezvous::get_string(msg, "session");
+		auto role = rendezvous::get_string(msg, "role");
+		if (session.empty() || (role != "send" && role != "recv")) continue;
+
+		auto &members = sessions[session];
+		auto &self = members[role];
+		if (!rendezvous::same_address(self.addr, self.addrlen, from, fromlen)) {
+			LogInfo("%s/%s: %s\n", session.c_str(), role.c_str(), rendezvous::to_string(from).c_str());
+		}
+		memcpy(&self.addr, &from, fromlen);
+		self.addrlen = fromlen;
+		self.last = now;
+
+		// both sides are here, tell each other. the other side may wait after a
+		// failed attempt, it's told now to punch again.
+		auto other = members.find(role == "send" ? "recv" : "send");
+		if (other == members.end()) continue;
+		send_peer(sock, session, self, other->second);
+		send_peer(sock, session, other->second, self);
+	}
+
+#ifdef _WIN32
+	::closesocket(sock);
+#else
+	::close(sock);
+#endif
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,356 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+// replay recorded frames to a receiver.
+//   input: binary recording (vgmpad_send/vgmpad_recv --record), or
+//          captured stdout of vgmpad_send/vgmpad_recv (JSON frames).
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <chrono>
+#include <thread>
+#include <signal.h>
+
+#ifdef USE_SRT
+#include <srt.h>
+#endif
+#include "VirtualGamepad.h"
+#include "GamepadRecord.h"
+#include "GamepadArchive.h"
+#include "JsonFrames.h"
+
+static bool signal_recieved = false;
+
+static void sig_handler(int signo)
+{
+	// only the flag, no log: not async-signal-safe.
+	if( signo == SIGINT )
+	{
+		signal_recieved = true;
+	}
+}
+
+struct Frame {
+	int64_t t;	// time from the first frame [usec].
+	GamepadState state;
+};
+
+static void print_usage()
+{
+	LogInfo("usage: vgmpad_replay INPUT [host_name]:port[/protocol] [options]\n");
+	LogInfo("  INPUT   : binary recording (--record of vgmpad_send/vgmpad_recv), archive (vgmpad_archive pack),\n");
+	LogInfo("            or captured stdout of vgmpad_send/vgmpad_recv.\n");
+	LogInfo("  protocol: srt, udp, tcp, unix (same host). If not specified, it is 'srt'.\n");
+	LogInfo("  --speed X        : 1 = original timing, 2 = twice as fast, max = as fast as possible. (default: 1)\n");
+	LogInfo("  --step           : send one frame per Enter key.\n");
+	LogInfo("  --fps N          : frame rate of captured stdout, which has no time stamp. (default: 30)\n");
+	LogInfo("  --from SEC       : start at SEC from the beginning.\n");
+	LogInfo("  --to SEC         : stop at SEC from the beginning.\n");
+	LogInfo("  --loop N         : repeat N times, 0 = forever. (default: 1)\n");
+	LogInfo("  --srt-latency MS : SRT latency.\n");
+	LogInfo("  --rendezvous HOST:PORT : punch a direct path, through vgmpad_rendezvous (udp, srt).\n");
+	LogInfo("  --session ID     : pairs the sender and the receiver at the rendezvous server.\n");
+	LogInfo("  --path HOST:PORT : send each frame to HOST:PORT too (udp), repeat for more paths.\n");
+	LogInfo("  --fec K[:M]      : M parity packets per K frames (udp), K = auto: adaptive to loss.\n");
+	LogInfo("  --history N      : carry the previous N states (<= 12) in each frame.\n");
+}
+
+// binary recording. time is taken from the record time stamp.
+static bool load_record(const std::string &path, double from, double to, std::vector<Frame> &frames)
+{
+	GamepadRecordReader reader;
+	if (!reader.open(path)) return false;
+
+	auto first = reader.next_frame(0);
+	if (first >= reader.slots()) return true;
+	auto ts0 = reader[first].ts;
+
+	// seek by index.
+	auto slot = reader.find(ts0 + int64_t(from * 1'000'000));
+	for (; slot < reader.slots(); slot = reader.next_frame(slot + 1)) {
+		auto &r = reader[slot];
+		auto t = r.ts - ts0;
+		if (to > 0 && t > int64_t(to * 1'000'000)) break;
+		frames.push_back({ t, r.frame.state });
+	}
+
+	return true;
+}
+
+// columnar archive (vgmpad_archive pack).
+static bool load_archive(const std::string &path, double from, double to, std::vector<Frame> &frames)
+{
+	GamepadArchiveReader reader;
+	if (!reader.open(path)) return false;
+
+	auto &chunks = reader.chunks();
+	if (chunks.empty()) return true;
+	auto ts0 = chunks.front().ts_first;
+	auto t_from = int64_t(from * 1'000'000);
+
+	std::vector<GamepadArchiveFrame> decoded;
+	for (auto i = reader.find(ts0 + t_from); i < chunks.size(); i++) {
+		decoded.clear();
+		if (!reader.read_chunk(i, decoded)) return false;
+		for (auto &f : decoded) {
+			auto t = f.ts - ts0;
+			if (t < t_from) continue;
+			if (to > 0 && t > int64_t(to * 1'000'000)) return true;
+			frames.push_back({ t, f.state });
+		}
+	}
+
+	return true;
+}
+
+// captured stdout. frames are assumed to be printed at fps.
+static bool load_json(const std::string &path, double fps, double from, double to, VirtualGamepad &vg, std::vector<Frame> &frames)
+{
+	std::string text;
+	if (!json_frames::read_file(path, text)) return false;
+
+	int64_t n = 0;
+	for (auto &js : json_frames::parse(text)) {
+		try {
+			from_json(js, vg);
+		} catch (njson::exception &e) {
+			continue;	// not a frame.
+		}
+		auto t = int64_t(n++ * 1'000'000 / fps);
+		if (t < int64_t(from * 1'000'000)) continue;
+		if (to > 0 && t > int64_t(to * 1'000'000)) break;
+		frames.push_back({ t, vg.get_state() });
+	}
+
+	return true;
+}
+
+static bool has_magic(const std::string &path, const char (&expected)[8])
+{
+	char magic[8] = {};
+	std::ifstream ifs(path, std::ios::binary);
+	ifs.read(magic, sizeof magic);
+	return ifs && std::equal(magic, magic + sizeof magic, expected);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3) {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	std::string input = argv[1];
+	auto [ name, service, protocol ] = VirtualGamepad::get_name_service(argv[2]);
+	if (name == "" && service == "" && protocol == "") {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	double speed = 1.0;	// 0: as fast as possible.
+	bool step = false;
+	double fps = 30.0;
+	double from = 0.0, to = 0.0;	// [sec].
+	int loop = 1;
+	int srt_latency = -1;
+	rendezvous::Config rdv;
+	std::vector<std::string> paths;
+	int fec_k = 0, fec_m = 0;
+	int history = 0;
+	for (int i = 3; i < argc; i++) {
+		std::string arg = argv[i];
+		auto has_next = (i + 1 < argc);
+		if (arg == "--speed" && has_next) {
+			std::string v = argv[++i];
+			speed = (v == "max") ? 0.0 : std::atof(v.c_str());
+			if (speed <= 0.0 && v != "max") {
+				print_usage();
+				exit(EXIT_FAILURE);
+			}
+		} else if (arg == "--step") {
+			step = true;
+		} else if (arg == "--fps" && has_next) {
+			fps = std::atof(argv[++i]);
+		} else if (arg == "--from" && has_next) {
+			from = std::atof(argv[++i]);
+		} else if (arg == "--to" && has_next) {
+			to = std::atof(argv[++i]);
+		} else if (arg == "--loop" && has_next) {
+			loop = std::atoi(argv[++i]);
+		} else if (arg == "--srt-latency" && has_next) {
+			srt_latency = std::atoi(argv[++i]);
+		} else if (arg == "--rendezvous" && has_next) {
+			if (!rdv.set_server(argv[++i])) {
+				print_usage();
+				exit(EXIT_FAILURE);
+			}
+		} else if (arg == "--session" && has_next) {
+			rdv.session = argv[++i];
+		} else if (arg == "--history" && has_next) {
+			history = std::atoi(argv[++i]);
+		} else if (arg == "--path" && has_next) {
+			paths.push_back(argv[++i]);
+		} else if (arg == "--fec" && has_next) {
+			std::string v = argv[++i];
+			auto pos = v.find(':');
+			auto k = v.substr(0, pos);
+			fec_k = (k == "auto") ? 0 : std::atoi(k.c_str());
+			fec_m = (pos == std::string::npos) ? 1 : std::atoi(v.c_str() + pos + 1);
+			if ((fec_k <= 0 && k != "auto") || fec_m <= 0) {
+				print_usage();
+				exit(EXIT_FAILURE);
+			}
+		} else {
+			print_usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (fps <= 0.0 || loop < 0) {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+	if (rdv.service.empty() != rdv.session.empty()) {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+	if (rdv.enabled() && protocol != "udp" && protocol != "srt") {
+		LogError("ERROR!! --rendezvous needs udp or srt.\n");
+		exit(EXIT_FAILURE);
+	}
+	if (history < 0 || history > VirtualGamepad::MAX_HISTORY) {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+	if ((!paths.empty() || fec_m > 0) && protocol != "udp") {
+		LogError("ERROR!! --path, --fec need udp.\n");
+		exit(EXIT_FAILURE);
+	}
+
+#ifdef USE_SRT
+	if (srt_startup() < 0) {
+		LogError("Unable to initialize SRT: %s\n", srt_getlasterror_str());
+		return EXIT_FAILURE;
+	}
+#endif
+
+	/*
+	 * attach signal handler
+	 */
+	if( signal(SIGINT, sig_handler) == SIG_ERR )
+		LogError("can't catch SIGINT\n");
+
+	std::unique_ptr<VirtualGamepad> vgmpad;
+	if (protocol == "udp") {
+		auto udp = VirtualGamepadUDP::Create(name, service, VirtualGamepad::em_Mode::SEND, rdv);
+		for (auto &path : paths) {
+			auto pos = path.rfind(':');
+			if (pos == std::string::npos || !udp->AddPath(path.substr(0, pos), path.substr(pos + 1))) {
+				LogError("ERROR!! path %s\n", path.c_str());
+				return EXIT_FAILURE;
+			}
+		}
+		if (fec_m > 0 && !udp->SetFec(fec_k, fec_m)) {
+			LogError("ERROR!! fec k=%d m=%d (k <= %d, m <= %d, m <= k)\n", fec_k, fec_m, FecEncoder::MAX_K, FecEncoder::MAX_M);
+			return EXIT_FAILURE;
+		}
+		vgmpad = std::move(udp);
+#if !defined(_WIN32)
+	} else if (protocol == "unix") {
+		vgmpad = VirtualGamepadUnix::Create(name, service, VirtualGamepad::em_Mode::SEND);
+	} else if (protocol == "tcp") {
+		vgmpad = VirtualGamepadTCP::Create(name, service, VirtualGamepad::em_Mode::SEND);
+#endif
+	} else {
+		vgmpad = VirtualGamepadSRT::Create(name, service, VirtualGamepad::em_Mode::SEND, srt_latency, rdv);
+	}
+	if (!vgmpad) {
+		LogError("ERROR!! open virtual gamepad.\n");
+		return EXIT_FAILURE;
+	}
+	vgmpad->SetHistory(history);
+
+	std::vector<Frame> frames;
+	bool ok;
+	if (has_magic(input, GamepadRecordHeader::MAGIC)) ok = load_record(input, from, to, frames);
+	else if (has_magic(input, GamepadArchiveHeader::MAGIC)) ok = load_archive(input, from, to, frames);
+	else ok = load_json(input, fps, from, to, *vgmpad, frames);
+	if (!ok) {
+		LogError("ERROR!! can't read %s\n", input.c_str());
+		return EXIT_FAILURE;
+	}
+	if (frames.empty()) {
+		LogError("ERROR!! no frame in %s\n", input.c_str());
+		return EXIT_FAILURE;
+	}
+	LogInfo("%zu frames, %.1f sec.\n", frames.size(), (frames.back().t - frames.front().t) / 1e6);
+
+	using clock = std::chrono::steady_clock;
+	uint64_t sent = 0, errors = 0, late = 0;
+	auto t_begin = clock::now();
+	for (int n = 0; (loop == 0 || n < loop) && !signal_recieved; n++) {
+		// schedule on absolute deadline, sleep error does not accumulate.
+		auto t_start = clock::now();
+		auto t0 = frames.front().t;
+		for (auto &f : frames) {
+			if (signal_recieved) break;
+
+			if (step) {
+				LogInfo("[%zu] t = %.3f sec, Enter to send.\n", sent, (f.t - t0) / 1e6);
+				std::string line;
+				if (!std::getline(std::cin, line)) {
+					signal_recieved = true;
+					break;
+				}
+			} else if (speed > 0.0) {
+				auto deadline = t_start + std::chrono::microseconds(int64_t((f.t - t0) / speed));
+				auto now = clock::now();
+				if (now > deadline + std::chrono::milliseconds(10)) late++;
+				else if (now < deadline) vgmpad->wait_control(std::chrono::duration_cast<std::chrono::microseconds>(deadline - now).count());
+			}
+
+			vgmpad->set_state(f.state);
+			if (vgmpad->send(0)) sent++;
+			else errors++;
+		}
+	}
+	auto elapsed = std::chrono::duration<double>(clock::now() - t_begin).count();
+
+	printf("sent %lu frames in %.2f sec (%.1f fps), error %lu, late %lu\n",
+		(unsigned long)sent, elapsed, sent / std::max(elapsed, 1e-9), (unsigned long)errors, (unsigned long)late);
+
+	vgmpad.reset();	// close before srt_cleanup().
+
+#ifdef USE_SRT
+	if (srt_cleanup() != 0) {
+		LogError("Unable to cleanup SRT: %s\n", srt_getlasterror_str());
+		return EXIT_FAILURE;
+	}
+#endif
+
+	return EXIT_SUCCESS;
+}
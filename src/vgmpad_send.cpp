@@ -25,6 +25,7 @@
 #include <fstream>
 #include <algorithm>
 #include <string>
+#include <vector>
 
 #include <chrono>
 #include <mutex>
@@ -46,26 +47,53 @@ namespace fs = std::filesystem;
 #include <srt.h>
 #endif
 #include "VirtualGamepad.h"
+#include "GamepadRecord.h"
+#include "devSynthetic.h"
 
 auto Usleep = [](uint64_t t) -> void {
 	std::this_thread::sleep_for(std::chrono::microseconds(t));
 };
 
 static bool signal_recieved = false;
+static volatile sig_atomic_t trace_dump_requested = 0;
 
 static void sig_handler(int signo)
 {
+	// only the flag, no log: not async-signal-safe.
 	if( signo == SIGINT )
 	{
-		LogVerbose("received SIGINT\n");
 		signal_recieved = true;
 	}
+	else if( signo == SIGUSR1 )
+	{
+		trace_dump_requested = 1;
+	}
 }
 
 static void print_usage()
 {
-	LogInfo("usage: vgmpad_send [host_name]:port[/protocol]\n");
-	LogInfo("  protocol: srt, udp. If not specified, it is 'srt'.\n");
+	LogInfo("usage: vgmpad_send [host_name]:port[/protocol] [options]\n");
+	LogInfo("  protocol: srt, udp, tcp, unix (same host). If not specified, it is 'srt'.\n");
+	LogInfo("  --synthetic pattern[:rate[:seed]] : use synthetic gamepad instead of SDL.\n");
+	LogInfo("      pattern: idle, sticks, random, storm, mixed. rate: events/sec.\n");
+	LogInfo("  --fps N : send rate. (default: 10)\n");
+	LogInfo("  --srt-latency MS : SRT latency. (default: libsrt default, 120)\n");
+	LogInfo("  --rendezvous HOST:PORT : punch a direct path, through vgmpad_rendezvous at HOST:PORT.\n");
+	LogInfo("      udp, srt only. the address above is used as the relay, until / unless punching succeeds.\n");
+	LogInfo("  --session ID : pairs the sender and the receiver at the rendezvous server.\n");
+	LogInfo("  --punch-timeout MS : give up punching after MS. (default: 5000)\n");
+	LogInfo("  --path HOST:PORT : send each frame to HOST:PORT too (another relay), the receiver keeps the first copy.\n");
+	LogInfo("      udp only. repeat for more paths.\n");
+	LogInfo("  --fec K[:M] : M parity packets per K frames (default M: 1), a lost frame is rebuilt without retransmission.\n");
+	LogInfo("      udp only. K = auto: from loss reported by the receiver.\n");
+	LogInfo("  --events [HZ] : button presses / releases over a reliable sub channel too, acked and sent again if lost.\n");
+	LogInfo("      udp only. the gamepad is polled at HZ (default: 250) for them, frames (axes) are still sent at --fps.\n");
+	LogInfo("  --history N : carry the previous N states (<= 12) in each frame, a lost frame is covered by the next one.\n");
+	LogInfo("  --record FILE : record every frame to FILE (binary, see GamepadRecord.h).\n");
+	LogInfo("  --trace FILE : record spans of the loop, write Chrome trace JSON to FILE at exit or on SIGUSR1.\n");
+	LogInfo("      (needs build with -DVGMPAD_TRACE=YES)\n");
+	LogInfo("  --metrics-file PATH : write metrics (Prometheus text format) to PATH every second.\n");
+	LogInfo("  --metrics-port N : serve metrics at http://127.0.0.1:N/metrics .\n");
 }
 
 int main(int argc, char *argv[])
@@ -81,11 +109,98 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
-	if (SDL_Init(SDL_INIT_GAMECONTROLLER | SDL_INIT_VIDEO) != 0) {
-		LogError("Unable to initialize SDL: %s\n", SDL_GetError());
-		return EXIT_FAILURE;
+	const char *synthetic = nullptr;
+	auto fps = 10.0;
+	std::string metrics_file;
+	int metrics_port = 0;
+	int srt_latency = -1;
+	rendezvous::Config rdv;
+	std::vector<std::string> paths;
+	int fec_k = 0, fec_m = 0;
+	int history = 0;
+	double events_hz = 0.0;
+	std::string trace_file;
+	std::string record_file;
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		auto has_next = (i + 1 < argc);
+		if (arg == "--synthetic") {
+			synthetic = (has_next && argv[i + 1][0] != '-') ? argv[++i] : "mixed";
+		} else if (arg == "--fps" && has_next) {
+			fps = std::atof(argv[++i]);
+		} else if (arg == "--srt-latency" && has_next) {
+			srt_latency = std::atoi(argv[++i]);
+		} else if (arg == "--rendezvous" && has_next) {
+			if (!rdv.set_server(argv[++i])) {
+				print_usage();
+				exit(EXIT_FAILURE);
+			}
+		} else if (arg == "--session" && has_next) {
+			rdv.session = argv[++i];
+		} else if (arg == "--punch-timeout" && has_next) {
+			rdv.timeout = std::atoi(argv[++i]);
+		} else if (arg == "--events") {
+			events_hz = (has_next && argv[i + 1][0] != '-') ? std::atof(argv[++i]) : 250.0;
+			if (events_hz <= 0.0) {
+				print_usage();
+				exit(EXIT_FAILURE);
+			}
+		} else if (arg == "--history" && has_next) {
+			history = std::atoi(argv[++i]);
+		} else if (arg == "--path" && has_next) {
+			paths.push_back(argv[++i]);
+		} else if (arg == "--fec" && has_next) {
+			std::string v = argv[++i];
+			auto pos = v.find(':');
+			auto k = v.substr(0, pos);
+			fec_k = (k == "auto") ? 0 : std::atoi(k.c_str());
+			fec_m = (pos == std::string::npos) ? 1 : std::atoi(v.c_str() + pos + 1);
+			if ((fec_k <= 0 && k != "auto") || fec_m <= 0) {
+				print_usage();
+				exit(EXIT_FAILURE);
+			}
+		} else if (arg == "--record" && has_next) {
+			record_file = argv[++i];
+		} else if (arg == "--trace" && has_next) {
+			trace_file = argv[++i];
+		} else if (arg == "--metrics-file" && has_next) {
+			metrics_file = argv[++i];
+		} else if (arg == "--metrics-port" && has_next) {
+			metrics_port = std::atoi(argv[++i]);
+		} else {
+			print_usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (fps <= 0.0) {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+	if (rdv.service.empty() != rdv.session.empty()) {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+	if (rdv.enabled() && protocol != "udp" && protocol != "srt") {
+		LogError("ERROR!! --rendezvous needs udp or srt.\n");
+		exit(EXIT_FAILURE);
+	}
+	if (history < 0 || history > VirtualGamepad::MAX_HISTORY) {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+	if ((!paths.empty() || fec_m > 0 || events_hz > 0.0) && protocol != "udp") {
+		LogError("ERROR!! --path, --fec, --events need udp.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// synthetic gamepad runs headless, without SDL.
+	if (!synthetic) {
+		if (SDL_Init(SDL_INIT_GAMECONTROLLER | SDL_INIT_VIDEO) != 0) {
+			LogError("Unable to initialize SDL: %s\n", SDL_GetError());
+			return EXIT_FAILURE;
+		}
+		atexit(SDL_Quit);
 	}
-	atexit(SDL_Quit);
 
 #ifdef USE_SRT
 	if (srt_startup() < 0) {
@@ -99,43 +214,146 @@ int main(int argc, char *argv[])
 	 */
 	if( signal(SIGINT, sig_handler) == SIG_ERR )
 		LogError("can't catch SIGINT\n");
+	if( signal(SIGUSR1, sig_handler) == SIG_ERR )
+		LogError("can't catch SIGUSR1\n");
+
+	if (!trace_file.empty()) {
+#if defined(VGMPAD_TRACE)
+		Trace::start(trace_file);
+		Trace::set_thread_name("vgmpad_send");
+#else
+		LogError("WARNING!! built without VGMPAD_TRACE, --trace is ignored.\n");
+#endif
+	}
 
-	std::unique_ptr<GamepadDevice> gamepad;
+	std::unique_ptr<GamepadSource> gamepad;
 
 	// create gamepad.
-	gamepad = GamepadDevice::Create();
+	if (synthetic) {
+		gamepad = SyntheticGamepad::Create(synthetic);
+		if (!gamepad) {
+			print_usage();
+			return EXIT_FAILURE;
+		}
+	} else {
+		gamepad = GamepadDevice::Create();
+	}
 
 	std::unique_ptr<VirtualGamepad> vgmpad;
 	if (protocol == "udp") {
-		vgmpad = VirtualGamepadUDP::Create(name, service, VirtualGamepad::em_Mode::SEND);
+		auto udp = VirtualGamepadUDP::Create(name, service, VirtualGamepad::em_Mode::SEND, rdv);
+		for (auto &path : paths) {
+			auto pos = path.rfind(':');
+			if (pos == std::string::npos || !udp->AddPath(path.substr(0, pos), path.substr(pos + 1))) {
+				LogError("ERROR!! path %s\n", path.c_str());
+				return EXIT_FAILURE;
+			}
+		}
+		if (fec_m > 0 && !udp->SetFec(fec_k, fec_m)) {
+			LogError("ERROR!! fec k=%d m=%d (k <= %d, m <= %d, m <= k)\n", fec_k, fec_m, FecEncoder::MAX_K, FecEncoder::MAX_M);
+			return EXIT_FAILURE;
+		}
+		udp->SetEvents(events_hz > 0.0);
+		vgmpad = std::move(udp);
+#if !defined(_WIN32)
+	} else if (protocol == "unix") {
+		vgmpad = VirtualGamepadUnix::Create(name, service, VirtualGamepad::em_Mode::SEND);
+	} else if (protocol == "tcp") {
+		vgmpad = VirtualGamepadTCP::Create(name, service, VirtualGamepad::em_Mode::SEND);
+#endif
 	} else {
-		vgmpad = VirtualGamepadSRT::Create(name, service, VirtualGamepad::em_Mode::SEND);
+		vgmpad = VirtualGamepadSRT::Create(name, service, VirtualGamepad::em_Mode::SEND, srt_latency, rdv);
 	}
 	if (!vgmpad) {
 		LogError("ERROR!! open virtual gamepad.\n");
 		return EXIT_FAILURE;
 	}
+	vgmpad->SetHistory(history);
+
+	GamepadRecordWriter recorder;
+	if (!record_file.empty()) {
+		if (!recorder.open(record_file, argv[1], false)) {
+			LogError("ERROR!! open record file %s\n", record_file.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+
+	MetricsExporter metrics;
+	if (!metrics_file.empty() || metrics_port > 0) {
+		auto labels = "mode=\"send\",protocol=\"" + protocol + "\"";
+		auto source = [&vgmpad, labels]() -> std::string {
+			return VirtualGamepadMetrics::to_prometheus(vgmpad->GetMetricsSnapshot(), labels);
+		};
+		if (!metrics.start(source, metrics_file, metrics_port)) {
+			LogError("ERROR!! start metrics exporter.\n");
+			return EXIT_FAILURE;
+		}
+	}
 	njson js;
 	to_json(js, *vgmpad);
 	from_json(js, *vgmpad);
+	const int64_t frame_interval = (1.0 / fps) * 1'000'000.0;	// [usec].
+	int64_t next_frame = 0;
 	while (!signal_recieved) {
-		uint32_t timeout = 1000;	// dummy.
-		gamepad->Poll(timeout);
+		TRACE_SCOPE("frame");
+		{
+			TRACE_SCOPE("gamepad.poll");
+			uint32_t timeout = 1000;	// dummy.
+			gamepad->Poll(timeout);
+		}
 
 		if (gamepad->IsAttached()) {
+			TRACE_SCOPE("update");
 			vgmpad->update(gamepad);
 		}
 
-		// std::cout << vgmpad << std::endl;
-		to_json(js, *vgmpad);
-		std::cout << std::setw(4) << js << std::endl;
+		// between frames, button events only.
+		if (events_hz > 0.0) {
+			auto now = VirtualGamepad::get_time_us();
+			if (now < next_frame) {
+				{
+					TRACE_SCOPE("send_events");
+					vgmpad->send_events();
+				}
+				TRACE_SCOPE("sleep");
+				vgmpad->wait_control(std::min<int64_t>(1'000'000.0 / events_hz, next_frame - now));
+				continue;
+			}
+			next_frame = (now - next_frame < frame_interval) ? next_frame + frame_interval : now + frame_interval;
+		}
+
+		{
+			TRACE_SCOPE("print");
+			// std::cout << vgmpad << std::endl;
+			to_json(js, *vgmpad);
+			std::cout << std::setw(4) << js << std::endl;
+		}
 
-		vgmpad->send(33);
+		{
+			TRACE_SCOPE("send");
+			vgmpad->send(33);
+		}
 
-		auto fps = 10.0;
-		Usleep((1.0 / fps) * 1'000'000.0);
+		if (recorder.IsOpen()) {
+			TRACE_SCOPE("record");
+			recorder.write(vgmpad->GetSeq(), vgmpad->GetSendTime(), 0, vgmpad->get_state());
+		}
+
+		if (trace_dump_requested) {
+			trace_dump_requested = 0;
+			Trace::dump();
+		}
+
+		TRACE_SCOPE("sleep");
+		vgmpad->wait_control(events_hz > 0.0 ? 1'000'000.0 / events_hz : (1.0 / fps) * 1'000'000.0);
 	}
 
+	metrics.stop();
+	recorder.close();
+	if (Trace::enabled()) Trace::dump();
+
+	vgmpad.reset();	// close before srt_cleanup().
+
 #ifdef USE_SRT
 	if (srt_cleanup() != 0) {
 		LogError("Unable to cleanup SRT: %s\n", srt_getlasterror_str());
@@ -0,0 +1,144 @@
+/* MIT License
+ *
+ *  Copyright (c) 2022 edgecraft.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+// read the state published by vgmpad_recv --shm NAME.
+
+#include <iostream>
+#include <algorithm>
+#include <string>
+
+#include <chrono>
+#include <thread>
+#include <signal.h>
+
+#include "json.hpp"
+#include "Logger.h"
+#include "SharedState.h"
+
+using njson = nlohmann::json;
+
+static bool signal_recieved = false;
+
+static void sig_handler(int signo)
+{
+	// only the flag, no log: not async-signal-safe.
+	if( signo == SIGINT )
+	{
+		signal_recieved = true;
+	}
+}
+
+static void print_usage()
+{
+	LogInfo("usage: vgmpad_shm NAME [options]\n");
+	LogInfo("  NAME     : shared memory name given to vgmpad_recv --shm.\n");
+	LogInfo("  (default): print input events as JSON, one per line.\n");
+	LogInfo("  --latest : print the latest frame and exit.\n");
+	LogInfo("  --bench  : measure time to read the latest frame.\n");
+}
+
+static void print_frame(const SharedGamepadFrame &f)
+{
+	njson js = {
+		{ "seq", f.seq },
+		{ "ts_send", f.ts_send },
+		{ "ts_recv", f.ts_recv },
+		{ "ts_publish", f.ts_publish },
+		{ "axis", f.state.axis },
+		{ "buttons", f.state.buttons },
+		{ "flags", f.state.flags },
+	};
+	printf("%s\n", js.dump().c_str());
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+
+	std::string name = argv[1];
+	bool latest = false;
+	bool bench = false;
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--latest") {
+			latest = true;
+		} else if (arg == "--bench") {
+			bench = true;
+		} else {
+			print_usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if( signal(SIGINT, sig_handler) == SIG_ERR )
+		LogError("can't catch SIGINT\n");
+
+	SharedStateReader reader;
+	if (!reader.open(name)) {
+		LogError("ERROR!! open shared memory %s\n", name.c_str());
+		return EXIT_FAILURE;
+	}
+	LogInfo("%s: %.*s, writer pid %u\n", name.c_str(), int(sizeof reader.segment()->source), reader.segment()->source, reader.segment()->pid);
+
+	SharedGamepadFrame f;
+	if (latest) {
+		if (!reader.read(f)) {
+			LogError("no frame yet, or the writer stopped while writing.\n");
+			return EXIT_FAILURE;
+		}
+		print_frame(f);
+		return EXIT_SUCCESS;
+	}
+
+	if (bench) {
+		constexpr int N = 10'000'000;
+		uint64_t sum = 0;
+		auto t0 = std::chrono::steady_clock::now();
+		for (int i = 0; i < N; i++) {
+			reader.read(f);
+			sum += f.seq;
+		}
+		auto sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		printf("read latest: %.1f ns/read (%d reads, checksum %lu)\n", sec / N * 1e9, N, (unsigned long)sum);
+		return EXIT_SUCCESS;
+	}
+
+	SharedGamepadFrame events[64];
+	uint64_t lost = 0, lost_reported = 0;
+	while (!signal_recieved) {
+		auto n = reader.read_events(events, 64, &lost);
+		for (size_t i = 0; i < n; i++) print_frame(events[i]);
+		if (lost != lost_reported) {
+			LogError("%lu events lost.\n", (unsigned long)(lost - lost_reported));
+			lost_reported = lost;
+		}
+		if (n > 0) fflush(stdout);
+		else std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,68 @@
+# vgmpad_archive pack -> cat round trip of captured stdout (no time stamp, --fps).
+# 6000 frames at 30 fps = 200 sec, past 4295 frames where seq * 1'000'000 overflowed
+# 32 bits and the time stamps went back.
+#
+#   cmake -DARCHIVE=path/to/vgmpad_archive -DWORK=dir -P archive_roundtrip.cmake
+
+set(FRAMES 6000)
+set(FPS 30)
+
+file(MAKE_DIRECTORY ${WORK})
+set(input ${WORK}/stdout.txt)
+set(archive ${WORK}/stdout.vga)
+
+# frame i has axis_Left_X = i.
+set(text "")
+math(EXPR last "${FRAMES} - 1")
+foreach(i RANGE ${last})
+	string(APPEND text "{\"axis_motion\":true,\"button_down\":false,\"button_up\":false,"
+		"\"axis_Left_X\":${i},\"axis_Left_Y\":0,\"axis_Right_X\":0,\"axis_Right_Y\":0,\"axis_Trigger_L\":0,\"axis_Trigger_R\":0,"
+		"\"button_A\":0,\"button_B\":0,\"button_X\":0,\"button_Y\":0,\"button_Back\":0,\"button_Guide\":0,\"button_Start\":0,"
+		"\"button_Stick_L\":0,\"button_Stick_R\":0,\"button_Shoulder_L\":0,\"button_Shoulder_R\":0,"
+		"\"button_Dpad_U\":0,\"button_Dpad_D\":0,\"button_Dpad_L\":0,\"button_Dpad_R\":0}\n")
+endforeach()
+file(WRITE ${input} "${text}")
+
+execute_process(COMMAND ${ARCHIVE} pack ${input} ${archive} --fps ${FPS} RESULT_VARIABLE ret OUTPUT_QUIET)
+if(NOT ret EQUAL 0)
+	message(FATAL_ERROR "pack failed: ${ret}")
+endif()
+
+# all frames, in order, at i / fps.
+execute_process(COMMAND ${ARCHIVE} cat ${archive} RESULT_VARIABLE ret OUTPUT_VARIABLE out)
+if(NOT ret EQUAL 0)
+	message(FATAL_ERROR "cat failed: ${ret}")
+endif()
+string(REGEX MATCHALL "[^\n]+" lines "${out}")
+list(LENGTH lines n)
+if(NOT n EQUAL FRAMES)
+	message(FATAL_ERROR "cat: ${n} frames, expected ${FRAMES}")
+endif()
+set(ts0 "")
+set(i 0)
+foreach(line IN LISTS lines)
+	if(NOT line MATCHES "\"axis\":\\[([0-9]+),.*\"seq\":([0-9]+),\"ts\":([0-9]+)")
+		message(FATAL_ERROR "cat: unexpected line ${line}")
+	endif()
+	set(axis ${CMAKE_MATCH_1})
+	set(seq ${CMAKE_MATCH_2})
+	set(ts ${CMAKE_MATCH_3})
+	if(ts0 STREQUAL "")
+		set(ts0 ${ts})
+	endif()
+	math(EXPR dt "${ts} - ${ts0}")
+	math(EXPR expect "${i} * 1000000 / ${FPS}")
+	if(NOT axis EQUAL i OR NOT seq EQUAL i OR NOT dt EQUAL expect)
+		message(FATAL_ERROR "frame ${i}: axis ${axis}, seq ${seq}, ts +${dt} (expected +${expect})")
+	endif()
+	math(EXPR i "${i} + 1")
+endforeach()
+
+# --from 150 : frames 4500 ..
+execute_process(COMMAND ${ARCHIVE} cat ${archive} --from 150 RESULT_VARIABLE ret OUTPUT_VARIABLE out)
+string(REGEX MATCHALL "[^\n]+" lines "${out}")
+list(LENGTH lines n)
+math(EXPR expect "${FRAMES} - 150 * ${FPS}")
+if(NOT ret EQUAL 0 OR NOT n EQUAL expect)
+	message(FATAL_ERROR "cat --from 150: ${n} frames, expected ${expect}")
+endif()